@@ -0,0 +1,76 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+#include "data.hpp"
+
+using namespace std;
+
+/**
+ * A set of article ids as a dense bitset, one bit per article, e.g. the
+ * articles excluded from path searches. Membership tests are a single
+ * memory access (the searches test every link they follow), clear() only
+ * writes the words used so far.
+ */
+class ArticleBitset {
+public:
+  typedef WikiData::ArticleID ArticleID;
+
+private:
+  vector<uint64_t> words;
+  size_t n_articles = 0;
+
+public:
+  /**
+   * Adds 'article', returns whether it was not contained before.
+   */
+  bool insert(ArticleID article) {
+    size_t w = article / 64;
+    if (w >= words.size())
+      words.resize(w + 1);
+    uint64_t bit = (uint64_t)1 << (article % 64);
+    if (words[w] & bit)
+      return false;
+    words[w] |= bit;
+    n_articles++;
+    return true;
+  }
+
+  template<typename It>
+  void insert(It first, It last) {
+    for (; first != last; ++first) {
+      insert(*first);
+    }
+  }
+
+  size_t count(ArticleID article) const {
+    size_t w = article / 64;
+    return w < words.size() && (words[w] >> (article % 64) & 1);
+  }
+
+  size_t size() const {
+    return n_articles;
+  }
+
+  bool empty() const {
+    return !n_articles;
+  }
+
+  void clear() {
+    fill(words.begin(), words.end(), 0);
+    n_articles = 0;
+  }
+
+  /**
+   * Articles 64 * i .. 64 * i + 63, as bits of word i (LSB first). Words
+   * beyond word_count() are 0.
+   */
+  size_t word_count() const {
+    return words.size();
+  }
+
+  uint64_t word(size_t i) const {
+    return words[i];
+  }
+};
@@ -0,0 +1,165 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+
+#include "data.hpp"
+
+using namespace std;
+
+/**
+ * Scratch state of a graph search: a parent per article and a work queue,
+ * both sized for the whole link database and reused across searches.
+ *
+ * Instead of clearing the parents before each search, every entry carries
+ * the epoch (search number) it was written in, entries of older epochs
+ * count as unset. Starting a search is O(1), so a search costs time
+ * proportional to the articles it touches instead of the number of
+ * articles. The epoch and parent share one 64 bit word, a lookup is a
+ * single memory access.
+ */
+class BFSWorkspace {
+public:
+  typedef WikiData::ArticleID ArticleID;
+
+private:
+  // epoch in the upper, parent in the lower 32 bits.
+  vector<uint64_t> entries;
+  uint32_t epoch = 0;
+
+  // ring buffer, at least as large as the link database. A search queues
+  // each article at most once, so it never overflows.
+  vector<ArticleID> queue;
+  size_t queue_mask = 0;
+  size_t head = 0;
+  size_t tail = 0;
+
+public:
+  BFSWorkspace() { }
+  BFSWorkspace(const BFSWorkspace &other) = delete;
+  BFSWorkspace& operator=(const BFSWorkspace &other) = delete;
+
+  /**
+   * Starts a new search on 'n_articles' articles: unsets all parents and
+   * empties the queue.
+   */
+  void reset(size_t n_articles) {
+    if (entries.size() != n_articles) {
+      vector<uint64_t>(n_articles, 0).swap(entries);
+      size_t capacity = 1;
+      while (capacity < n_articles)
+        capacity *= 2;
+      vector<ArticleID>(capacity).swap(queue);
+      queue_mask = capacity - 1;
+      epoch = 0;
+    }
+    if (++epoch == 0) {
+      // wrapped around, entries of the first epoch would be valid again.
+      fill(entries.begin(), entries.end(), 0);
+      epoch = 1;
+    }
+    head = tail = 0;
+  }
+
+  bool is_set(ArticleID article) const {
+    return entries[article] >> 32 == epoch;
+  }
+
+  ArticleID parent(ArticleID article) const {
+    return (ArticleID)entries[article];
+  }
+
+  void set(ArticleID article, ArticleID parent) {
+    entries[article] = ((uint64_t)epoch << 32) | parent;
+  }
+
+  bool queue_empty() const {
+    return head == tail;
+  }
+
+  void push(ArticleID article) {
+    queue[tail++ & queue_mask] = article;
+  }
+
+  ArticleID pop() {
+    return queue[head++ & queue_mask];
+  }
+
+  size_t memory_usage() const {
+    return entries.size() * sizeof(uint64_t) + queue.size() * sizeof(ArticleID);
+  }
+};
+
+
+/**
+ * Workspaces of finished searches, for the next ones. acquire() and the
+ * release of a Handle may be called from any thread.
+ */
+class BFSWorkspacePool {
+  mutex lock;
+  vector<unique_ptr<BFSWorkspace>> available;
+
+public:
+  /**
+   * A workspace in use, returned to the pool when the handle is destroyed.
+   */
+  class Handle {
+    BFSWorkspacePool *pool;
+    unique_ptr<BFSWorkspace> workspace;
+
+  public:
+    Handle(BFSWorkspacePool *pool, unique_ptr<BFSWorkspace> workspace)
+      : pool(pool), workspace(move(workspace)) { }
+    Handle(Handle &&other) = default;
+
+    ~Handle() {
+      if (workspace)
+        pool->release(move(workspace));
+    }
+
+    BFSWorkspace& operator*() const { return *workspace; }
+    BFSWorkspace* operator->() const { return workspace.get(); }
+  };
+
+  /**
+   * A workspace reset for a search on 'n_articles' articles.
+   */
+  Handle acquire(size_t n_articles) {
+    unique_ptr<BFSWorkspace> workspace;
+    {
+      lock_guard<mutex> guard(lock);
+      if (available.size()) {
+        workspace = move(available.back());
+        available.pop_back();
+      }
+    }
+    if (!workspace)
+      workspace.reset(new BFSWorkspace());
+    workspace->reset(n_articles);
+    return Handle(this, move(workspace));
+  }
+
+  /**
+   * Frees the memory of all workspaces not in use.
+   */
+  void clear() {
+    lock_guard<mutex> guard(lock);
+    available.clear();
+  }
+
+  /**
+   * The pool used by the graph searches by default.
+   */
+  static BFSWorkspacePool& shared() {
+    static BFSWorkspacePool pool;
+    return pool;
+  }
+
+private:
+  void release(unique_ptr<BFSWorkspace> workspace) {
+    lock_guard<mutex> guard(lock);
+    available.push_back(move(workspace));
+  }
+};
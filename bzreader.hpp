@@ -2,21 +2,34 @@
 #include <string>
 #include <cstring>
 #include <stdexcept>
+#include <memory>
+#include <boost/utility/string_ref.hpp>
 #include <bzlib.h>
 #include <fcntl.h>
 #include <errno.h>
 
+#include "parallel_bzdecompressor.hpp"
+
 using namespace std;
 /**
  * Simple wrapper around libbz2, because i ran into this bug:
  * http://stackoverflow.com/questions/3167109/exceptions-from-boostiostreamscopy
+ *
+ * With more than one decompression thread, the file is decompressed block-wise
+ * by a ParallelBzDecompressor instead.
  */
 class BzReader {
-  FILE * _file;
-  void * _bzfile;
+  FILE * _file = NULL;
+  void * _bzfile = NULL;
   const char linedelim = '\n';
   const static size_t buffsize = 4096;
   char buffer[buffsize];
+  const static size_t chunk_size = 1 << 20;
+  // points to 'buffer' or 'block'
+  const char* data = buffer;
+
+  unique_ptr<ParallelBzDecompressor> parallel;
+  string block;
 
   int nunused = 0;
   const static size_t max_unused = 5000; // BZ_MAX_UNUSED as of bzlib2 1.0.5
@@ -29,7 +42,11 @@ class BzReader {
   bool eof = false;
 
   public:
-  BzReader(string filename) {
+  BzReader(string filename, size_t decompress_threads = 1) {
+    if (decompress_threads > 1) {
+      parallel.reset(new ParallelBzDecompressor(filename, decompress_threads));
+      return;
+    }
     _file = fopen(filename.c_str(), "r");
     if (_file == NULL) {
       throw std::runtime_error("Unable to open file " + filename + ", errno=" + to_string(errno) + " (" + strerror(errno) + ")");
@@ -53,6 +70,17 @@ class BzReader {
   bool read_more() {
     if (eof)
       return false;
+    if (parallel) {
+      if (!parallel->next_block(block)) {
+        eof = true;
+        buffer_end = 0;
+        next_read = 0;
+        return false;
+      }
+      data = block.data();
+      buffer_end = block.size();
+      return true;
+    }
     int bzerror = BZ_OK;
     int nBuf = BZ2_bzRead(&bzerror, _bzfile, buffer, buffsize);
     if (bzerror != BZ_OK && bzerror != BZ_STREAM_END) {
@@ -67,6 +95,7 @@ class BzReader {
         eof = true;
         if (nBuf == 0) {
           buffer_end = 0;
+          next_read = 0;
           return false;
         }
         buffer_end = nBuf;
@@ -90,23 +119,25 @@ class BzReader {
 
   public:
   ~BzReader() {
+    if (parallel)
+      return;
     close_stream();
     fclose(_file);
   }
 
   string readline() {
     string ret;
-    ret.reserve(buffsize);
     while (true) {
-      while (next_read < buffer_end) {
-        if (buffer[next_read] == linedelim) {
-          next_read++;
-          return ret;
-        }
-        ret.push_back(buffer[next_read]);
-        next_read++;
+      const char *begin = data + next_read;
+      const char *delim = (const char*)memchr(begin, linedelim, buffer_end - next_read);
+      if (delim) {
+        ret.append(begin, delim);
+        next_read += delim - begin + 1;
+        return ret;
       }
-      
+      ret.append(begin, data + buffer_end);
+      next_read = buffer_end;
+
       if (!read_more()) {
         return ret;
       }
@@ -117,8 +148,71 @@ class BzReader {
   }
 
 
+  /**
+   * Replaces the content of 'chunk' with the next complete lines of the
+   * file, at least 'min_size' bytes unless the end of the file is reached.
+   * Every line in the chunk is terminated by '\n', except possibly the
+   * last line of the file. Use LineSplitter to iterate over the lines.
+   * Returns false if there isn't any more data.
+   */
+  bool read_chunk(string &chunk, size_t min_size = chunk_size) {
+    chunk.clear();
+    chunk.reserve(min_size + buffsize);
+    while (true) {
+      const char *begin = data + next_read;
+      const char *end = data + buffer_end;
+      if (chunk.size() + (end - begin) >= min_size) {
+        // cut after the last delimiter, leave the rest for the next chunk.
+        const char *last = end;
+        while (last > begin && last[-1] != linedelim)
+          last--;
+        if (last > begin && chunk.size() + (last - begin) >= min_size) {
+          chunk.append(begin, last);
+          next_read += last - begin;
+          return true;
+        }
+      }
+      chunk.append(begin, end);
+      next_read = buffer_end;
+
+      if (!read_more()) {
+        return chunk.size() > 0;
+      }
+      next_read = 0;
+    }
+  }
+
+
+  // true once all data has been returned by readline() / read_chunk().
   bool done() const {
-    return eof;
+    return eof && next_read >= buffer_end;
   }
 };
 
+
+/**
+ * Iterates over the lines of a chunk returned by BzReader::read_chunk.
+ * The lines point into the chunk and don't include the delimiter.
+ */
+class LineSplitter {
+  const char *pos;
+  const char *end;
+
+  public:
+  LineSplitter(const string &chunk) : pos(chunk.data()), end(chunk.data() + chunk.size()) {}
+
+  // returns false after the last line.
+  bool next(boost::string_ref &line) {
+    if (pos == end)
+      return false;
+    const char *delim = (const char*)memchr(pos, '\n', end - pos);
+    if (!delim) {
+      line = boost::string_ref(pos, end - pos);
+      pos = end;
+      return true;
+    }
+    line = boost::string_ref(pos, delim - pos);
+    pos = delim + 1;
+    return true;
+  }
+};
@@ -1,9 +1,12 @@
 #include <set>
 #include <iomanip>
 #include <queue>
+#include <memory>
+#include <fstream>
 #include <boost/algorithm/string/trim.hpp>
 #include "data.hpp"
 #include "graph_bfs.hpp"
+#include "parallel_bfs.hpp"
 // Command-line querying /*{{{*/
 
 using namespace std;
@@ -11,13 +14,28 @@ using namespace std;
 class CLI {
   typedef WikiData::ArticleID ArticleID;
   const WikiData &wikidata;
+  // the searches work on vertex ids (see WikiData::vertex_of), so do the
+  // excluded articles.
   GraphBFS::ArticleSet path_exclude_set;
+  // decode buffers for labels and resources, reused between queries.
+  mutable string resource_buffer;
+  mutable string label_buffer;
+  // threads of the parallel BFS, which is created on first use.
+  const size_t bfs_threads;
+  unique_ptr<ParallelBFS> parallel_bfs;
+
+  ParallelBFS& get_parallel_bfs() {
+    if (!parallel_bfs)
+      parallel_bfs.reset(new ParallelBFS(wikidata, bfs_threads));
+    return *parallel_bfs;
+  }
 
   void dump_article_info(ArticleID idx) const {
     // the additional space is on purpose to make selection on command
     // line easier.
     cout << setw(9) << idx << " : "
-         << wikidata.resource_by_id(idx) << " \"" << wikidata.label_by_id(idx)
+         << wikidata.resource_by_id(idx, resource_buffer) << " \""
+         << wikidata.label_by_id(idx, label_buffer)
          << '"' << endl;
   }
 
@@ -77,14 +95,19 @@ class CLI {
     cout << " path <from> <to>" << endl;
     cout << " path* <from> <to>" << endl;
     cout << " path-undirected[*] <from> <to>" << endl;
+    cout << " distances[-undirected] <id>" << endl;
+    cout << " component <id>" << endl;
+    cout << " distance <from> <to>" << endl;
     cout << " path-exclude-add <id>" << endl;
+    cout << " path-exclude-file <file>" << endl;
+    cout << " path-exclude-degree <n>" << endl;
     cout << " path-exclude-clear" << endl;
   }
 
 
   void dump_path(const GraphBFS::Path &p) const {
-    for (const auto& a: p) {
-      dump_article_info(a);
+    for (const auto& v: p) {
+      dump_article_info(wikidata.article_of(v));
     }
   }
 
@@ -102,15 +125,10 @@ class CLI {
   }
 
 
-  void graph_interface(const string& cmd, const string &rem, bool undirected) {
-      string from, to;
-      split_one(from, to, rem);
-      ArticleID from_idx = stoul(from);
-      ArticleID to_idx = stoul(to);
-      GraphBFS bfs(wikidata, path_exclude_set, from_idx, to_idx, undirected);
-
+  template<typename Search>
+  void print_paths(const string& cmd, Search &search) {
       while (true) {
-        GraphBFS::Path next = bfs.next(); 
+        GraphBFS::Path next = search.next();
         if (!next.size())
           break;
         dump_path(next);
@@ -124,41 +142,161 @@ class CLI {
       }
   }
 
-  void run_query(string& input) {
-    boost::trim(input);
+  void graph_interface(const string& cmd, const string &rem, bool undirected) {
+      string from, to;
+      split_one(from, to, rem);
+      ArticleID from_idx = wikidata.vertex_of(stoul(from));
+      ArticleID to_idx = wikidata.vertex_of(stoul(to));
+      wikidata.check_articleid_linkdb(from_idx);
+      wikidata.check_articleid_linkdb(to_idx);
+      if (!wikidata.components.path_possible(from_idx, to_idx, undirected)) {
+        cout << "no path" << endl;
+        return;
+      }
+      if (cmd == "path" && !wikidata.distance_index.empty() &&
+          path_exclude_set.empty() && from_idx != to_idx) {
+        GraphBFS::Path path = distance_index_path(wikidata, from_idx, to_idx);
+        if (path.size())
+          dump_path(path);
+        return;
+      }
+      // the bidirectional search below is much faster, A* only pays off
+      // without the incoming links.
+      if (cmd == "path" && !wikidata.landmarks.empty() && !wikidata.has_incoming_links() &&
+          from_idx != to_idx) {
+        LandmarkSearch search(wikidata, path_exclude_set, from_idx, to_idx);
+        GraphBFS::Path path = search.next();
+        if (path.size())
+          dump_path(path);
+        cout << "(A* search visited " << search.visited_count() << " articles)" << endl;
+        return;
+      }
+      // searching from both ends needs the incoming links.
+      if (wikidata.has_incoming_links() && from_idx != to_idx) {
+        BidirectionalBFS bfs(wikidata, path_exclude_set, from_idx, to_idx, undirected);
+        print_paths(cmd, bfs);
+      } else if (cmd[cmd.size()-1] != '*' && from_idx != to_idx) {
+        // a single path, the parallel search finds one per query.
+        GraphBFS::Path path = get_parallel_bfs().path(from_idx, to_idx, path_exclude_set, undirected);
+        if (path.size())
+          dump_path(path);
+      } else {
+        GraphBFS bfs(wikidata, path_exclude_set, from_idx, to_idx, undirected);
+        print_paths(cmd, bfs);
+      }
+  }
 
-    string first, rem;
-    split_one(first, rem, input);
+  void distances_interface(const string &rem, bool undirected) {
+    ArticleID idx = wikidata.vertex_of(stoul(rem));
+    ParallelBFS &bfs = get_parallel_bfs();
+    const vector<ParallelBFS::Distance> &distances = bfs.distances(idx, path_exclude_set, undirected);
+    // number of articles per distance
+    vector<size_t> histogram;
+    size_t unreachable = 0;
+    for (ParallelBFS::Distance d: distances) {
+      if (d == bfs.UNREACHABLE) {
+        unreachable++;
+        continue;
+      }
+      if (d >= histogram.size())
+        histogram.resize(d + 1);
+      histogram[d]++;
+    }
+    for (size_t d = 0; d < histogram.size(); ++d) {
+      cout << setw(4) << d << " : " << histogram[d] << endl;
+    }
+    cout << "unreachable : " << unreachable << endl;
+    const ParallelBFS::Stats &stats = bfs.last_stats();
+    cout << "(" << stats.top_down_levels << " top-down, " << stats.bottom_up_levels
+         << " bottom-up levels on " << bfs_threads << " threads)" << endl;
+  }
 
-    if (first == "resource") {
-      query_by_resource(rem);
-    } else if (first == "label") {
-      query_by_label(rem);
-    } else if (first == "id") {
-      ArticleID idx = stoul(rem);
-      query_by_id(idx);
-    } else if (first == "outs") {
-      ArticleID idx = stoul(rem);
-      query_links(idx, true, false);
-    } else if (first == "ins") {
-      ArticleID idx = stoul(rem);
-      query_links(idx, false, true);
-    } else if (first == "inouts") { 
-      ArticleID idx = stoul(rem);
-      query_links(idx, true, true);
-    } else if (first == "path" || first == "path*") {
-      graph_interface(first, rem, false);
-    } else if (first == "path-undirected" || first == "path-undirected*") {
-      graph_interface(first, rem, true);
-    } else if (first == "path-exclude-add") {
-      ArticleID excl = stoul(rem);
+  /**
+   * Excludes all article ids (separated by whitespace) in 'filename'.
+   */
+  void exclude_file(const string &filename) {
+    ifstream in(filename);
+    if (!in)
+      throw std::runtime_error("Cannot open " + filename);
+    ArticleID excl;
+    size_t added = 0;
+    while (in >> excl) {
       wikidata.check_articleid(excl);
-      path_exclude_set.insert(excl); 
-    } else if (first == "path-exclude-clear") {
-      path_exclude_set.clear();
+      added += path_exclude_set.insert(wikidata.vertex_of(excl));
+    }
+    if (!in.eof())
+      throw std::runtime_error("Invalid article id in " + filename);
+    cout << "Excluded " << added << " more articles, " << path_exclude_set.size() << " in total." << endl;
+  }
+
+
+  /**
+   * Excludes all articles with more than 'max_links' links.
+   */
+  void exclude_degree(size_t max_links) {
+    size_t added = 0;
+    for (ArticleID v = 0; v < wikidata.linkdb_size(); ++v) {
+      if (wikidata.outlink_count(v) + wikidata.inlinks_of(v).size() > max_links)
+        added += path_exclude_set.insert(v);
+    }
+    cout << "Excluded " << added << " more articles, " << path_exclude_set.size() << " in total." << endl;
+  }
+
+
+  void query_component(ArticleID article) const {
+    wikidata.check_articleid_linkdb(article);
+    article = wikidata.vertex_of(article);
+    const Components &components = wikidata.components;
+    if (components.empty()) {
+      cout << "Connected components were not computed." << endl;
+      return;
+    }
+    cout << "weakly connected component " << components.weak[article] << " of "
+         << components.weak_sizes.size() << ": " << components.weak_size(article) << " articles" << endl;
+    cout << "strongly connected component " << components.strong[article] << " of "
+         << components.strong_sizes.size() << ": " << components.strong_size(article) << " articles" << endl;
+  }
+
+
+  /**
+   * Prints the length of a shortest path along outgoing links (ignoring
+   * excluded articles), from the distance index if built.
+   */
+  void query_distance(const string &rem) {
+    string from, to;
+    split_one(from, to, rem);
+    ArticleID from_idx = wikidata.vertex_of(stoul(from));
+    ArticleID to_idx = wikidata.vertex_of(stoul(to));
+    wikidata.check_articleid_linkdb(from_idx);
+    wikidata.check_articleid_linkdb(to_idx);
+
+    auto start = chrono::steady_clock::now();
+    size_t distance = -1;
+    string method;
+    if (!wikidata.distance_index.empty()) {
+      method = "distance index";
+      DistanceIndex::Distance d = wikidata.distance_index.distance(from_idx, to_idx);
+      if (d != (DistanceIndex::Distance)-1)
+        distance = d;
+    } else if (from_idx == to_idx) {
+      method = "trivial";
+      distance = 0;
+    } else if (!wikidata.components.path_possible(from_idx, to_idx, false)) {
+      method = "components";
     } else {
-      query_help();
+      method = "BFS";
+      GraphBFS::ArticleSet no_exclusions;
+      GraphBFS::Path path = get_parallel_bfs().path(from_idx, to_idx, no_exclusions);
+      if (path.size())
+        distance = path.size() - 1;
+    }
+    auto micros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    if (distance == (size_t)-1) {
+      cout << "no path";
+    } else {
+      cout << "distance " << distance;
     }
+    cout << " (" << method << ", " << micros << " us)" << endl;
   }
 
 
@@ -185,13 +323,66 @@ class CLI {
   }
 
   public:
-  CLI(const WikiData& wikidata) : wikidata(wikidata) {
+  CLI(const WikiData& wikidata, size_t bfs_threads = 1)
+    : wikidata(wikidata), bfs_threads(max((size_t)1, bfs_threads)) {
 
   }
 
   void run() {
     query();
   }
+
+  /**
+   * Runs one query as typed at the prompt.
+   */
+  void run_query(string& input) {
+    boost::trim(input);
+
+    string first, rem;
+    split_one(first, rem, input);
+
+    if (first == "resource") {
+      query_by_resource(rem);
+    } else if (first == "label") {
+      query_by_label(rem);
+    } else if (first == "id") {
+      ArticleID idx = stoul(rem);
+      query_by_id(idx);
+    } else if (first == "outs") {
+      ArticleID idx = stoul(rem);
+      query_links(idx, true, false);
+    } else if (first == "ins") {
+      ArticleID idx = stoul(rem);
+      query_links(idx, false, true);
+    } else if (first == "inouts") { 
+      ArticleID idx = stoul(rem);
+      query_links(idx, true, true);
+    } else if (first == "path" || first == "path*") {
+      graph_interface(first, rem, false);
+    } else if (first == "path-undirected" || first == "path-undirected*") {
+      graph_interface(first, rem, true);
+    } else if (first == "distances") {
+      distances_interface(rem, false);
+    } else if (first == "distances-undirected") {
+      distances_interface(rem, true);
+    } else if (first == "distance") {
+      query_distance(rem);
+    } else if (first == "component") {
+      query_component(stoul(rem));
+    } else if (first == "path-exclude-add") {
+      ArticleID excl = stoul(rem);
+      wikidata.check_articleid(excl);
+      path_exclude_set.insert(wikidata.vertex_of(excl));
+    } else if (first == "path-exclude-file") {
+      exclude_file(rem);
+    } else if (first == "path-exclude-degree") {
+      exclude_degree(stoul(rem));
+    } else if (first == "path-exclude-clear") {
+      path_exclude_set.clear();
+    } else {
+      query_help();
+    }
+  }
 };
 /*}}}*/
 // vim: foldmethod=marker
@@ -0,0 +1,194 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <utility>
+
+#include "data.hpp"
+
+using namespace std;
+
+/**
+ * Computes the connected components of the link database of 'wikidata'
+ * (see Components) and stores them in wikidata.components.
+ *
+ * Weakly connected components are found with a lock-free union-find on
+ * 'n_threads' threads: every link joins the sets of its articles, the root
+ * of a set is its smallest article. Strongly connected components use an
+ * iterative version of Tarjan's algorithm along the outgoing links, which
+ * is linear in the number of links but serial.
+ *
+ * Runs on the uncompressed links, before WikiData::compress_links.
+ */
+class ComponentBuilder {
+public:
+  typedef WikiData::ArticleID ArticleID;
+  typedef Components::ComponentID ComponentID;
+
+private:
+  WikiData &wikidata;
+  const size_t n;
+  const size_t n_threads;
+
+  // articles handed out to the threads at once
+  const size_t chunk_size = 1 << 14;
+
+  WikiData::LinkRange outlinks_of(ArticleID a) const {
+    const ArticleID *base = wikidata.link_targets.data();
+    WikiData::LinkRange ret = { base + wikidata.link_offsets[a], base + wikidata.link_offsets[a + 1] };
+    return ret;
+  }
+
+  template<typename F>
+  void parallel_for(F f) {
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+      size_t begin;
+      while ((begin = next.fetch_add(chunk_size)) < n) {
+        for (size_t a = begin; a < min(begin + chunk_size, n); ++a) {
+          f(a);
+        }
+      }
+    };
+    vector<thread> threads;
+    for (size_t i = 1; i < n_threads; ++i) {
+      threads.push_back(thread(worker));
+    }
+    worker();
+    for (thread &t: threads) {
+      t.join();
+    }
+  }
+
+  static ArticleID find(vector<atomic<ArticleID>> &parent, ArticleID a) {
+    while (true) {
+      ArticleID p = parent[a].load(memory_order_relaxed);
+      if (p == a)
+        return a;
+      // path halving
+      ArticleID grandparent = parent[p].load(memory_order_relaxed);
+      if (grandparent != p)
+        parent[a].compare_exchange_weak(p, grandparent, memory_order_relaxed);
+      a = grandparent;
+    }
+  }
+
+  static void unite(vector<atomic<ArticleID>> &parent, ArticleID a, ArticleID b) {
+    while (true) {
+      a = find(parent, a);
+      b = find(parent, b);
+      if (a == b)
+        return;
+      if (a < b)
+        swap(a, b);
+      // hook the larger root below the smaller one, unless it was hooked
+      // somewhere else meanwhile.
+      ArticleID expected = a;
+      if (parent[a].compare_exchange_strong(expected, b, memory_order_relaxed))
+        return;
+    }
+  }
+
+  void build_weak() {
+    vector<atomic<ArticleID>> parent(n);
+    parallel_for([&](ArticleID a) {
+      parent[a].store(a, memory_order_relaxed);
+    });
+    parallel_for([&](ArticleID a) {
+      for (ArticleID target: outlinks_of(a)) {
+        unite(parent, a, target);
+      }
+    });
+
+    // number the components in order of their roots.
+    vector<ComponentID> &weak = wikidata.components.weak.vec();
+    vector<uint32_t> &sizes = wikidata.components.weak_sizes.vec();
+    weak.resize(n);
+    sizes.clear();
+    for (ArticleID a = 0; a < n; ++a) {
+      ArticleID root = find(parent, a);
+      if (root == a) {
+        weak[a] = sizes.size();
+        sizes.push_back(0);
+      } else {
+        weak[a] = weak[root];
+      }
+      sizes[weak[a]]++;
+    }
+  }
+
+  void build_strong() {
+    vector<ComponentID> &strong = wikidata.components.strong.vec();
+    vector<uint32_t> &sizes = wikidata.components.strong_sizes.vec();
+    const ComponentID unassigned = -1;
+    strong.assign(n, unassigned);
+    sizes.clear();
+
+    // visiting order and lowest reachable visiting order of an article.
+    // Visited articles without component are on 'stack'.
+    const ArticleID unvisited = -1;
+    vector<ArticleID> index(n, unvisited);
+    vector<ArticleID> low(n);
+    vector<ArticleID> stack;
+    // the recursion: article and its next link to follow
+    vector<pair<ArticleID, const ArticleID*>> calls;
+    ArticleID next_index = 0;
+
+    auto visit = [&](ArticleID a) {
+      index[a] = low[a] = next_index++;
+      stack.push_back(a);
+      calls.push_back(make_pair(a, outlinks_of(a).begin()));
+    };
+
+    for (ArticleID root = 0; root < n; ++root) {
+      if (index[root] != unvisited)
+        continue;
+      visit(root);
+      while (calls.size()) {
+        ArticleID a = calls.back().first;
+        const ArticleID *&link = calls.back().second;
+        if (link != outlinks_of(a).end()) {
+          ArticleID target = *link++;
+          if (index[target] == unvisited) {
+            visit(target);
+          } else if (strong[target] == unassigned) {
+            low[a] = min(low[a], index[target]);
+          }
+          continue;
+        }
+
+        calls.pop_back();
+        if (calls.size()) {
+          ArticleID caller = calls.back().first;
+          low[caller] = min(low[caller], low[a]);
+        }
+        if (low[a] == index[a]) {
+          // 'a' is the root of a component, which is on the stack above it.
+          ComponentID c = sizes.size();
+          ArticleID member;
+          uint32_t size = 0;
+          do {
+            member = stack.back();
+            stack.pop_back();
+            strong[member] = c;
+            size++;
+          } while (member != a);
+          sizes.push_back(size);
+        }
+      }
+    }
+  }
+
+public:
+  ComponentBuilder(WikiData &wikidata, size_t n_threads)
+    : wikidata(wikidata), n(wikidata.linkdb_size()), n_threads(max((size_t)1, n_threads)) { }
+
+  void build() {
+    if (!wikidata.compressed_links.empty())
+      throw std::runtime_error("Connected components need the uncompressed links.");
+    wikidata.components.clear();
+    build_weak();
+    build_strong();
+  }
+};
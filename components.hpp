@@ -0,0 +1,78 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "flat_array.hpp"
+
+using namespace std;
+
+/**
+ * The weakly and strongly connected components of the link graph, one
+ * component id per article each (see component_builder.hpp). Lets path
+ * queries answer "no path" without a search.
+ *
+ * Strongly connected components are numbered in reverse topological order
+ * (as Tarjan's algorithm finishes them): if there is a path from a to b,
+ * then strong[a] >= strong[b].
+ */
+class Components {
+public:
+  typedef uint32_t ArticleID;
+  typedef uint32_t ComponentID;
+
+  FlatArray<ComponentID> weak;
+  FlatArray<ComponentID> strong;
+  // number of articles, per component id
+  FlatArray<uint32_t> weak_sizes;
+  FlatArray<uint32_t> strong_sizes;
+
+  Components() { }
+  Components(const Components &other) = delete;
+  Components& operator=(const Components &other) = delete;
+
+  bool empty() const {
+    return weak.empty();
+  }
+
+  void clear() {
+    vector<ComponentID>().swap(weak.vec());
+    vector<ComponentID>().swap(strong.vec());
+    vector<uint32_t>().swap(weak_sizes.vec());
+    vector<uint32_t>().swap(strong_sizes.vec());
+  }
+
+  /**
+   * False if there is certainly no path from 'from' to 'to' (along links in
+   * both directions if 'undirected'). Always true if not computed.
+   */
+  bool path_possible(ArticleID from, ArticleID to, bool undirected) const {
+    if (empty())
+      return true;
+    if (weak[from] != weak[to])
+      return false;
+    return undirected || strong[from] >= strong[to];
+  }
+
+  size_t weak_size(ArticleID article) const {
+    return component_size(weak_sizes, weak[article]);
+  }
+
+  size_t strong_size(ArticleID article) const {
+    return component_size(strong_sizes, strong[article]);
+  }
+
+  size_t memory_usage() const {
+    return (weak.size() + strong.size()) * sizeof(ComponentID) +
+      (weak_sizes.size() + strong_sizes.size()) * sizeof(uint32_t);
+  }
+
+private:
+  static size_t component_size(const FlatArray<uint32_t> &sizes, ComponentID c) {
+    // checked, as the ids may come from a snapshot.
+    if (c >= sizes.size())
+      throw std::runtime_error("Invalid component id " + to_string(c));
+    return sizes[c];
+  }
+};
@@ -0,0 +1,217 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "flat_array.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#define COMPRESSED_LINKS_SSSE3
+#endif
+
+using namespace std;
+
+/**
+ * Sorted lists of article ids (the outgoing links of each article),
+ * compressed with StreamVByte (Lemire et al.): each list stores the
+ * differences between consecutive ids, which are small for sorted lists.
+ * Every group of four values has a control byte with the byte length
+ * (1-4) of each value in two bits; a list is its control bytes followed by
+ * the value bytes.
+ *
+ * Decoding a group is one table lookup and one byte shuffle (SSSE3, used
+ * if the CPU supports it; the build doesn't need to enable it) plus a
+ * prefix sum, decode_scalar() is the portable fallback.
+ */
+class CompressedLinks {
+public:
+  typedef uint32_t ArticleID;
+
+  // the 16 byte loads of a group may read past the last list.
+  static const size_t padding = 16;
+
+  // byte offsets of the lists in 'data', one more than there are lists
+  FlatArray<uint64_t> offsets;
+  FlatArray<uint8_t> data;
+
+  CompressedLinks() { }
+  CompressedLinks(const CompressedLinks &other) = delete;
+  CompressedLinks& operator=(const CompressedLinks &other) = delete;
+
+  bool empty() const {
+    return offsets.empty();
+  }
+
+  void clear() {
+    vector<uint64_t>().swap(offsets.vec());
+    vector<uint8_t>().swap(data.vec());
+  }
+
+  size_t memory_usage() const {
+    return offsets.size() * sizeof(uint64_t) + data.size();
+  }
+
+  /**
+   * Replaces the lists with the ones of the CSR arrays 'list_offsets' /
+   * 'values' (list i: values[list_offsets[i]] .. values[list_offsets[i+1] - 1],
+   * each sorted).
+   */
+  template<typename Offset>
+  void build(const FlatArray<Offset> &list_offsets, const FlatArray<ArticleID> &values) {
+    clear();
+    vector<uint64_t> &byte_offsets = offsets.vec();
+    vector<uint8_t> &bytes = data.vec();
+    size_t n = list_offsets.size() ? list_offsets.size() - 1 : 0;
+    byte_offsets.reserve(n + 1);
+    bytes.reserve(values.size() * 3 / 2 + n + padding);
+    for (size_t i = 0; i < n; ++i) {
+      byte_offsets.push_back(bytes.size());
+      size_t count = list_offsets[i + 1] - list_offsets[i];
+      const ArticleID *list = values.data() + list_offsets[i];
+      size_t control = bytes.size();
+      bytes.resize(bytes.size() + (count + 3) / 4, 0);
+      ArticleID previous = 0;
+      for (size_t j = 0; j < count; ++j) {
+        uint32_t delta = list[j] - previous;
+        previous = list[j];
+        size_t length = delta < (1u << 8) ? 1 : delta < (1u << 16) ? 2 : delta < (1u << 24) ? 3 : 4;
+        bytes[control + j / 4] |= (length - 1) << (2 * (j % 4));
+        for (size_t b = 0; b < length; ++b) {
+          bytes.push_back(delta >> (8 * b));
+        }
+      }
+    }
+    byte_offsets.push_back(bytes.size());
+    bytes.resize(bytes.size() + padding, 0);
+    bytes.shrink_to_fit();
+  }
+
+  /**
+   * True if list i holds list_offsets[i + 1] - list_offsets[i] values, all
+   * less than 'bound', in exactly its bytes. For lists not built here
+   * (snapshots), whose offsets were checked already.
+   */
+  template<typename Offset>
+  bool valid(const FlatArray<Offset> &list_offsets, uint64_t bound) const {
+    for (size_t list = 0; list + 1 < offsets.size(); ++list) {
+      size_t count = list_offsets[list + 1] - list_offsets[list];
+      const uint8_t *control = data.data() + offsets[list];
+      const uint8_t *p = control + (count + 3) / 4;
+      const uint8_t *end = data.data() + offsets[list + 1];
+      if (p > end)
+        return false;
+      uint64_t value = 0;
+      for (size_t j = 0; j < count; ++j) {
+        size_t length = ((control[j / 4] >> (2 * (j % 4))) & 3) + 1;
+        if (length > (size_t)(end - p))
+          return false;
+        for (size_t b = 0; b < length; ++b) {
+          value += (uint64_t)p[b] << (8 * b);
+        }
+        p += length;
+      }
+      if (p != end || (count && value >= bound))
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * Replaces 'out' with the 'count' values of list 'list'.
+   */
+  void decode(size_t list, size_t count, vector<ArticleID> &out) const {
+#ifdef COMPRESSED_LINKS_SSSE3
+    if (has_ssse3()) {
+      decode_ssse3(list, count, out);
+      return;
+    }
+#endif
+    decode_scalar(list, count, out);
+  }
+
+  void decode_scalar(size_t list, size_t count, vector<ArticleID> &out) const {
+    out.resize(count);
+    const uint8_t *control = data.data() + offsets[list];
+    const uint8_t *p = control + (count + 3) / 4;
+    decode_tail(control, p, 0, count, 0, out.data());
+  }
+
+#ifdef COMPRESSED_LINKS_SSSE3
+  __attribute__((target("ssse3")))
+  void decode_ssse3(size_t list, size_t count, vector<ArticleID> &out) const {
+    const Tables &t = tables();
+    // whole groups are stored at once.
+    out.resize((count + 3) & ~(size_t)3);
+    const uint8_t *control = data.data() + offsets[list];
+    const uint8_t *p = control + (count + 3) / 4;
+    ArticleID *o = out.data();
+    __m128i previous = _mm_setzero_si128();
+    size_t groups = count / 4;
+    for (size_t g = 0; g < groups; ++g) {
+      uint8_t c = control[g];
+      __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+      __m128i x = _mm_shuffle_epi8(bytes, _mm_loadu_si128((const __m128i*)t.shuffle[c]));
+      p += t.length[c];
+      // prefix sum of the differences, plus the last value of the group before.
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+      x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+      x = _mm_add_epi32(x, previous);
+      _mm_storeu_si128((__m128i*)(o + 4 * g), x);
+      previous = _mm_shuffle_epi32(x, 0xff);
+    }
+    decode_tail(control, p, groups * 4, count, groups ? o[groups * 4 - 1] : 0, o);
+    out.resize(count);
+  }
+#endif
+
+private:
+  // decodes values 'first' .. 'count' - 1, whose bytes start at 'p'.
+  static void decode_tail(const uint8_t *control, const uint8_t *p, size_t first,
+                          size_t count, ArticleID previous, ArticleID *out) {
+    for (size_t j = first; j < count; ++j) {
+      size_t length = ((control[j / 4] >> (2 * (j % 4))) & 3) + 1;
+      uint32_t delta = 0;
+      for (size_t b = 0; b < length; ++b) {
+        delta |= (uint32_t)p[b] << (8 * b);
+      }
+      p += length;
+      previous += delta;
+      out[j] = previous;
+    }
+  }
+
+#ifdef COMPRESSED_LINKS_SSSE3
+  // per control byte: the shuffle moving the bytes of four values to
+  // their 32 bit lanes (0x80 clears a byte), and the bytes used.
+  struct Tables {
+    uint8_t shuffle[256][16];
+    uint8_t length[256];
+
+    Tables() {
+      for (size_t c = 0; c < 256; ++c) {
+        uint8_t pos = 0;
+        for (size_t lane = 0; lane < 4; ++lane) {
+          size_t length = ((c >> (2 * lane)) & 3) + 1;
+          for (size_t b = 0; b < 4; ++b) {
+            shuffle[c][4 * lane + b] = b < length ? pos + b : 0x80;
+          }
+          pos += length;
+        }
+        this->length[c] = pos;
+      }
+    }
+  };
+
+  static const Tables& tables() {
+    static const Tables t;
+    return t;
+  }
+
+  static bool has_ssse3() {
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+  }
+#endif
+};
@@ -1,20 +1,36 @@
 #pragma once
 
 #include "parseutil.hpp"
+#include "flat_array.hpp"
+#include "label_store.hpp"
+#include "resource_index.hpp"
+#include "label_index.hpp"
+#include "components.hpp"
+#include "distance_index.hpp"
+#include "landmarks.hpp"
+#include "compressed_links.hpp"
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <mutex>
 #include <stdexcept>
 #include <functional>
 #include <memory>
 #include <boost/iterator/transform_iterator.hpp>
 #include <boost/iterator/filter_iterator.hpp>
+#include <boost/utility/string_ref.hpp>
 
 using namespace std;
 
 class WikiData {
 public:
-  typedef uint32_t Pagelink;
   typedef uint32_t ArticleID;
+  /**
+   * A link with its directions as returned by get_links: the linked
+   * article in the upper bits, the LSB is set when the link is outgoing
+   * (from the article asked for), the second bit when it is incoming.
+   */
+  typedef uint64_t Pagelink;
 
   // Not really a technical requirement, rather a protection - copying
   // potentially multiple GB of data is most likely a programming error.
@@ -36,56 +52,117 @@ public:
    * the exact Title, it is not stored separately.
    * Otherwise, the CompressedLabel consists of the resource
    * followed by the label, delimited by a '\0' character.
+   *
+   * The labels are kept in a front coded LabelStore, sorted by resource.
+   * Use set_labels to fill it.
    */
   typedef string CompressedLabel;
-  vector<CompressedLabel> labels;
-  mutex labels_write;
+  LabelStore labels;
 
+  /**
+   * Optional hash index for find_by_resource, see build_resource_index.
+   */
+  ResourceIndex resource_index;
 
-  static string get_resource(const CompressedLabel& compressed) { 
-    size_t zero = compressed.find('\0');
-    if (zero == string::npos) {
-      return compressed;
-    }
-    return compressed.substr(0, zero);
+  /**
+   * Article ids sorted by label for find_by_label, see build_label_index.
+   */
+  LabelIndex label_index;
+
+
+  size_t label_count() const {
+    return labels.size();
   }
 
 
-  static string get_label(const CompressedLabel& compressed) {
-    size_t zero = compressed.find('\0');
-    if (zero == string::npos) {
-      string ret = compressed;
-      wikipedia_denormalization(ret);
-      return ret;
-    }
-    return compressed.substr(zero+1);
+  /**
+   * Replaces all labels with 'compressed', which have to be sorted.
+   * Empties 'compressed'.
+   */
+  void set_labels(vector<CompressedLabel> &compressed) {
+    resource_index.clear();
+    label_index.clear();
+    labels.build(compressed);
+  }
+
+
+  /**
+   * Builds the hash index used by find_by_resource. Costs 8 bytes per
+   * article.
+   */
+  void build_resource_index() {
+    resource_index.build(labels);
+  }
+
+
+  /**
+   * Builds the label sorted index used by find_by_label on 'n_threads'
+   * threads. Costs 4 bytes per article.
+   */
+  void build_label_index(size_t n_threads) {
+    label_index.build(labels, n_threads);
   }
 
 
   /**
    * returns the ArticleID by the given resource, or -1.
    */
-  ArticleID find_by_resource(const string& resource) const { 
-    auto it = lower_bound(labels.begin(), labels.end(), resource);
-    if (it == labels.end() || get_resource(*it) != resource) {
-      return -1;
+  ArticleID find_by_resource(const boost::string_ref& resource) const { 
+    if (!resource_index.empty())
+      return resource_index.find(labels, resource);
+    return labels.find(resource);
+  }
+
+
+  /**
+   * find_by_resource for 'n' resources at once, the results go to 'out'.
+   * Interleaves the lookups with prefetching (see ResourceIndex::find_batch
+   * and LabelStore::find_batch), which hides most of their cache misses.
+   */
+  void find_by_resource_batch(const boost::string_ref *resources, size_t n, ArticleID *out) const {
+    if (!resource_index.empty()) {
+      resource_index.find_batch(labels, resources, n, out);
+    } else {
+      labels.find_batch(resources, n, out);
     }
-    return it - labels.begin();
+  }
+
+  vector<ArticleID> find_by_resource_batch(const vector<boost::string_ref> &resources) const {
+    vector<ArticleID> ret(resources.size());
+    find_by_resource_batch(resources.data(), resources.size(), ret.data());
+    return ret;
+  }
+
+
+  /**
+   * find_by_resource for resources that mostly come in ascending order,
+   * 'hint' is the article found for an earlier one. Without the resource
+   * index, searches onwards from the hint (see LabelStore::find_from).
+   */
+  ArticleID find_by_resource(const boost::string_ref& resource, ArticleID hint) const {
+    if (!resource_index.empty())
+      return resource_index.find(labels, resource);
+    return labels.find_from(resource, hint);
   }
 
   
   /**
    * returens the ArticleID corresponding to the given label.
    * returns -1 on failure.
+   * Without the label index, only labels equal to their denormalized
+   * resource are found.
    */
   ArticleID find_by_label(const string &label) const {
+    if (!label_index.empty())
+      return label_index.find(labels, label);
     string normalized = label;
     wikipedia_normalization(normalized);
-    auto it = lower_bound(labels.begin(), labels.end(), normalized);
-    if (it == labels.end() || get_label(*it) != label) {
+    ArticleID idx = labels.find(normalized);
+    string buffer;
+    if (idx == (ArticleID)-1 || labels.label(idx, buffer) != label) {
       return -1;
     }
-    return it - labels.begin();
+    return idx;
   }
 
 
@@ -93,8 +170,19 @@ public:
    * Throws std::runtime_error if the article was not found.
    */
   string label_by_id(ArticleID article) const {
+    string buffer;
+    return label_by_id(article, buffer).to_string();
+  }
+
+
+  /**
+   * Allocation-free variant: the result refers to 'buffer' or to the label
+   * store and is valid until 'buffer' is modified.
+   * Throws std::runtime_error if the article was not found.
+   */
+  boost::string_ref label_by_id(ArticleID article, string &buffer) const {
     check_articleid(article);
-    return get_label(labels[article]);
+    return labels.label(article, buffer);
   }
 
 
@@ -102,76 +190,237 @@ public:
    * Throws std::runtime_error if the article was not found.
    */
   string resource_by_id(ArticleID article) const {
+    string buffer;
+    return resource_by_id(article, buffer).to_string();
+  }
+
+
+  /**
+   * Allocation-free variant, see label_by_id.
+   */
+  boost::string_ref resource_by_id(ArticleID article, string &buffer) const {
     check_articleid(article);
-    return get_resource(labels[article]);
+    return labels.resource(article, buffer);
   }
 
 
   bool idx_to_label(string &out, const ArticleID article) const {
-    if (article >= labels.size()) {
+    if (article >= label_count()) {
       out.clear();
       return false;
     }
-    out = get_label(labels[article]);
+    boost::string_ref label = labels.label(article, out);
+    if (label.data() != out.data())
+      out.assign(label.begin(), label.end());
     return true;
   }
 
 
   void check_articleid(ArticleID article) const {
-    if (article < labels.size())
+    if (article < label_count())
       return;
     throw std::runtime_error("Article ID not found: " + to_string(article));
   }
 
   /**
-   * Primary index in links is the article id (index in labels).
-   * nested vector contains the page links. In each element, 
-   * the 30 most significant bits describe the article id.
-   * the LSB is set when the page link is outgoing (from the primary id),
-   * the second bit is set when the link is incoming.
+   * Page links are stored in compressed sparse row format: The outgoing
+   * links of article 'a' (index in labels) are
+   * link_targets[link_offsets[a]] .. link_targets[link_offsets[a+1] - 1],
+   * sorted. link_offsets has one entry more than there are articles, both
+   * are empty if no link database is loaded. Use LinkBuilder to fill them.
    *
-   * LSB (instead of MSBs) have been chosen to allow lookups for 
-   * a specific lookup to happen in O(log n), usint standard sorting.
-   * Lookups for all out/in links are only slowed
-   * down by, on average, a factor of 2.
+   * The incoming links (see --inlinks) are kept apart in the same form,
+   * in inlink_offsets and inlink_sources, which are empty if they were not
+   * loaded. Directed searches only read the links they follow.
+   *
+   * After compress_links(), the outgoing links are kept in compressed_links
+   * instead of link_targets, which is empty then; link_offsets still gives
+   * their number. Read them with outlinks_of.
+   */
+  typedef uint32_t LinkOffset;
+  FlatArray<LinkOffset> link_offsets;
+  FlatArray<ArticleID> link_targets;
+  FlatArray<LinkOffset> inlink_offsets;
+  FlatArray<ArticleID> inlink_sources;
+  CompressedLinks compressed_links;
+
+  /**
+   * The link database may be stored in another order than the articles
+   * (see LinkOrderBuilder): then the arrays above, the components, the
+   * distance index, the landmarks and the searches use vertex ids, and
+   * vertex_articles[v] is the article of vertex v, article_vertices the
+   * reverse. Both are empty if vertex ids are article ids. get_links and
+   * outlink_exists take and return article ids, translate with vertex_of
+   * and article_of for everything else.
+   */
+  FlatArray<ArticleID> vertex_articles;
+  FlatArray<ArticleID> article_vertices;
+
+  /**
+   * Connected components of the link database, empty if not computed.
+   * Use ComponentBuilder to fill them.
    */
-  vector<vector<Pagelink>> links;
+  Components components;
 
   /**
-   * Adds an incoming or outgoing link to article 'from'.
-   * This function is not threadsafe for multiple parallel calls with the same
-   * 'from'.
+   * Optional exact distance index of the link database, empty if not
+   * built. Use DistanceIndexBuilder to fill it.
    */
-  void add_link_unsafe(const ArticleID from, ArticleID target, bool outgoing) {
-    if (from >= links.size())
+  DistanceIndex distance_index;
+
+  /**
+   * Optional landmark distances for A* path searches, empty if not built.
+   * Use LandmarkBuilder to fill them.
+   */
+  Landmarks landmarks;
+
+  /**
+   * Keeps the memory the arrays above refer to alive when they are mapped
+   * from a snapshot (see load_snapshot).
+   */
+  shared_ptr<const void> mapping;
+
+  /**
+   * The links of a single article, usable in range-based for loops.
+   */
+  struct LinkRange {
+    const ArticleID *first;
+    const ArticleID *last;
+    const ArticleID *begin() const { return first; }
+    const ArticleID *end() const { return last; }
+    size_t size() const { return last - first; }
+  };
+
+  /**
+   * Number of articles covered by the link database (0 if not loaded).
+   */
+  size_t linkdb_size() const {
+    return link_offsets.size() ? link_offsets.size() - 1 : 0;
+  }
+
+  /**
+   * Whether the link database contains the incoming links as well (see
+   * --inlinks), which allows searching paths backwards.
+   */
+  bool has_incoming_links() const {
+    return !inlink_offsets.empty();
+  }
+
+  bool is_reordered() const {
+    return !article_vertices.empty();
+  }
+
+  /**
+   * The vertex of 'article' in the link database. Ids beyond the link
+   * database are returned unchanged.
+   */
+  ArticleID vertex_of(ArticleID article) const {
+    return article < article_vertices.size() ? article_vertices[article] : article;
+  }
+
+  /**
+   * The article of 'vertex', the reverse of vertex_of.
+   */
+  ArticleID article_of(ArticleID vertex) const {
+    return vertex < vertex_articles.size() ? vertex_articles[vertex] : vertex;
+  }
+
+  /**
+   * Number of outgoing links of the link database.
+   */
+  size_t link_count() const {
+    return link_offsets.size() ? link_offsets[link_offsets.size() - 1] : 0;
+  }
+
+  size_t outlink_count(ArticleID article) const {
+    return link_offsets[article + 1] - link_offsets[article];
+  }
+
+  /**
+   * Compresses the outgoing links (see CompressedLinks), frees link_targets.
+   */
+  void compress_links() {
+    if (!compressed_links.empty())
       return;
+    compressed_links.build(link_offsets, link_targets);
+    vector<ArticleID>().swap(link_targets.vec());
+  }
 
+  /**
+   * The articles 'article' links to (both vertex ids, if reordered). The
+   * result refers to 'buffer' (if the links are compressed) or to the link
+   * database, and is valid until 'buffer' is modified. Does not check the
+   * article id, see check_articleid_linkdb.
+   */
+  LinkRange outlinks_of(ArticleID article, vector<ArticleID> &buffer) const {
+    if (!compressed_links.empty()) {
+      compressed_links.decode(article, outlink_count(article), buffer);
+      LinkRange ret = { buffer.data(), buffer.data() + buffer.size() };
+      return ret;
+    }
+    const ArticleID *base = link_targets.data();
+    LinkRange ret = { base + link_offsets[article], base + link_offsets[article + 1] };
+    return ret;
+  }
 
-    auto it = lower_bound(links[from].begin(), links[from].end(), to_pagelink(target));
-    if (it == links[from].end() || !is_link_to_article(*it, target)) {
-      links[from].insert(it, to_pagelink(target, outgoing, !outgoing));
-    } else {
-      *it = *it | to_pagelink(0, outgoing, !outgoing);
+  /**
+   * The articles linking to 'article', empty if the incoming links are not
+   * loaded. Does not check the article id.
+   */
+  LinkRange inlinks_of(ArticleID article) const {
+    if (!has_incoming_links()) {
+      LinkRange ret = { nullptr, nullptr };
+      return ret;
     }
+    const ArticleID *base = inlink_sources.data();
+    LinkRange ret = { base + inlink_offsets[article], base + inlink_offsets[article + 1] };
+    return ret;
+  }
+
+
+  typedef array<LinkRange, 2> LinkRanges;
+
+  /**
+   * The outgoing links of 'article' followed by, if 'undirected', the
+   * incoming ones (the second range is empty otherwise). Articles linked
+   * in both directions are in both ranges. Does not check the article id.
+   */
+  LinkRanges links_of(ArticleID article, bool undirected, vector<ArticleID> &buffer) const {
+    LinkRanges ret = {{ outlinks_of(article, buffer), undirected ? inlinks_of(article) : LinkRange() }};
+    return ret;
   }
 
 
   /**
    * return a vector of all links from (outgoing) and/or to (incoming)
-   * the source node.
+   * the source node, sorted by article; an article linked in both
+   * directions appears once.
    * throws std::runtime_error when used without a link database
    * or invalid source id.
    */
   vector<Pagelink> get_links(ArticleID source, bool outgoing=true,
                              bool incoming=false) const {
-    vector<ArticleID> ret;
+    vector<Pagelink> ret;
     check_articleid_linkdb(source);
-    for (const Pagelink &p: links[source]) {
-      if ((incoming && is_incoming(p)) ||
-          (outgoing && is_outgoing(p))) {
-        ret.push_back(p);
+    vector<ArticleID> buffer;
+    ArticleID vertex = vertex_of(source);
+    LinkRange outs = outgoing ? outlinks_of(vertex, buffer) : LinkRange();
+    LinkRange ins = incoming ? inlinks_of(vertex) : LinkRange();
+    const ArticleID *o = outs.begin(), *i = ins.begin();
+    while (o != outs.end() || i != ins.end()) {
+      if (i == ins.end() || (o != outs.end() && *o < *i)) {
+        ret.push_back(to_pagelink(article_of(*o++), true, false));
+      } else if (o == outs.end() || *i < *o) {
+        ret.push_back(to_pagelink(article_of(*i++), false, true));
+      } else {
+        ret.push_back(to_pagelink(article_of(*o), true, true));
+        ++o;
+        ++i;
       }
     }
+    // the flags are in the lowest bits, so this sorts by article.
+    if (is_reordered())
+      sort(ret.begin(), ret.end());
     return ret;
   }
 
@@ -179,9 +428,7 @@ public:
    * Check whether the pagelink referes to a given article.
    */
   static bool is_link_to_article(const Pagelink pagelink, const ArticleID article) {
-    if ((pagelink >> 2) == article)
-      return true;
-    return false;
+    return to_ArticleID(pagelink) == article;
   }
 
   static inline bool is_outgoing(const Pagelink pagelink) {
@@ -198,14 +445,14 @@ public:
 
   static inline Pagelink to_pagelink(const ArticleID article, bool outgoing = false,
       bool incoming = false) {
-    return ((article << 2) | ((int)incoming << 1) | ((int)outgoing));
+    return (((Pagelink)article << 2) | ((int)incoming << 1) | ((int)outgoing));
   }
 
 
   void check_articleid_linkdb(ArticleID article) const {
-    if (article < links.size())
+    if (article < linkdb_size())
       return;
-    if (links.size() == 0) {
+    if (linkdb_size() == 0) {
       throw std::runtime_error("Cannot use this function without page link database loaded");
     }
     throw std::runtime_error("Invalid id for use with page links: " + to_string(article));
@@ -214,10 +461,8 @@ public:
 
   bool outlink_exists(const ArticleID& root, const ArticleID& other) const {
     check_articleid_linkdb(root);
-    Pagelink other_pl = to_pagelink(other);
-    auto it = lower_bound(links[root].begin(), links[root].end(), other_pl);
-    if (it == links[root].end())
-      return false;
-    return (is_link_to_article(*it, other) && is_outgoing(*it));
+    vector<ArticleID> buffer;
+    LinkRange links = outlinks_of(vertex_of(root), buffer);
+    return binary_search(links.begin(), links.end(), vertex_of(other));
   }
 };
@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "flat_array.hpp"
+
+using namespace std;
+
+/**
+ * Exact distances (number of links on a shortest path along outgoing
+ * links) between any two articles from a 2-hop labeling, see
+ * distance_index_builder.hpp.
+ *
+ * Each article a has an out-label, pairs (hub, distance from a to the hub),
+ * and an in-label, pairs (hub, distance from the hub to a). The labels are
+ * chosen such that some shortest path from a to b passes a hub in both the
+ * out-label of a and the in-label of b, so the distance is the minimum sum
+ * over the common hubs. Both labels are sorted by hub (the hub's rank in
+ * the build order, not its article id), a query is a merge of two short
+ * arrays.
+ */
+class DistanceIndex {
+public:
+  typedef uint32_t ArticleID;
+  typedef uint32_t Distance;
+  typedef uint64_t LabelOffset;
+
+  // distances don't exceed max_distance (checked when building)
+  static const uint8_t max_distance = 254;
+
+  struct Labels {
+    // labels of article a: hubs/distances[offsets[a]] .. [offsets[a + 1] - 1]
+    FlatArray<LabelOffset> offsets;
+    FlatArray<uint32_t> hubs;
+    FlatArray<uint8_t> distances;
+
+    size_t memory_usage() const {
+      return offsets.size() * sizeof(LabelOffset) + hubs.size() * sizeof(uint32_t) + distances.size();
+    }
+
+    void clear() {
+      vector<LabelOffset>().swap(offsets.vec());
+      vector<uint32_t>().swap(hubs.vec());
+      vector<uint8_t>().swap(distances.vec());
+    }
+  };
+
+  Labels out;
+  Labels in;
+
+  DistanceIndex() { }
+  DistanceIndex(const DistanceIndex &other) = delete;
+  DistanceIndex& operator=(const DistanceIndex &other) = delete;
+
+  bool empty() const {
+    return out.offsets.empty();
+  }
+
+  void clear() {
+    out.clear();
+    in.clear();
+  }
+
+  /**
+   * The distance from 'from' to 'to', (Distance)-1 if there is no path.
+   * The article ids are not checked.
+   */
+  Distance distance(ArticleID from, ArticleID to) const {
+    LabelOffset i = out.offsets[from], i_end = out.offsets[from + 1];
+    LabelOffset j = in.offsets[to], j_end = in.offsets[to + 1];
+    Distance best = -1;
+    while (i < i_end && j < j_end) {
+      uint32_t a = out.hubs[i], b = in.hubs[j];
+      if (a == b) {
+        best = min(best, (Distance)out.distances[i] + in.distances[j]);
+        i++;
+        j++;
+      } else if (a < b) {
+        i++;
+      } else {
+        j++;
+      }
+    }
+    return best;
+  }
+
+  size_t entry_count() const {
+    return out.hubs.size() + in.hubs.size();
+  }
+
+  size_t memory_usage() const {
+    return out.memory_usage() + in.memory_usage();
+  }
+};
@@ -0,0 +1,263 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include <functional>
+#include <cstdint>
+
+#include "data.hpp"
+
+using namespace std;
+
+/**
+ * Builds the DistanceIndex of wikidata.distance_index with pruned landmark
+ * labeling (Akiba et al. 2013): articles are processed in order of
+ * decreasing degree, each runs a BFS forwards (adding itself to the
+ * in-labels of the reached articles) and one backwards (adding itself to
+ * their out-labels). A BFS doesn't continue from an article whose distance
+ * is already answered by the labels of earlier hubs, so the searches of
+ * later, less connected articles stay very small.
+ *
+ * Batches of consecutive hubs are searched on 'n_threads' threads in
+ * parallel, pruning only with the labels of earlier batches; their new
+ * label entries are merged after the batch. The labels stay exact, they
+ * only get slightly larger than with the serial algorithm. The first hubs,
+ * whose searches are large and prune the later ones, go in batches of one
+ * hub per thread, later ones (which only visit a few articles) in larger
+ * batches to keep the synchronization cheap.
+ */
+class DistanceIndexBuilder {
+public:
+  typedef WikiData::ArticleID ArticleID;
+  typedef DistanceIndex::Distance Distance;
+
+private:
+  struct Entry {
+    uint32_t hub;
+    uint8_t distance;
+  };
+
+  // a label entry found by a BFS, not merged yet.
+  struct NewEntry {
+    ArticleID article;
+    uint8_t distance;
+  };
+
+  // one direction of the graph, in CSR form
+  struct Adjacency {
+    vector<uint64_t> offsets;
+    vector<ArticleID> targets;
+  };
+
+  // state of one thread
+  struct Searcher {
+    // distance from the BFS root, unreached if 'unreached'
+    vector<uint8_t> distance;
+    // distance from/to the root per hub of the root's label, if in it
+    vector<uint8_t> root_label;
+    vector<ArticleID> queue;
+  };
+
+  // label entries found by the searches of a hub
+  struct HubEntries {
+    vector<NewEntry> found[2];
+  };
+
+  // hubs searched in batches of one per thread
+  const size_t small_batch_hubs = 1 << 16;
+  // hubs per thread in later batches
+  const size_t large_batch_size = 64;
+
+  const uint8_t unreached = 255;
+
+  const WikiData &wikidata;
+  const size_t n;
+  const size_t n_threads;
+  // forward (outgoing) and backward (incoming) links
+  Adjacency graph[2];
+  // labels per article; 0: out-labels, 1: in-labels
+  vector<vector<Entry>> labels[2];
+
+  void build_graph() {
+    for (Adjacency &a: graph) {
+      a.offsets.assign(n + 1, 0);
+    }
+    vector<ArticleID> buffer;
+    auto for_each_link = [&](std::function<void(ArticleID, ArticleID)> f) {
+      for (ArticleID a = 0; a < n; ++a) {
+        for (ArticleID target: wikidata.outlinks_of(a, buffer)) {
+          f(a, target);
+        }
+      }
+    };
+    for_each_link([&](ArticleID from, ArticleID to) {
+      graph[0].offsets[from + 1]++;
+      graph[1].offsets[to + 1]++;
+    });
+    for (Adjacency &a: graph) {
+      for (size_t i = 0; i < n; ++i) {
+        a.offsets[i + 1] += a.offsets[i];
+      }
+      a.targets.resize(a.offsets[n]);
+    }
+    vector<uint64_t> pos[2] = { graph[0].offsets, graph[1].offsets };
+    for_each_link([&](ArticleID from, ArticleID to) {
+      graph[0].targets[pos[0][from]++] = to;
+      graph[1].targets[pos[1][to]++] = from;
+    });
+  }
+
+  /**
+   * Pruned BFS from 'root' along graph[direction], adds the reached
+   * articles not covered by the labels to 'found'. direction 0 finds
+   * in-label entries of the reached articles, 1 out-label entries.
+   */
+  void search(Searcher &s, ArticleID root, vector<NewEntry> &found, int direction) {
+    const Adjacency &adjacency = graph[direction];
+    // the reached articles' labels of the other kind than the ones found.
+    const vector<vector<Entry>> &reached_labels = labels[1 - direction];
+    for (const Entry &e: labels[direction][root]) {
+      s.root_label[e.hub] = e.distance;
+    }
+    s.queue.clear();
+    s.queue.push_back(root);
+    s.distance[root] = 0;
+    for (size_t head = 0; head < s.queue.size(); ++head) {
+      ArticleID a = s.queue[head];
+      uint8_t d = s.distance[a];
+      bool covered = false;
+      for (const Entry &e: reached_labels[a]) {
+        if (s.root_label[e.hub] != unreached && s.root_label[e.hub] + e.distance <= d) {
+          covered = true;
+          break;
+        }
+      }
+      if (covered)
+        continue;
+      NewEntry entry = { a, d };
+      found.push_back(entry);
+      for (uint64_t i = adjacency.offsets[a]; i < adjacency.offsets[a + 1]; ++i) {
+        ArticleID next = adjacency.targets[i];
+        if (s.distance[next] != unreached)
+          continue;
+        if (d >= DistanceIndex::max_distance)
+          throw std::runtime_error("Distance index: distances above " +
+              to_string((int)DistanceIndex::max_distance) + " are not supported.");
+        s.distance[next] = d + 1;
+        s.queue.push_back(next);
+      }
+    }
+    for (ArticleID a: s.queue) {
+      s.distance[a] = unreached;
+    }
+    for (const Entry &e: labels[direction][root]) {
+      s.root_label[e.hub] = unreached;
+    }
+  }
+
+  void flatten(vector<vector<Entry>> &from, DistanceIndex::Labels &to) {
+    vector<DistanceIndex::LabelOffset> &offsets = to.offsets.vec();
+    vector<uint32_t> &hubs = to.hubs.vec();
+    vector<uint8_t> &distances = to.distances.vec();
+    size_t total = 0;
+    for (const vector<Entry> &label: from) {
+      total += label.size();
+    }
+    offsets.assign(1, 0);
+    offsets.reserve(n + 1);
+    hubs.reserve(total);
+    distances.reserve(total);
+    for (vector<Entry> &label: from) {
+      for (const Entry &e: label) {
+        hubs.push_back(e.hub);
+        distances.push_back(e.distance);
+      }
+      offsets.push_back(hubs.size());
+      vector<Entry>().swap(label);
+    }
+  }
+
+public:
+  DistanceIndexBuilder(const WikiData &wikidata, size_t n_threads)
+    : wikidata(wikidata), n(wikidata.linkdb_size()), n_threads(max((size_t)1, n_threads)) { }
+
+  /**
+   * Replaces 'index' with the index of the link database.
+   */
+  void build(DistanceIndex &index) {
+    index.clear();
+    build_graph();
+
+    vector<ArticleID> order(n);
+    for (size_t i = 0; i < n; ++i) {
+      order[i] = i;
+    }
+    auto degree = [&](ArticleID a) {
+      return graph[0].offsets[a + 1] - graph[0].offsets[a] +
+        graph[1].offsets[a + 1] - graph[1].offsets[a];
+    };
+    stable_sort(order.begin(), order.end(), [&](ArticleID a, ArticleID b) {
+      return degree(a) > degree(b);
+    });
+
+    for (vector<vector<Entry>> &l: labels) {
+      l.assign(n, vector<Entry>());
+    }
+    vector<Searcher> searchers(n_threads);
+    for (Searcher &s: searchers) {
+      s.distance.assign(n, unreached);
+      s.root_label.assign(n, unreached);
+    }
+
+    vector<HubEntries> entries;
+    for (size_t batch = 0; batch < n; ) {
+      size_t batch_size = min(n - batch, batch < small_batch_hubs ? n_threads : n_threads * large_batch_size);
+      if (entries.size() < batch_size)
+        entries.resize(batch_size);
+      vector<exception_ptr> errors(n_threads);
+      auto run = [&](size_t t) {
+        try {
+          for (size_t i = t; i < batch_size; i += n_threads) {
+            ArticleID root = order[batch + i];
+            search(searchers[t], root, entries[i].found[0], 0);
+            search(searchers[t], root, entries[i].found[1], 1);
+          }
+        } catch (...) {
+          errors[t] = current_exception();
+        }
+      };
+      vector<thread> threads;
+      for (size_t t = 1; t < min(n_threads, batch_size); ++t) {
+        threads.push_back(thread(run, t));
+      }
+      run(0);
+      for (thread &t: threads) {
+        t.join();
+      }
+      for (exception_ptr &e: errors) {
+        if (e)
+          rethrow_exception(e);
+      }
+      // hubs are merged in order, so labels stay sorted by hub.
+      for (size_t i = 0; i < batch_size; ++i) {
+        for (int direction = 0; direction < 2; ++direction) {
+          for (const NewEntry &e: entries[i].found[direction]) {
+            Entry entry = { (uint32_t)(batch + i), e.distance };
+            labels[1 - direction][e.article].push_back(entry);
+          }
+          entries[i].found[direction].clear();
+        }
+      }
+      batch += batch_size;
+    }
+    for (Adjacency &a: graph) {
+      vector<uint64_t>().swap(a.offsets);
+      vector<ArticleID>().swap(a.targets);
+    }
+
+    flatten(labels[0], index.out);
+    flatten(labels[1], index.in);
+  }
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * A read-mostly array which either owns its elements (in a vector) or
+ * refers to memory owned by someone else, usually a memory mapped snapshot
+ * (see snapshot.hpp).
+ *
+ * Reading works the same in both modes. vec() gives write access to the
+ * owned vector; calling it on a mapped array drops the reference to the
+ * mapping and starts with an empty vector.
+ */
+template<typename T>
+class FlatArray {
+  vector<T> owned;
+  const T *mapped = nullptr;
+  size_t mapped_size = 0;
+
+public:
+  typedef T value_type;
+  typedef const T* const_iterator;
+
+  FlatArray() { }
+  FlatArray(const FlatArray &other) = delete;
+  FlatArray& operator=(const FlatArray &other) = delete;
+
+  const T *data() const {
+    return mapped ? mapped : owned.data();
+  }
+
+  size_t size() const {
+    return mapped ? mapped_size : owned.size();
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  const T& operator[](size_t i) const {
+    return data()[i];
+  }
+
+  const T& back() const {
+    return data()[size() - 1];
+  }
+
+  const T *begin() const {
+    return data();
+  }
+
+  const T *end() const {
+    return data() + size();
+  }
+
+  bool is_mapped() const {
+    return mapped != nullptr;
+  }
+
+  /**
+   * Refers to 'n' elements at 'ptr', which must stay valid for the lifetime
+   * of this array (or until the next call to vec() or map()).
+   */
+  void map(const T *ptr, size_t n) {
+    vector<T>().swap(owned);
+    mapped = ptr;
+    mapped_size = n;
+    // keep data() non-null, so that an empty mapping is still a mapping.
+    if (!mapped) {
+      static const T dummy = T();
+      mapped = &dummy;
+      mapped_size = 0;
+    }
+  }
+
+  vector<T> &vec() {
+    if (mapped) {
+      mapped = nullptr;
+      mapped_size = 0;
+    }
+    return owned;
+  }
+};
@@ -1,13 +1,17 @@
+#pragma once
 #include "data.hpp"
+#include "bfs_workspace.hpp"
+#include "article_bitset.hpp"
 #include <algorithm>
 #include <vector>
-#include <set>
-#include <queue>
 
 using namespace std;
 
 /**
  * A basic breadth-first search, with basic trivial cycle avoidance
+ *
+ * The visited articles, their parents and the work queue are kept in a
+ * BFSWorkspace from 'pool', which is returned to the pool with the search.
  */
 class GraphBFS {
 
@@ -20,128 +24,392 @@ protected:
 
 public:
   typedef vector<ArticleID> Path;
-  typedef set<ArticleID> ArticleSet;
+  typedef ArticleBitset ArticleSet;
 
 
 protected:
   ArticleSet& exclude_set;
 
-  const ArticleID VISITED_BIT =  ~(((ArticleID)-1) >> 1);
+  // visited articles (with parent) and the work queue
+  BFSWorkspacePool::Handle workspace;
+  // 'to' isn't marked visited (to find further paths), its parent on the
+  // current path.
+  ArticleID to_parent;
+  // articles taken from the queue
+  size_t visited = 0;
+  // decoded links, if compressed
+  vector<ArticleID> links_buffer;
 
-  const ArticleID ARTICLE_MASK = -1 & ~VISITED_BIT /*& ~ADJACENT_BIT*/;
-  const ArticleID UNVISITED = ARTICLE_MASK;
-  
-  vector<ArticleID> data;
-  queue<ArticleID> work;
-  
-  template<typename T>
-  static constexpr T get_msb() {
-    return ~((T)-1 >> 1);
-  }
 
+  Path backtrack(ArticleID root, ArticleID current) const {
+    vector<ArticleID> path;
+    path.push_back(current);
+    current = to_parent;
+    path.push_back(current);
+    while (current != root) {
+      current = workspace->parent(current);
+      path.push_back(current);
+    }
 
-  template<typename T>
-  static void set_msb(T &d) {
-    d |= get_msb<T>();
+    reverse(path.begin(), path.end());
+    return path;
   }
 
 
-  template<typename T>
-  static bool test_msb(T &d) {
-    return d & get_msb<T>();
+  bool undirected;
+public:
+  GraphBFS(const WikiData& wikidata, ArticleSet& path_exclude_set,
+      ArticleID from, ArticleID to, bool undirected=false,
+      BFSWorkspacePool &pool=BFSWorkspacePool::shared())
+    : wikidata(wikidata), from(from), to(to),
+      exclude_set(path_exclude_set), workspace(pool.acquire(wikidata.linkdb_size())),
+      to_parent(from), undirected(undirected) {
+
+    wikidata.check_articleid_linkdb(from);
+    wikidata.check_articleid_linkdb(to);
+
+    if (exclude_set.count(to)) {
+      throw std::runtime_error("Error: 'to' node is contained in the excluded nodes.");
+    }
+
+    workspace->push(from);
+    workspace->set(from, from);
   }
 
+  /**
+   * Returns the next shortest path, an empty path if no further paths exist.
+   */
+  Path next() {
+    BFSWorkspace &ws = *workspace;
+    while (!ws.queue_empty()) {
+      ArticleID currentArticle = ws.pop();
+      visited++;
+
+      for (const WikiData::LinkRange& links: wikidata.links_of(currentArticle, undirected, links_buffer)) {
+        for (ArticleID nextArticle: links) {
+          if (nextArticle == to) {
+            to_parent = currentArticle;
+            return backtrack(from, to);
+          } else {
+            if (ws.is_set(nextArticle))
+              continue;
+            if (exclude_set.count(nextArticle))
+              continue;
+            ws.set(nextArticle, currentArticle);
+            ws.push(nextArticle);
+          }
+        }
+      }
+    }
+    return Path();
+  }
 
-  bool is_visited(ArticleID article) const {
-    return data[article] & VISITED_BIT;
+  /**
+   * Number of articles whose links were followed so far.
+   */
+  size_t visited_count() const {
+    return visited;
   }
+};
+
+
+/**
+ * Breadth-first search from both ends: the forward search follows outgoing
+ * links from 'from', the backward search incoming links from 'to' (both
+ * follow all links if 'undirected' is set). The side with the smaller
+ * frontier expands a complete level, until the searches meet.
+ *
+ * Requires the incoming links (see WikiData::has_incoming_links). Provides
+ * the same interface as GraphBFS: next() returns a shortest path first,
+ * followed by the further paths found where the searches meet.
+ */
+class BidirectionalBFS {
+  typedef WikiData::ArticleID ArticleID;
 
+public:
+  typedef GraphBFS::Path Path;
+  typedef GraphBFS::ArticleSet ArticleSet;
 
-  void set_visited(ArticleID article) {
-    data[article] |= VISITED_BIT;
+private:
+  const WikiData& wikidata;
+  const ArticleID from;
+  const ArticleID to;
+  const ArticleSet& exclude_set;
+  const bool undirected;
+
+  struct Side {
+    // visited articles, with their parent towards the root of this side.
+    BFSWorkspacePool::Handle visited;
+    vector<ArticleID> frontier;
+    bool forward;
+
+    Side(BFSWorkspacePool::Handle visited, bool forward)
+      : visited(move(visited)), forward(forward) { }
+  };
+  Side sides[2];
+
+  // paths found, but not returned yet. Sorted by decreasing length.
+  vector<Path> pending;
+  // articles whose links were followed, on both sides
+  size_t expanded = 0;
+  // decoded links, if compressed
+  vector<ArticleID> links_buffer;
+
+  // the links 'side' follows from 'article': its own direction first,
+  // the other one as well if undirected.
+  WikiData::LinkRanges follow(const Side &side, ArticleID article) {
+    WikiData::LinkRange out = wikidata.outlinks_of(article, links_buffer);
+    WikiData::LinkRange in = wikidata.inlinks_of(article);
+    WikiData::LinkRanges ranges = {{ side.forward ? out : in, side.forward ? in : out }};
+    if (!undirected)
+      ranges[1] = WikiData::LinkRange();
+    return ranges;
   }
 
+  // 'a' was reached by the forward search, 'b' by the backward search.
+  Path make_path(ArticleID a, ArticleID b) const {
+    Path path;
+    for (ArticleID c = a; c != from; c = sides[0].visited->parent(c)) {
+      path.push_back(c);
+    }
+    path.push_back(from);
+    reverse(path.begin(), path.end());
+    for (ArticleID c = b; c != to; c = sides[1].visited->parent(c)) {
+      path.push_back(c);
+    }
+    path.push_back(to);
+    return path;
+  }
 
-  ArticleID get_parent(ArticleID article) const {
-    return data[article] & ARTICLE_MASK;
+  // expands one level of 'side', adding paths to 'pending' for each link
+  // reaching the other side.
+  void expand(Side &side, const Side &other) {
+    BFSWorkspace &visited = *side.visited;
+    const BFSWorkspace &other_visited = *other.visited;
+    vector<ArticleID> next;
+    size_t found = pending.size();
+    expanded += side.frontier.size();
+    for (ArticleID current: side.frontier) {
+      WikiData::LinkRanges ranges = follow(side, current);
+      for (size_t r = 0; r < ranges.size(); ++r) {
+        for (ArticleID article: ranges[r]) {
+          if (visited.is_set(article))
+            continue;
+          if (exclude_set.count(article))
+            continue;
+          if (other_visited.is_set(article)) {
+            // don't mark it, so other links to it are found as well; but
+            // only once if linked in both directions.
+            if (r == 1 && binary_search(ranges[0].begin(), ranges[0].end(), article))
+              continue;
+            pending.push_back(side.forward ? make_path(current, article) : make_path(article, current));
+            continue;
+          }
+          visited.set(article, current);
+          next.push_back(article);
+        }
+      }
+    }
+    side.frontier.swap(next);
+    sort(pending.begin() + found, pending.end(), [](const Path &a, const Path &b) {
+      return a.size() > b.size();
+    });
   }
 
+public:
+  BidirectionalBFS(const WikiData& wikidata, const ArticleSet& path_exclude_set,
+      ArticleID from, ArticleID to, bool undirected=false,
+      BFSWorkspacePool &pool=BFSWorkspacePool::shared())
+    : wikidata(wikidata), from(from), to(to),
+      exclude_set(path_exclude_set), undirected(undirected),
+      sides{ Side(pool.acquire(wikidata.linkdb_size()), true),
+             Side(pool.acquire(wikidata.linkdb_size()), false) } {
+    wikidata.check_articleid_linkdb(from);
+    wikidata.check_articleid_linkdb(to);
+
+    if (exclude_set.count(to)) {
+      throw std::runtime_error("Error: 'to' node is contained in the excluded nodes.");
+    }
+    if (from == to) {
+      throw std::runtime_error("Error: 'from' and 'to' are the same node.");
+    }
+
+    sides[0].visited->set(from, from);
+    sides[0].frontier.push_back(from);
+    sides[1].visited->set(to, to);
+    sides[1].frontier.push_back(to);
+  }
 
   /**
-   *Set parent. Does not override previously existing parent unless 'force' is set.
+   * Returns the next path, an empty path if no further paths exist.
    */
-  void set_parent(ArticleID article, ArticleID parent, bool force = false) {
-    if (force || get_parent(article) > data.size()) {
-      data[article] = (data[article] & ~ARTICLE_MASK) | (ARTICLE_MASK & parent);
+  Path next() {
+    while (pending.empty()) {
+      Side &forward = sides[0];
+      Side &backward = sides[1];
+      if (forward.frontier.empty() && backward.frontier.empty())
+        return Path();
+      bool expand_forward = !forward.frontier.empty() &&
+        (backward.frontier.empty() || forward.frontier.size() <= backward.frontier.size());
+      if (expand_forward) {
+        expand(forward, backward);
+      } else {
+        expand(backward, forward);
+      }
     }
+    Path ret = pending.back();
+    pending.pop_back();
+    return ret;
   }
 
-
-  Path backtrack(ArticleID root, ArticleID current) const {
-    vector<ArticleID> path;
-    path.push_back(current);
-    do {
-      current = get_parent(current);
-      path.push_back(current);
-    } while (current != root);
-    
-    reverse(path.begin(), path.end());
-    return path;
+  /**
+   * Number of articles whose links were followed so far.
+   */
+  size_t visited_count() const {
+    return expanded;
   }
+};
 
 
-  bool undirected;
+/**
+ * A* search from 'from' to 'to' along outgoing links, guided by the lower
+ * bounds of wikidata.landmarks (ALT). Articles are expanded in order of
+ * their distance from 'from' plus the bound of their distance to 'to', so
+ * the search heads towards 'to' instead of visiting everything closer than
+ * it. The bounds are consistent, an article is first expanded from a
+ * shortest path.
+ *
+ * Provides the interface of GraphBFS, but next() only returns one shortest
+ * path (followed by an empty one).
+ */
+class LandmarkSearch {
+  typedef WikiData::ArticleID ArticleID;
+
 public:
-  GraphBFS(const WikiData& wikidata, ArticleSet& path_exclude_set,
-      ArticleID from, ArticleID to, bool undirected=false)
-    : wikidata(wikidata), from(from), to(to),
-      exclude_set(path_exclude_set), undirected(undirected) {
+  typedef GraphBFS::Path Path;
+  typedef GraphBFS::ArticleSet ArticleSet;
+
+private:
+  const WikiData& wikidata;
+  const Landmarks& landmarks;
+  const ArticleID from;
+  const ArticleID to;
+  const ArticleSet& exclude_set;
+
+  struct Entry {
+    ArticleID article;
+    ArticleID parent;
+    uint32_t distance;
+  };
+  // expanded articles, with their parent
+  BFSWorkspacePool::Handle expanded_set;
+  // queued articles by distance plus bound. Each bucket is a stack: on
+  // ties, the articles reached last are closer to 'to'.
+  vector<vector<Entry>> buckets;
+  size_t current = 0;
+  size_t visited = 0;
+  bool done = false;
+  // decoded links, if compressed
+  vector<ArticleID> links_buffer;
+
+  void push(ArticleID article, ArticleID parent, uint32_t distance) {
+    Landmarks::Distance bound = landmarks.lower_bound(article, to);
+    if (bound == Landmarks::no_path)
+      return;
+    size_t f = max((size_t)(distance + bound), current);
+    if (f >= buckets.size())
+      buckets.resize(f + 1);
+    Entry entry = { article, parent, distance };
+    buckets[f].push_back(entry);
+  }
 
-    data.clear();
-    data.resize(wikidata.links.size(), UNVISITED);
+  Path backtrack() const {
+    Path path;
+    for (ArticleID c = to; c != from; c = expanded_set->parent(c)) {
+      path.push_back(c);
+    }
+    path.push_back(from);
+    reverse(path.begin(), path.end());
+    return path;
+  }
 
+public:
+  LandmarkSearch(const WikiData& wikidata, const ArticleSet& path_exclude_set,
+      ArticleID from, ArticleID to, BFSWorkspacePool &pool=BFSWorkspacePool::shared())
+    : wikidata(wikidata), landmarks(wikidata.landmarks), from(from), to(to),
+      exclude_set(path_exclude_set), expanded_set(pool.acquire(wikidata.linkdb_size())) {
     wikidata.check_articleid_linkdb(from);
     wikidata.check_articleid_linkdb(to);
 
     if (exclude_set.count(to)) {
       throw std::runtime_error("Error: 'to' node is contained in the excluded nodes.");
     }
-    
-    work.push(from);
-    set_visited(from);
+    if (from == to) {
+      throw std::runtime_error("Error: 'from' and 'to' are the same node.");
+    }
+    push(from, from, 0);
   }
 
   /**
-   * Returns the next shortest path, an empty path if no further paths exist.
+   * Returns a shortest path on the first call, then an empty path.
    */
-  Path next() { 
-    while (!work.empty()) {
-      ArticleID currentArticle = work.front();
-      work.pop();
-
-      for (const WikiData::Pagelink& l: wikidata.links[currentArticle]) {
-        if (!undirected && !WikiData::is_outgoing(l))
+  Path next() {
+    if (done)
+      return Path();
+    done = true;
+    BFSWorkspace &expanded = *expanded_set;
+    for (; current < buckets.size(); ++current) {
+      while (!buckets[current].empty()) {
+        Entry e = buckets[current].back();
+        buckets[current].pop_back();
+        if (expanded.is_set(e.article))
           continue;
-
-        ArticleID nextArticle = WikiData::to_ArticleID(l);
-
-        if (nextArticle == to) {
-          set_parent(nextArticle, currentArticle, true);
-          return backtrack(from, to);
-        } else {
-          if (is_visited(nextArticle))
+        expanded.set(e.article, e.parent);
+        visited++;
+        if (e.article == to)
+          return backtrack();
+        for (ArticleID next: wikidata.outlinks_of(e.article, links_buffer)) {
+          if (expanded.is_set(next) || exclude_set.count(next))
             continue;
-          if (exclude_set.count(nextArticle))
-            continue;
-          set_parent(nextArticle, currentArticle);
-          set_visited(nextArticle);
-          work.push(nextArticle);
+          push(next, e.article, e.distance + 1);
         }
       }
     }
     return Path();
   }
 
-
+  /**
+   * Number of articles whose links were followed so far.
+   */
+  size_t visited_count() const {
+    return visited;
+  }
 };
 
+
+/**
+ * A shortest path from 'from' to 'to' along outgoing links, using the
+ * distance index (which has to be built): every step follows a link to an
+ * article one link closer to 'to'. Only looks at the articles on the path
+ * and their links. Ignores excluded articles. Empty if there is no path.
+ */
+inline GraphBFS::Path distance_index_path(const WikiData &wikidata,
+    WikiData::ArticleID from, WikiData::ArticleID to) {
+  const DistanceIndex &index = wikidata.distance_index;
+  GraphBFS::Path path;
+  DistanceIndex::Distance d = index.distance(from, to);
+  if (d == (DistanceIndex::Distance)-1)
+    return path;
+  path.push_back(from);
+  vector<WikiData::ArticleID> buffer;
+  for (WikiData::ArticleID current = from; d > 0; --d) {
+    for (WikiData::ArticleID next: wikidata.outlinks_of(current, buffer)) {
+      if (index.distance(next, to) == d - 1) {
+        current = next;
+        break;
+      }
+    }
+    path.push_back(current);
+  }
+  return path;
+}
@@ -0,0 +1,149 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <boost/utility/string_ref.hpp>
+
+#include "flat_array.hpp"
+#include "label_store.hpp"
+#include "parallel_sort.hpp"
+
+using namespace std;
+
+/**
+ * All article ids, sorted by label (page title), for find_by_label.
+ *
+ * Unlike a lookup of the normalized label in the resource order, this
+ * covers custom labels as well. Costs 4 bytes per article, plus the first
+ * sample_length bytes of the label of every sample_step'th entry (~1 byte
+ * per article). The samples narrow down the binary search in one
+ * contiguous array before labels have to be decoded from the LabelStore.
+ * Lookups don't allocate.
+ */
+class LabelIndex {
+public:
+  typedef LabelStore::ArticleID ArticleID;
+
+  static const size_t sample_step = 16;
+  static const size_t sample_length = 16;
+
+  FlatArray<ArticleID> ids;
+  // sample i: label prefix of ids[i * sample_step], zero padded
+  FlatArray<char> samples;
+
+  LabelIndex() { }
+  LabelIndex(const LabelIndex &other) = delete;
+  LabelIndex& operator=(const LabelIndex &other) = delete;
+
+  bool empty() const {
+    return ids.empty();
+  }
+
+  void clear() {
+    vector<ArticleID>().swap(ids.vec());
+    vector<char>().swap(samples.vec());
+  }
+
+  /**
+   * Replaces the index with one for all labels of 'labels', sorting on
+   * 'n_threads' threads. Needs all labels in memory temporarily.
+   */
+  void build(const LabelStore &labels, size_t n_threads) {
+    vector<ArticleID> &sorted = ids.vec();
+    vector<char> &new_samples = samples.vec();
+    sorted.clear();
+    new_samples.clear();
+    const size_t n = labels.size();
+    if (!n)
+      return;
+
+    vector<char> text;
+    vector<uint64_t> offsets;
+    offsets.reserve(n + 1);
+    offsets.push_back(0);
+    size_t next_custom = 0;
+    labels.for_each_resource([&](ArticleID article, boost::string_ref resource) {
+      if (next_custom < labels.custom_label_count() &&
+          labels.custom_label_ids[next_custom] == article) {
+        boost::string_ref custom = labels.custom_label(article);
+        text.insert(text.end(), custom.begin(), custom.end());
+        next_custom++;
+      } else {
+        for (char c: resource) {
+          text.push_back(c == '_' ? ' ' : c);
+        }
+      }
+      offsets.push_back(text.size());
+    });
+
+    sorted.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      sorted[i] = i;
+    }
+    auto label = [&](ArticleID a) {
+      return boost::string_ref(text.data() + offsets[a], offsets[a + 1] - offsets[a]);
+    };
+    parallel_sort(sorted.begin(), sorted.end(), [&](ArticleID a, ArticleID b) {
+      int c = label(a).compare(label(b));
+      return c < 0 || (c == 0 && a < b);
+    }, n_threads);
+
+    new_samples.assign((n + sample_step - 1) / sample_step * sample_length, 0);
+    for (size_t i = 0; i < n; i += sample_step) {
+      boost::string_ref l = label(sorted[i]).substr(0, sample_length);
+      copy(l.begin(), l.end(), new_samples.begin() + i / sample_step * sample_length);
+    }
+  }
+
+  /**
+   * The (smallest) article with label 'key', or -1.
+   */
+  ArticleID find(const LabelStore &labels, boost::string_ref key) const {
+    // Samples are prefixes, so the comparison with the key is only
+    // conclusive if they differ. The result is after the last sample less
+    // than the key's prefix and not after the first one greater than it.
+    // (Labels don't contain '\0', so the zero padding sorts like the end
+    // of the string.)
+    char prefix[sample_length] = { 0 };
+    copy(key.begin(), key.begin() + min(key.size(), (size_t)sample_length), prefix);
+    const char *begin = samples.data();
+    const size_t n_samples = samples.size() / sample_length;
+    size_t first = lower_bound_sample(begin, 0, n_samples, prefix);
+    size_t last = first;
+    while (last < n_samples && memcmp(begin + last * sample_length, prefix, sample_length) == 0)
+      last++;
+    first = first ? (first - 1) * sample_step + 1 : 0;
+    last = min(last * sample_step, ids.size());
+    while (first < last) {
+      size_t mid = first + (last - first) / 2;
+      if (labels.compare_label(ids[mid], key) < 0) {
+        first = mid + 1;
+      } else {
+        last = mid;
+      }
+    }
+    if (first == ids.size() || labels.compare_label(ids[first], key) != 0)
+      return -1;
+    return ids[first];
+  }
+
+  size_t memory_usage() const {
+    return ids.size() * sizeof(ArticleID) + samples.size();
+  }
+
+private:
+  // first sample in [first, last) not less than 'prefix'
+  static size_t lower_bound_sample(const char *samples, size_t first, size_t last,
+                                   const char *prefix) {
+    while (first < last) {
+      size_t mid = first + (last - first) / 2;
+      if (memcmp(samples + mid * sample_length, prefix, sample_length) < 0) {
+        first = mid + 1;
+      } else {
+        last = mid;
+      }
+    }
+    return first;
+  }
+};
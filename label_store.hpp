@@ -0,0 +1,537 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <boost/utility/string_ref.hpp>
+
+#include "flat_array.hpp"
+#include "parseutil.hpp"
+
+using namespace std;
+
+/**
+ * Sorted, front coded store of all page resources and labels.
+ *
+ * Resources are stored in blocks of 'block_size' entries in resource_data.
+ * The first entry of each block is stored completely
+ *   <varint length> <bytes>
+ * all others relative to their predecessor
+ *   <varint shared prefix length> <varint suffix length> <suffix bytes>
+ * resource_block_offsets points to the start of each block (plus one entry
+ * for the end of the data).
+ *
+ * The label of a page usually is its resource with '_' replaced by ' '.
+ * Only the labels which differ are stored, in a side table: custom_label_ids
+ * is sorted, custom label i is
+ * custom_label_data[custom_label_offsets[i]] .. [custom_label_offsets[i+1] - 1].
+ *
+ * info holds the number of entries and the block size (empty if there are
+ * no labels).
+ *
+ * Entries which are not stored contiguously are decoded to a buffer
+ * provided by the caller; reusing the buffer keeps lookups allocation-free.
+ */
+class LabelStore {
+public:
+  typedef uint32_t ArticleID;
+  typedef boost::string_ref string_view;
+
+  static const size_t default_block_size = 16;
+
+  FlatArray<uint64_t> info;
+  FlatArray<uint64_t> resource_block_offsets;
+  FlatArray<char> resource_data;
+  FlatArray<ArticleID> custom_label_ids;
+  FlatArray<uint64_t> custom_label_offsets;
+  FlatArray<char> custom_label_data;
+
+  LabelStore() { }
+  LabelStore(const LabelStore &other) = delete;
+  LabelStore& operator=(const LabelStore &other) = delete;
+
+  size_t size() const {
+    return info.empty() ? 0 : info[0];
+  }
+
+  size_t block_size() const {
+    return info.empty() ? default_block_size : info[1];
+  }
+
+  size_t custom_label_count() const {
+    return custom_label_ids.size();
+  }
+
+
+  /**
+   * Replaces the store with 'compressed', which is sorted and consists of
+   * resources, optionally followed by '\0' and the page label. Empties
+   * 'compressed'.
+   */
+  void build(vector<string> &compressed) {
+    vector<uint64_t> &new_info = info.vec();
+    vector<uint64_t> &block_offsets = resource_block_offsets.vec();
+    vector<char> &data = resource_data.vec();
+    vector<ArticleID> &custom_ids = custom_label_ids.vec();
+    vector<uint64_t> &custom_offsets = custom_label_offsets.vec();
+    vector<char> &custom_data = custom_label_data.vec();
+    new_info.clear();
+    block_offsets.clear();
+    data.clear();
+    custom_ids.clear();
+    custom_offsets.clear();
+    custom_data.clear();
+    if (compressed.empty())
+      return;
+
+    const uint64_t bs = default_block_size;
+    const size_t n_blocks = (compressed.size() + bs - 1) / bs;
+    new_info.push_back(compressed.size());
+    new_info.push_back(bs);
+    block_offsets.reserve(n_blocks + 1);
+    custom_offsets.push_back(0);
+
+    string_view previous;
+    string previous_storage;
+    for (size_t i = 0; i < compressed.size(); ++i) {
+      string_view entry(compressed[i]);
+      string_view resource = entry.substr(0, entry.find('\0'));
+      if (resource.size() < entry.size()) {
+        string_view label = entry.substr(resource.size() + 1);
+        custom_ids.push_back(i);
+        custom_data.insert(custom_data.end(), label.begin(), label.end());
+        custom_offsets.push_back(custom_data.size());
+      }
+
+      if (i % bs == 0) {
+        block_offsets.push_back(data.size());
+        put_varint(data, resource.size());
+        data.insert(data.end(), resource.begin(), resource.end());
+      } else {
+        size_t prefix = common_prefix(previous, resource);
+        put_varint(data, prefix);
+        put_varint(data, resource.size() - prefix);
+        data.insert(data.end(), resource.begin() + prefix, resource.end());
+      }
+      previous_storage.assign(resource.begin(), resource.end());
+      previous = previous_storage;
+      string().swap(compressed[i]);
+    }
+    block_offsets.push_back(data.size());
+    vector<string>().swap(compressed);
+    data.shrink_to_fit();
+    custom_data.shrink_to_fit();
+    custom_ids.shrink_to_fit();
+    custom_offsets.shrink_to_fit();
+  }
+
+
+  /**
+   * The resource of 'article', which must be valid. The result refers to
+   * 'buffer' or to the store.
+   */
+  string_view resource(ArticleID article, string &buffer) const {
+    size_t bs = block_size();
+    const char *p = resource_data.data() + resource_block_offsets[article / bs];
+    size_t length = get_varint(p);
+    size_t n = article % bs;
+    if (!n)
+      return string_view(p, length);
+    buffer.assign(p, length);
+    p += length;
+    for (size_t i = 0; i < n; ++i) {
+      size_t prefix = get_varint(p);
+      size_t suffix = get_varint(p);
+      buffer.resize(prefix);
+      buffer.append(p, suffix);
+      p += suffix;
+    }
+    return buffer;
+  }
+
+
+  /**
+   * The custom label of 'article', or an empty string_view if the label is
+   * derived from the resource.
+   */
+  string_view custom_label(ArticleID article) const {
+    string_view ret;
+    find_custom_label(article, ret);
+    return ret;
+  }
+
+
+  /**
+   * The label of 'article', which must be valid. The result refers to
+   * 'buffer' or to the store.
+   */
+  string_view label(ArticleID article, string &buffer) const {
+    string_view custom;
+    if (find_custom_label(article, custom))
+      return custom;
+    string_view res = resource(article, buffer);
+    if (res.data() != buffer.data())
+      buffer.assign(res.begin(), res.end());
+    wikipedia_denormalization(buffer);
+    return buffer;
+  }
+
+
+  /**
+   * The id of an entry with the given resource, or -1.
+   * Does not allocate.
+   */
+  ArticleID find(string_view key) const {
+    return find_in_block(last_block_not_after(key, 0, block_count()), key);
+  }
+
+
+  /**
+   * find() for keys that usually come in ascending order, like a merge
+   * join with the store: the blocks are searched from the one of 'hint'
+   * (an earlier result) on, in steps doubling from 1, so nearby keys take a
+   * few comparisons instead of a binary search over all blocks. Falls back
+   * to find() for keys before the block of 'hint'.
+   */
+  ArticleID find_from(string_view key, ArticleID hint) const {
+    const size_t n_blocks = block_count();
+    size_t first = hint / block_size();
+    if (first >= n_blocks || key < block_head(first))
+      return find(key);
+    // block_head(first) <= key < block_head(last), or last is n_blocks.
+    size_t step = 1, last = first + 1;
+    while (last < n_blocks && !(key < block_head(last))) {
+      first = last;
+      step *= 2;
+      last = min(n_blocks, first + step);
+    }
+    return find_in_block(last_block_not_after(key, first + 1, last), key);
+  }
+
+
+  /**
+   * find() for 'n_keys' keys at once, the results go to 'out'. The binary
+   * searches of a group of keys advance in lockstep: each step first
+   * prefetches the block offsets all of them read next, then the block
+   * heads, then compares. The cache misses of a group overlap instead of
+   * each one waiting for the previous.
+   */
+  void find_batch(const string_view *keys, size_t n_keys, ArticleID *out) const {
+    const size_t n_blocks = block_count();
+    size_t first[batch_group_size], last[batch_group_size];
+    for (size_t g = 0; g < n_keys; g += batch_group_size) {
+      size_t m = n_keys - g;
+      if (m > batch_group_size)
+        m = batch_group_size;
+      const string_view *group = keys + g;
+      for (size_t j = 0; j < m; ++j) {
+        first[j] = 0;
+        last[j] = n_blocks;
+      }
+      // the searches differ by at most one step.
+      bool searching = n_blocks > 0;
+      while (searching) {
+        for (size_t j = 0; j < m; ++j) {
+          if (first[j] < last[j])
+            __builtin_prefetch(&resource_block_offsets[first[j] + (last[j] - first[j]) / 2]);
+        }
+        for (size_t j = 0; j < m; ++j) {
+          if (first[j] < last[j])
+            __builtin_prefetch(resource_data.data() +
+                               resource_block_offsets[first[j] + (last[j] - first[j]) / 2]);
+        }
+        searching = false;
+        for (size_t j = 0; j < m; ++j) {
+          if (first[j] >= last[j])
+            continue;
+          size_t mid = first[j] + (last[j] - first[j]) / 2;
+          if (group[j] < block_head(mid)) {
+            last[j] = mid;
+          } else {
+            first[j] = mid + 1;
+          }
+          searching |= first[j] < last[j];
+        }
+      }
+      for (size_t j = 0; j < m; ++j) {
+        out[g + j] = find_in_block(first[j], group[j]);
+      }
+    }
+  }
+
+
+  /**
+   * Prefetch what resource_equals(article, ...) reads, for lookups
+   * interleaving their memory accesses: prefetch_offset first, then
+   * prefetch_resource once the offset is likely loaded.
+   */
+  void prefetch_offset(ArticleID article) const {
+    __builtin_prefetch(&resource_block_offsets[article / block_size()]);
+  }
+
+  void prefetch_resource(ArticleID article) const {
+    const char *p = resource_data.data() + resource_block_offsets[article / block_size()];
+    __builtin_prefetch(p);
+    __builtin_prefetch(p + 64);
+  }
+
+
+  /**
+   * Whether the resource of 'article' (which must be valid) equals 'key'.
+   * Does not allocate.
+   */
+  bool resource_equals(ArticleID article, string_view key) const {
+    size_t bs = block_size();
+    const char *p = resource_data.data() + resource_block_offsets[article / bs];
+    size_t length = get_varint(p);
+    size_t n = article % bs;
+    // common prefix of the current entry and the key
+    size_t match = common_prefix(string_view(p, length), key);
+    p += length;
+    for (size_t i = 0; i < n; ++i) {
+      size_t prefix = get_varint(p);
+      size_t suffix_length = get_varint(p);
+      if (prefix <= match) {
+        match = prefix + common_prefix(string_view(p, suffix_length), key.substr(prefix));
+      }
+      length = prefix + suffix_length;
+      p += suffix_length;
+    }
+    return match == length && length == key.size();
+  }
+
+
+  /**
+   * Compares the label of 'article' (which must be valid) with 'key' like
+   * string::compare. Does not allocate.
+   */
+  int compare_label(ArticleID article, string_view key) const {
+    string_view custom;
+    if (find_custom_label(article, custom))
+      return custom.compare(key);
+
+    // As resource_equals, with '_' read as ' '. 'next' is the character of
+    // the current entry at position 'match', or -1 if the entry ends there.
+    size_t bs = block_size();
+    const char *p = resource_data.data() + resource_block_offsets[article / bs];
+    size_t length = get_varint(p);
+    size_t match = common_denormalized_prefix(string_view(p, length), key);
+    int next = match < length ? denormalized(p[match]) : -1;
+    p += length;
+    for (size_t i = 0, n = article % bs; i < n; ++i) {
+      size_t prefix = get_varint(p);
+      size_t suffix_length = get_varint(p);
+      if (prefix <= match) {
+        size_t c = common_denormalized_prefix(string_view(p, suffix_length), key.substr(prefix));
+        match = prefix + c;
+        next = c < suffix_length ? denormalized(p[c]) : -1;
+      }
+      p += suffix_length;
+    }
+    int key_next = match < key.size() ? (unsigned char)key[match] : -1;
+    return next < key_next ? -1 : (next > key_next ? 1 : 0);
+  }
+
+
+  /**
+   * Calls f(article, resource) for all entries in order. Cheaper than
+   * calling resource() for each one.
+   */
+  template<typename F>
+  void for_each_resource(F f) const {
+    string buffer;
+    const size_t bs = block_size();
+    const char *p = resource_data.data();
+    for (size_t i = 0; i < size(); ++i) {
+      if (i % bs == 0) {
+        size_t length = get_varint(p);
+        buffer.assign(p, length);
+        p += length;
+      } else {
+        size_t prefix = get_varint(p);
+        size_t suffix = get_varint(p);
+        buffer.resize(prefix);
+        buffer.append(p, suffix);
+        p += suffix;
+      }
+      f((ArticleID)i, string_view(buffer));
+    }
+  }
+
+
+  /**
+   * True if every block decodes within its bytes, with shared prefixes no
+   * longer than the resource before. For stores not built here (snapshots),
+   * whose block offsets were checked already.
+   */
+  bool blocks_valid() const {
+    const size_t bs = block_size();
+    for (size_t block = 0; block + 1 < resource_block_offsets.size(); ++block) {
+      const char *p = resource_data.data() + resource_block_offsets[block];
+      const char *end = resource_data.data() + resource_block_offsets[block + 1];
+      size_t entries = min(bs, size() - block * bs);
+      size_t previous = 0;
+      for (size_t i = 0; i < entries; ++i) {
+        size_t prefix = 0, suffix;
+        if ((i && (!get_varint(p, end, prefix) || prefix > previous)) ||
+            !get_varint(p, end, suffix) || suffix > (size_t)(end - p))
+          return false;
+        p += suffix;
+        previous = prefix + suffix;
+      }
+      if (p != end)
+        return false;
+    }
+    return true;
+  }
+
+
+  /**
+   * Heap memory used by the store (0 for mapped arrays).
+   */
+  size_t memory_usage() const {
+    return owned_size(info) + owned_size(resource_block_offsets) +
+      owned_size(resource_data) + owned_size(custom_label_ids) +
+      owned_size(custom_label_offsets) + owned_size(custom_label_data);
+  }
+
+private:
+  bool find_custom_label(ArticleID article, string_view &out) const {
+    auto it = lower_bound(custom_label_ids.begin(), custom_label_ids.end(), article);
+    if (it == custom_label_ids.end() || *it != article)
+      return false;
+    size_t i = it - custom_label_ids.begin();
+    out = string_view(custom_label_data.data() + custom_label_offsets[i],
+        custom_label_offsets[i + 1] - custom_label_offsets[i]);
+    return true;
+  }
+
+  // keys find_batch searches at once
+  static const size_t batch_group_size = 16;
+
+  size_t block_count() const {
+    return resource_block_offsets.size() ? resource_block_offsets.size() - 1 : 0;
+  }
+
+  // one past the last of the blocks [first, last) whose first entry is not
+  // greater than 'key', or 'first' if there is none.
+  size_t last_block_not_after(string_view key, size_t first, size_t last) const {
+    while (first < last) {
+      size_t mid = first + (last - first) / 2;
+      if (key < block_head(mid)) {
+        last = mid;
+      } else {
+        first = mid + 1;
+      }
+    }
+    return first;
+  }
+
+  // the entry equal to 'key' in the block before 'block_end', or -1.
+  ArticleID find_in_block(size_t block_end, string_view key) const {
+    if (block_end == 0)
+      return -1;
+    const size_t block = block_end - 1;
+    const size_t bs = block_size();
+
+    const char *p = resource_data.data() + resource_block_offsets[block];
+    size_t length = get_varint(p);
+    string_view head(p, length);
+    p += length;
+    if (head == key)
+      return block * bs;
+
+    // The entries are sorted and each one is less than the key, so far.
+    // 'match' is the common prefix of the current entry and the key.
+    size_t match = common_prefix(head, key);
+    const size_t n = min(bs, size() - block * bs);
+    for (size_t i = 1; i < n; ++i) {
+      size_t prefix = get_varint(p);
+      size_t suffix_length = get_varint(p);
+      const char *suffix = p;
+      p += suffix_length;
+      if (prefix > match) {
+        // differs from the key where the previous entry did.
+        continue;
+      }
+      if (prefix < match) {
+        // greater than the previous entry at a position where that matched the key.
+        return -1;
+      }
+      size_t c = common_prefix(string_view(suffix, suffix_length), key.substr(match));
+      match += c;
+      if (c == suffix_length) {
+        if (match == key.size())
+          return block * bs + i;
+        continue;
+      }
+      if (match == key.size() || (unsigned char)suffix[c] > (unsigned char)key[match])
+        return -1;
+    }
+    return -1;
+  }
+
+  string_view block_head(size_t block) const {
+    const char *p = resource_data.data() + resource_block_offsets[block];
+    size_t length = get_varint(p);
+    return string_view(p, length);
+  }
+
+  template<typename T>
+  static size_t owned_size(const FlatArray<T> &array) {
+    return array.is_mapped() ? 0 : array.size() * sizeof(T);
+  }
+
+  static size_t common_prefix(string_view a, string_view b) {
+    size_t n = min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && a[i] == b[i])
+      i++;
+    return i;
+  }
+
+  static int denormalized(char c) {
+    return c == '_' ? ' ' : (unsigned char)c;
+  }
+
+  // common prefix of 'a' with '_' read as ' ' and 'b'.
+  static size_t common_denormalized_prefix(string_view a, string_view b) {
+    size_t n = min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && denormalized(a[i]) == (unsigned char)b[i])
+      i++;
+    return i;
+  }
+
+  static void put_varint(vector<char> &out, size_t value) {
+    while (value >= 0x80) {
+      out.push_back((char)(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back((char)value);
+  }
+
+  static size_t get_varint(const char *&p) {
+    size_t value = 0;
+    unsigned shift = 0;
+    while (true) {
+      unsigned char c = *p++;
+      value |= (size_t)(c & 0x7f) << shift;
+      if (!(c & 0x80))
+        return value;
+      shift += 7;
+    }
+  }
+
+  // get_varint() reading no further than 'end'.
+  static bool get_varint(const char *&p, const char *end, size_t &value) {
+    value = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+      unsigned char c = *p++;
+      value |= (size_t)(c & 0x7f) << shift;
+      if (!(c & 0x80))
+        return true;
+    }
+    return false;
+  }
+};
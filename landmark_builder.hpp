@@ -0,0 +1,173 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+
+#include "data.hpp"
+
+using namespace std;
+
+/**
+ * Selects 'k' landmarks of the link database and computes the Landmarks
+ * distances with a BFS to and from each of them.
+ *
+ * The first landmark is the article with the most links. Each further one
+ * is the article farthest (distance to plus from the nearest landmark)
+ * from the landmarks chosen so far, among the articles in the strongly
+ * connected component of the first one; bounds are best for targets on the
+ * far side of a landmark, so the landmarks should lie around the graph.
+ * Articles outside that component would be "farthest" without helping.
+ *
+ * The backward searches use a transposed copy of the outgoing links, which
+ * is freed after the build. With more than one thread, the two searches of
+ * a landmark run in parallel.
+ */
+class LandmarkBuilder {
+public:
+  typedef WikiData::ArticleID ArticleID;
+
+private:
+  const WikiData &wikidata;
+  const size_t n;
+  const size_t k;
+  const size_t n_threads;
+
+  const uint8_t unreachable = Landmarks::unreachable;
+  const uint8_t far = Landmarks::far;
+
+  // incoming links in CSR form
+  vector<uint64_t> in_offsets;
+  vector<ArticleID> in_sources;
+
+  void build_incoming() {
+    in_offsets.assign(n + 1, 0);
+    vector<ArticleID> buffer;
+    for (ArticleID a = 0; a < n; ++a) {
+      for (ArticleID target: wikidata.outlinks_of(a, buffer)) {
+        in_offsets[target + 1]++;
+      }
+    }
+    for (size_t i = 0; i < n; ++i) {
+      in_offsets[i + 1] += in_offsets[i];
+    }
+    in_sources.resize(in_offsets[n]);
+    vector<uint64_t> pos(in_offsets.begin(), in_offsets.end() - 1);
+    for (ArticleID a = 0; a < n; ++a) {
+      for (ArticleID target: wikidata.outlinks_of(a, buffer)) {
+        in_sources[pos[target]++] = a;
+      }
+    }
+  }
+
+  /**
+   * BFS from 'root', along outgoing links if 'forward', else along incoming
+   * ones. Distances are capped at Landmarks::far.
+   */
+  void search(ArticleID root, bool forward, vector<uint8_t> &distance) const {
+    distance.assign(n, unreachable);
+    vector<ArticleID> queue, buffer;
+    queue.reserve(n);
+    queue.push_back(root);
+    distance[root] = 0;
+    auto visit = [&](ArticleID next, uint8_t d) {
+      if (distance[next] != unreachable)
+        return;
+      distance[next] = d;
+      queue.push_back(next);
+    };
+    for (size_t head = 0; head < queue.size(); ++head) {
+      ArticleID a = queue[head];
+      uint8_t d = distance[a] == far ? far : distance[a] + 1;
+      if (forward) {
+        for (ArticleID target: wikidata.outlinks_of(a, buffer)) {
+          visit(target, d);
+        }
+      } else {
+        for (uint64_t i = in_offsets[a]; i < in_offsets[a + 1]; ++i) {
+          visit(in_sources[i], d);
+        }
+      }
+    }
+  }
+
+public:
+  LandmarkBuilder(const WikiData &wikidata, size_t k, size_t n_threads)
+    : wikidata(wikidata), n(wikidata.linkdb_size()), k(min(k, (size_t)wikidata.linkdb_size())),
+      n_threads(max((size_t)1, n_threads)) { }
+
+  /**
+   * Replaces 'landmarks' with 'k' landmarks of the link database.
+   */
+  void build(Landmarks &landmarks) {
+    landmarks.clear();
+    if (!k)
+      return;
+    build_incoming();
+
+    vector<uint32_t> degree(n);
+    for (ArticleID a = 0; a < n; ++a) {
+      degree[a] = in_offsets[a + 1] - in_offsets[a] + wikidata.outlink_count(a);
+    }
+
+    vector<ArticleID> &articles = landmarks.articles.vec();
+    vector<uint8_t> &distances = landmarks.distances.vec();
+    distances.resize(n * k * 2);
+    // distance to plus from the nearest landmark, -1 outside of the
+    // component of the first landmark.
+    const uint32_t outside = -1;
+    vector<uint32_t> nearest(n, outside);
+    vector<uint8_t> to, from;
+    for (size_t i = 0; i < k; ++i) {
+      ArticleID landmark = 0;
+      for (ArticleID a = 1; a < n; ++a) {
+        bool better;
+        if (articles.empty()) {
+          better = degree[a] > degree[landmark];
+        } else {
+          better = nearest[a] != outside && (nearest[landmark] == outside ||
+            nearest[a] > nearest[landmark] ||
+            (nearest[a] == nearest[landmark] && degree[a] > degree[landmark]));
+        }
+        if (better)
+          landmark = a;
+      }
+      if (articles.size() && (nearest[landmark] == outside || nearest[landmark] == 0))
+        break;  // the component has fewer than k articles
+      articles.push_back(landmark);
+
+      if (n_threads > 1) {
+        thread backward([&]() { search(landmark, false, to); });
+        search(landmark, true, from);
+        backward.join();
+      } else {
+        search(landmark, false, to);
+        search(landmark, true, from);
+      }
+      for (ArticleID a = 0; a < n; ++a) {
+        distances[(a * k + i) * 2] = to[a];
+        distances[(a * k + i) * 2 + 1] = from[a];
+        if (to[a] == unreachable || from[a] == unreachable) {
+          nearest[a] = outside;
+        } else if (i == 0) {
+          nearest[a] = to[a] + from[a];
+        } else if (nearest[a] != outside) {
+          nearest[a] = min(nearest[a], (uint32_t)to[a] + from[a]);
+        }
+      }
+    }
+
+    // fewer landmarks than requested: drop the unused columns.
+    if (articles.size() < k) {
+      size_t found = articles.size();
+      for (ArticleID a = 0; a < n; ++a) {
+        for (size_t i = 0; i < found * 2; ++i) {
+          distances[a * found * 2 + i] = distances[a * k * 2 + i];
+        }
+      }
+      distances.resize(n * found * 2);
+    }
+    vector<uint64_t>().swap(in_offsets);
+    vector<ArticleID>().swap(in_sources);
+  }
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "flat_array.hpp"
+
+using namespace std;
+
+/**
+ * Distances between a few landmark articles and all articles, for lower
+ * bounds on the distance between any two articles (ALT: A*, landmarks,
+ * triangle inequality), see landmark_builder.hpp and LandmarkSearch.
+ *
+ * For a landmark L, d(a, b) >= d(a, L) - d(b, L) and
+ * d(a, b) >= d(L, b) - d(L, a). The distances of an article to and from
+ * all landmarks are stored next to each other, so a bound costs one cache
+ * line.
+ */
+class Landmarks {
+public:
+  typedef uint32_t ArticleID;
+  typedef uint32_t Distance;
+
+  // stored distance of articles not reachable from/to the landmark.
+  static const uint8_t unreachable = 255;
+  // stored for distances >= far, which are not known exactly.
+  static const uint8_t far = 254;
+  // lower_bound() if there is certainly no path.
+  static const Distance no_path = -1;
+
+  // the landmark articles
+  FlatArray<ArticleID> articles;
+  // per article a and landmark i: distances[(a * size() + i) * 2] is the
+  // distance from a to the landmark, [... + 1] the one from the landmark to a.
+  FlatArray<uint8_t> distances;
+
+  Landmarks() { }
+  Landmarks(const Landmarks &other) = delete;
+  Landmarks& operator=(const Landmarks &other) = delete;
+
+  bool empty() const {
+    return articles.empty();
+  }
+
+  size_t size() const {
+    return articles.size();
+  }
+
+  void clear() {
+    vector<ArticleID>().swap(articles.vec());
+    vector<uint8_t>().swap(distances.vec());
+  }
+
+  uint8_t distance_to(ArticleID article, size_t landmark) const {
+    return distances[(article * size() + landmark) * 2];
+  }
+
+  uint8_t distance_from(ArticleID article, size_t landmark) const {
+    return distances[(article * size() + landmark) * 2 + 1];
+  }
+
+  /**
+   * A lower bound of the distance from 'from' to 'to' along outgoing links,
+   * no_path if some landmark shows that there is none. 0 if not computed.
+   */
+  Distance lower_bound(ArticleID from, ArticleID to) const {
+    const size_t k = size();
+    const uint8_t *a = &distances[from * k * 2];
+    const uint8_t *b = &distances[to * k * 2];
+    Distance bound = 0;
+    for (size_t i = 0; i < 2 * k; i += 2) {
+      // from -> L: if 'to' reaches L, 'from' can't reach 'to' unless it
+      // reaches L as well. The bound needs d(to, L) exactly.
+      if (b[i] < far) {
+        if (a[i] == unreachable)
+          return no_path;
+        if (a[i] > b[i])
+          bound = max(bound, (Distance)(a[i] - b[i]));
+      }
+      // L -> to: likewise, d(L, from) has to be exact.
+      if (a[i + 1] < far) {
+        if (b[i + 1] == unreachable)
+          return no_path;
+        if (b[i + 1] > a[i + 1])
+          bound = max(bound, (Distance)(b[i + 1] - a[i + 1]));
+      }
+    }
+    return bound;
+  }
+
+  size_t memory_usage() const {
+    return articles.size() * sizeof(ArticleID) + distances.size();
+  }
+};
@@ -0,0 +1,317 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "data.hpp"
+
+using namespace std;
+
+/**
+ * Collects page links during the import and packs them into the compressed
+ * sparse row arrays of WikiData (link_offsets, link_targets) in one go.
+ *
+ * Links are collected unsorted in shards, each covering a contiguous range of
+ * source articles. build() sorts and deduplicates the shards in parallel and
+ * copies them to their final position, which is the shard's range in
+ * link_targets. The incoming links (inlink_offsets, inlink_sources) are
+ * not collected, build() transposes the outgoing ones if asked to.
+ *
+ * Shards grow in blocks instead of doubling a vector, which keeps the peak
+ * memory usage during the import at ~8 bytes per link. Threads adding links
+ * in parallel use a Buffer each, which fills blocks per shard on its own
+ * and only locks a shard to hand over a full block.
+ */
+class LinkBuilder {
+public:
+  typedef WikiData::ArticleID ArticleID;
+  typedef WikiData::LinkOffset LinkOffset;
+
+private:
+  static const size_t block_size = 1 << 16;
+  // links a Buffer collects per shard before handing them over.
+  static const size_t buffer_block_size = 1 << 12;
+
+  struct Shard {
+    // source article in the upper 32 bits, the target in the lower 32
+    // bits, so sorting yields the final order.
+    vector<vector<uint64_t>> blocks;
+    // the sorted targets, after the first phase of build()
+    vector<ArticleID> packed;
+    ArticleID first_article = 0;
+    // protects 'blocks' while Buffers add theirs.
+    mutex add_blocks;
+
+    void add(uint64_t link) {
+      if (!blocks.size() || blocks.back().size() == block_size) {
+        blocks.push_back(vector<uint64_t>());
+        blocks.back().reserve(block_size);
+      }
+      blocks.back().push_back(link);
+    }
+
+    void add_block(vector<uint64_t> &&block) {
+      lock_guard<mutex> lock(add_blocks);
+      blocks.push_back(std::move(block));
+    }
+
+    size_t size() const {
+      size_t ret = 0;
+      for (const vector<uint64_t> &block: blocks) {
+        ret += block.size();
+      }
+      return ret;
+    }
+  };
+
+  vector<Shard> shards;
+  const size_t n_articles;
+  size_t articles_per_shard;
+
+public:
+  LinkBuilder(const LinkBuilder &other) = delete;
+  LinkBuilder& operator=(const LinkBuilder &other) = delete;
+
+  LinkBuilder(size_t n_articles, size_t n_shards)
+    : shards(max((size_t)1, n_shards)), n_articles(n_articles) {
+    articles_per_shard = n_articles / shards.size() + 1;
+  }
+
+
+  size_t shard_count() const {
+    return shards.size();
+  }
+
+
+  size_t shard_of(ArticleID from) const {
+    return from / articles_per_shard;
+  }
+
+
+  /**
+   * Adds a link from article 'from' to 'target'. Links to/from articles
+   * beyond the article count are ignored.
+   * This function is not threadsafe for multiple parallel calls with
+   * articles of the same shard.
+   */
+  void add_link_unsafe(ArticleID from, ArticleID target) {
+    if (from >= n_articles || target >= n_articles)
+      return;
+    shards[shard_of(from)].add(((uint64_t)from << 32) | target);
+  }
+
+
+  /**
+   * Collects the links of one thread in blocks per shard and adds full
+   * blocks to the builder. Any number of Buffers can add links in
+   * parallel; they don't mix with add_link_unsafe. Flushes on destruction,
+   * which has to happen before build().
+   */
+  class Buffer {
+    LinkBuilder &builder;
+    vector<vector<uint64_t>> pending;
+    size_t added = 0;
+
+  public:
+    Buffer(const Buffer &other) = delete;
+    Buffer& operator=(const Buffer &other) = delete;
+
+    Buffer(LinkBuilder &builder) : builder(builder), pending(builder.shards.size()) { }
+
+    ~Buffer() {
+      flush();
+    }
+
+    /**
+     * Adds a link from article 'from' to 'target', like add_link_unsafe.
+     */
+    void add_link(ArticleID from, ArticleID target) {
+      if (from >= builder.n_articles || target >= builder.n_articles)
+        return;
+      size_t shard = builder.shard_of(from);
+      vector<uint64_t> &block = pending[shard];
+      if (block.empty())
+        block.reserve(buffer_block_size);
+      block.push_back(((uint64_t)from << 32) | target);
+      added++;
+      if (block.size() == buffer_block_size) {
+        builder.shards[shard].add_block(std::move(block));
+        block.clear();
+      }
+    }
+
+    /**
+     * Hands all collected links to the builder.
+     */
+    void flush() {
+      for (size_t i = 0; i < pending.size(); ++i) {
+        if (!pending[i].empty())
+          builder.shards[i].add_block(std::move(pending[i]));
+        vector<uint64_t>().swap(pending[i]);
+      }
+    }
+
+    /**
+     * Number of links added to this buffer (duplicates included).
+     */
+    size_t size() const {
+      return added;
+    }
+  };
+
+
+  /**
+   * Replaces the link database of 'wikidata' with the collected links,
+   * using 'n_threads' threads, including the incoming links if 'incoming'.
+   * Empties the builder.
+   */
+  void build(WikiData &wikidata, size_t n_threads, bool incoming = false) {
+    size_t total = 0;
+    for (const Shard &shard: shards) {
+      total += shard.size();
+    }
+    if (total > (WikiData::LinkOffset)-1) {
+      throw std::runtime_error("Too many page links: " + to_string(total));
+    }
+
+    wikidata.components.clear();
+    wikidata.distance_index.clear();
+    wikidata.landmarks.clear();
+    wikidata.compressed_links.clear();
+    vector<ArticleID>().swap(wikidata.vertex_articles.vec());
+    vector<ArticleID>().swap(wikidata.article_vertices.vec());
+    vector<LinkOffset>().swap(wikidata.inlink_offsets.vec());
+    vector<ArticleID>().swap(wikidata.inlink_sources.vec());
+    vector<LinkOffset> &offsets = wikidata.link_offsets.vec();
+    offsets.assign(n_articles + 1, 0);
+
+    // sort and remove duplicates, count the links per article in offsets[a+1].
+    for_each_shard(n_threads, [&](Shard &shard) {
+      vector<uint64_t> links;
+      links.reserve(shard.size());
+      for (vector<uint64_t> &block: shard.blocks) {
+        links.insert(links.end(), block.begin(), block.end());
+        vector<uint64_t>().swap(block);
+      }
+      shard.blocks.clear();
+
+      sort(links.begin(), links.end());
+      links.erase(unique(links.begin(), links.end()), links.end());
+
+      shard.packed.resize(links.size());
+      for (size_t i = 0; i < links.size(); ++i) {
+        offsets[(links[i] >> 32) + 1]++;
+        shard.packed[i] = (ArticleID)links[i];
+      }
+      if (links.size())
+        shard.first_article = links[0] >> 32;
+    });
+
+    for (size_t i = 0; i < n_articles; ++i) {
+      offsets[i + 1] += offsets[i];
+    }
+
+    vector<ArticleID> &targets = wikidata.link_targets.vec();
+    targets.clear();
+    targets.shrink_to_fit();
+    targets.resize(offsets[n_articles]);
+
+    // shards cover consecutive article ranges, so each shard's links are
+    // a contiguous part of link_targets.
+    for_each_shard(n_threads, [&](Shard &shard) {
+      copy(shard.packed.begin(), shard.packed.end(),
+           targets.begin() + offsets[shard.first_article]);
+      vector<ArticleID>().swap(shard.packed);
+    });
+
+    if (incoming)
+      build_incoming(wikidata, n_threads);
+  }
+
+private:
+  // articles handed out to the threads at once by build_incoming.
+  const size_t chunk_size = 1 << 14;
+
+  template<typename F>
+  void parallel_for(size_t n_threads, F f) {
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+      size_t begin;
+      while ((begin = next.fetch_add(chunk_size)) < n_articles) {
+        for (size_t a = begin; a < min(begin + chunk_size, n_articles); ++a) {
+          f(a);
+        }
+      }
+    };
+    vector<thread> threads;
+    for (size_t i = 1; i < n_threads; ++i) {
+      threads.push_back(thread(worker));
+    }
+    worker();
+    for (thread &t: threads) {
+      t.join();
+    }
+  }
+
+  /**
+   * Transposes the outgoing links of 'wikidata' into its incoming links:
+   * counts the incoming links per article, scatters the sources to their
+   * lists with atomic cursors and sorts each list.
+   */
+  void build_incoming(WikiData &wikidata, size_t n_threads) {
+    const vector<LinkOffset> &out_offsets = wikidata.link_offsets.vec();
+    const vector<ArticleID> &targets = wikidata.link_targets.vec();
+    vector<atomic<LinkOffset>> counts(n_articles);
+    parallel_for(n_threads, [&](ArticleID a) {
+      counts[a].store(0, memory_order_relaxed);
+    });
+    parallel_for(n_threads, [&](ArticleID a) {
+      for (LinkOffset i = out_offsets[a]; i < out_offsets[a + 1]; ++i) {
+        counts[targets[i]].fetch_add(1, memory_order_relaxed);
+      }
+    });
+
+    vector<LinkOffset> &offsets = wikidata.inlink_offsets.vec();
+    offsets.resize(n_articles + 1);
+    offsets[0] = 0;
+    for (size_t a = 0; a < n_articles; ++a) {
+      offsets[a + 1] = offsets[a] + counts[a].load(memory_order_relaxed);
+      // the cursor where the next source of 'a' goes
+      counts[a].store(offsets[a], memory_order_relaxed);
+    }
+
+    vector<ArticleID> &sources = wikidata.inlink_sources.vec();
+    sources.resize(offsets[n_articles]);
+    parallel_for(n_threads, [&](ArticleID a) {
+      for (LinkOffset i = out_offsets[a]; i < out_offsets[a + 1]; ++i) {
+        sources[counts[targets[i]].fetch_add(1, memory_order_relaxed)] = a;
+      }
+    });
+    parallel_for(n_threads, [&](ArticleID a) {
+      sort(sources.begin() + offsets[a], sources.begin() + offsets[a + 1]);
+    });
+  }
+
+  template<typename F>
+  void for_each_shard(size_t n_threads, F f) {
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+      size_t i;
+      while ((i = next++) < shards.size()) {
+        f(shards[i]);
+      }
+    };
+    vector<thread> threads;
+    for (size_t i = 1; i < n_threads; ++i) {
+      threads.push_back(thread(worker));
+    }
+    worker();
+    for (thread &t: threads) {
+      t.join();
+    }
+  }
+};
@@ -0,0 +1,242 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <cstdint>
+
+#include "data.hpp"
+
+using namespace std;
+
+/**
+ * Renumbers the articles of the link database (vertex ids, see
+ * WikiData::vertex_articles) so that linked articles get nearby ids. In
+ * resource order, the neighbours of an article are spread over the whole
+ * database, and a search touches a different cache line of its per-article
+ * arrays for nearly every link it follows. Article ids seen by users don't
+ * change.
+ *
+ * DEGREE puts the articles with the most links first: the hubs most
+ * searches pass through share a few cache lines. BFS numbers the articles
+ * in the order a breadth-first search along the links in both directions
+ * reaches them, starting at the article with the most links (Cuthill-McKee
+ * without sorting each level by degree), so articles end up close to their
+ * neighbours. Articles it doesn't reach are searched from in the order of
+ * their degree.
+ *
+ * Runs on the uncompressed links, before the components and the indexes are
+ * built; they are cleared, as they are indexed by vertex. Holds a second
+ * copy of the links while permuting them, and for BFS without the incoming
+ * links, while ordering (the links transposed).
+ */
+class LinkOrderBuilder {
+public:
+  typedef WikiData::ArticleID ArticleID;
+  typedef WikiData::LinkOffset LinkOffset;
+
+  enum Method { KEEP, DEGREE, BFS };
+
+  /**
+   * The method called 'name' ("degree" or "bfs").
+   * Throws std::runtime_error for other names.
+   */
+  static Method parse_method(const string &name) {
+    if (name == "degree")
+      return DEGREE;
+    if (name == "bfs")
+      return BFS;
+    throw std::runtime_error("Unknown link order: " + name);
+  }
+
+private:
+  WikiData &wikidata;
+  const size_t n;
+  const size_t n_threads;
+
+  // articles handed out to the threads at once
+  const size_t chunk_size = 1 << 14;
+
+  template<typename F>
+  void parallel_for(F f) {
+    atomic<size_t> next(0);
+    auto worker = [&]() {
+      size_t begin;
+      while ((begin = next.fetch_add(chunk_size)) < n) {
+        for (size_t a = begin; a < min(begin + chunk_size, n); ++a) {
+          f(a);
+        }
+      }
+    };
+    vector<thread> threads;
+    for (size_t i = 1; i < n_threads; ++i) {
+      threads.push_back(thread(worker));
+    }
+    worker();
+    for (thread &t: threads) {
+      t.join();
+    }
+  }
+
+  WikiData::LinkRange outlinks_of(ArticleID a) const {
+    const ArticleID *base = wikidata.link_targets.data();
+    WikiData::LinkRange ret = { base + wikidata.link_offsets[a], base + wikidata.link_offsets[a + 1] };
+    return ret;
+  }
+
+  // outgoing plus incoming links per vertex
+  vector<uint32_t> degrees() const {
+    vector<uint32_t> degree(n);
+    for (ArticleID a = 0; a < n; ++a) {
+      degree[a] += wikidata.outlink_count(a);
+      if (wikidata.has_incoming_links()) {
+        degree[a] += wikidata.inlinks_of(a).size();
+      } else {
+        for (ArticleID target: outlinks_of(a)) {
+          degree[target]++;
+        }
+      }
+    }
+    return degree;
+  }
+
+  // the vertices by decreasing degree, ties in the current order.
+  vector<ArticleID> degree_order(const vector<uint32_t> &degree) const {
+    vector<ArticleID> order(n);
+    for (ArticleID a = 0; a < n; ++a) {
+      order[a] = a;
+    }
+    stable_sort(order.begin(), order.end(), [&](ArticleID a, ArticleID b) {
+      return degree[a] > degree[b];
+    });
+    return order;
+  }
+
+  // the incoming links as offsets and sources, like WikiData's, for the
+  // breadth-first search when they weren't read.
+  void transpose(vector<LinkOffset> &offsets, vector<ArticleID> &sources) const {
+    offsets.assign(n + 1, 0);
+    for (ArticleID a = 0; a < n; ++a) {
+      for (ArticleID target: outlinks_of(a)) {
+        offsets[target + 1]++;
+      }
+    }
+    for (ArticleID a = 0; a < n; ++a) {
+      offsets[a + 1] += offsets[a];
+    }
+    // offsets[t] is the next free slot of t, and ends up at the start of t + 1.
+    sources.resize(offsets[n]);
+    for (ArticleID a = 0; a < n; ++a) {
+      for (ArticleID target: outlinks_of(a)) {
+        sources[offsets[target]++] = a;
+      }
+    }
+    for (ArticleID a = n; a > 0; --a) {
+      offsets[a] = offsets[a - 1];
+    }
+    offsets[0] = 0;
+  }
+
+  vector<ArticleID> bfs_order(const vector<uint32_t> &degree) const {
+    vector<LinkOffset> in_offsets;
+    vector<ArticleID> in_sources;
+    if (!wikidata.has_incoming_links())
+      transpose(in_offsets, in_sources);
+    auto inlinks_of = [&](ArticleID a) -> WikiData::LinkRange {
+      if (wikidata.has_incoming_links())
+        return wikidata.inlinks_of(a);
+      WikiData::LinkRange ret = { in_sources.data() + in_offsets[a], in_sources.data() + in_offsets[a + 1] };
+      return ret;
+    };
+
+    vector<ArticleID> order;
+    order.reserve(n);
+    vector<bool> reached(n);
+    auto reach = [&](ArticleID a) {
+      if (reached[a])
+        return;
+      reached[a] = true;
+      order.push_back(a);
+    };
+    for (ArticleID root: degree_order(degree)) {
+      if (reached[root])
+        continue;
+      reach(root);
+      // 'order' is the queue.
+      for (size_t head = order.size() - 1; head < order.size(); ++head) {
+        ArticleID current = order[head];
+        for (ArticleID next: outlinks_of(current)) {
+          reach(next);
+        }
+        for (ArticleID next: inlinks_of(current)) {
+          reach(next);
+        }
+      }
+    }
+    return order;
+  }
+
+  // renumbers the lists of 'offsets' / 'values': list v of the result is
+  // list order[v], with each value a replaced by rank[a] (and sorted again).
+  void permute(FlatArray<LinkOffset> &offsets, FlatArray<ArticleID> &values,
+               const vector<ArticleID> &order, const vector<ArticleID> &rank) {
+    vector<LinkOffset> new_offsets(n + 1);
+    for (ArticleID v = 0; v < n; ++v) {
+      new_offsets[v + 1] = new_offsets[v] + offsets[order[v] + 1] - offsets[order[v]];
+    }
+    vector<ArticleID> new_values(values.size());
+    parallel_for([&](ArticleID v) {
+      ArticleID *list = new_values.data() + new_offsets[v];
+      for (LinkOffset i = offsets[order[v]]; i < offsets[order[v] + 1]; ++i) {
+        *list++ = rank[values[i]];
+      }
+      sort(new_values.begin() + new_offsets[v], new_values.begin() + new_offsets[v + 1]);
+    });
+    offsets.vec().swap(new_offsets);
+    values.vec().swap(new_values);
+  }
+
+public:
+  LinkOrderBuilder(WikiData &wikidata, size_t n_threads)
+    : wikidata(wikidata), n(wikidata.linkdb_size()), n_threads(max((size_t)1, n_threads)) { }
+
+  /**
+   * Renumbers the link database of 'wikidata' by 'method'.
+   */
+  void build(Method method) {
+    if (method == KEEP || !n)
+      return;
+    if (!wikidata.compressed_links.empty())
+      throw std::runtime_error("Reordering the links needs the uncompressed links.");
+
+    vector<uint32_t> degree = degrees();
+    vector<ArticleID> order = method == DEGREE ? degree_order(degree) : bfs_order(degree);
+    vector<uint32_t>().swap(degree);
+    vector<ArticleID> rank(n);
+    for (ArticleID v = 0; v < n; ++v) {
+      rank[order[v]] = v;
+    }
+
+    wikidata.components.clear();
+    wikidata.distance_index.clear();
+    wikidata.landmarks.clear();
+    permute(wikidata.link_offsets, wikidata.link_targets, order, rank);
+    if (wikidata.has_incoming_links())
+      permute(wikidata.inlink_offsets, wikidata.inlink_sources, order, rank);
+
+    // vertex v is the old vertex order[v], which may have been reordered
+    // before.
+    vector<ArticleID> articles(n);
+    for (ArticleID v = 0; v < n; ++v) {
+      articles[v] = wikidata.article_of(order[v]);
+    }
+    vector<ArticleID> &vertices = rank;
+    for (ArticleID v = 0; v < n; ++v) {
+      vertices[articles[v]] = v;
+    }
+    wikidata.vertex_articles.vec().swap(articles);
+    wikidata.article_vertices.vec().swap(vertices);
+  }
+};
@@ -0,0 +1,260 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Bounded multi-producer/multi-consumer queue with the same blocking and
+ * termination semantics as ProducerConsumerQueue, implemented as a ring buffer
+ * with a sequence number per slot (D. Vyukov's bounded MPMC queue).
+ *
+ * Producers and consumers only synchronize on the enqueue/dequeue position
+ * (one CAS per push, pop or batch) and on the slots they touch. A thread that
+ * cannot proceed spins for a while and then parks on a condition variable;
+ * the mutex is only taken when somebody is actually parked.
+ *
+ * T must be default constructible and movable.
+ */
+template<typename T>
+class MPMCRingBuffer {
+  struct Slot {
+    // pos: free for the push at position 'pos'
+    // pos + 1: filled by the push at position 'pos'
+    atomic<size_t> sequence;
+    T data;
+  };
+
+  static const size_t cacheline = 64;
+  // spin iterations before a waiting thread is parked
+  static const unsigned spin_count = 256;
+
+  vector<Slot> slots;
+  const size_t mask;
+
+  char pad0[cacheline];
+  atomic<size_t> enqueue_pos;
+  char pad1[cacheline - sizeof(atomic<size_t>)];
+  atomic<size_t> dequeue_pos;
+  char pad2[cacheline - sizeof(atomic<size_t>)];
+
+  atomic<bool> terminate_consumer;
+
+  // parking
+  mutex mutex_;
+  condition_variable not_empty;
+  condition_variable not_full;
+  atomic<unsigned> waiting_consumers;
+  atomic<unsigned> waiting_producers;
+
+  static size_t round_up_pow2(size_t n) {
+    size_t ret = 2;
+    while (ret < n)
+      ret <<= 1;
+    return ret;
+  }
+
+  static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  // Waits until 'ready' returns true. 'waiting' counts parked threads of this
+  // kind, 'cond' is notified by the other side.
+  template<typename Pred>
+  void wait(Pred ready, atomic<unsigned> &waiting, condition_variable &cond) {
+    for (unsigned i = 0; i < spin_count; ++i) {
+      if (ready())
+        return;
+      if (i < spin_count / 2) {
+        cpu_relax();
+      } else {
+        this_thread::yield();
+      }
+    }
+    unique_lock<mutex> lock(mutex_);
+    waiting.fetch_add(1);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (!ready()) {
+      cond.wait(lock);
+    }
+    waiting.fetch_sub(1);
+  }
+
+  void wake(atomic<unsigned> &waiting, condition_variable &cond) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (waiting.load() == 0)
+      return;
+    // the waiter re-checks its condition while holding the mutex.
+    { unique_lock<mutex> lock(mutex_); }
+    cond.notify_all();
+  }
+
+  // claims up to 'n' consecutive free slots, returns the number of slots
+  // claimed (starting at 'pos').
+  size_t claim_push(size_t n, size_t &pos) {
+    pos = enqueue_pos.load(memory_order_relaxed);
+    while (true) {
+      size_t k = 0;
+      while (k < n && slots[(pos + k) & mask].sequence.load(memory_order_acquire) == pos + k)
+        k++;
+      if (k == 0) {
+        size_t seq = slots[pos & mask].sequence.load(memory_order_acquire);
+        if ((ptrdiff_t)(seq - pos) < 0)
+          return 0; // full
+        pos = enqueue_pos.load(memory_order_relaxed);
+        continue;
+      }
+      if (enqueue_pos.compare_exchange_weak(pos, pos + k, memory_order_relaxed))
+        return k;
+    }
+  }
+
+  // claims up to 'n' consecutive filled slots.
+  size_t claim_pop(size_t n, size_t &pos) {
+    pos = dequeue_pos.load(memory_order_relaxed);
+    while (true) {
+      size_t k = 0;
+      while (k < n && slots[(pos + k) & mask].sequence.load(memory_order_acquire) == pos + k + 1)
+        k++;
+      if (k == 0) {
+        size_t seq = slots[pos & mask].sequence.load(memory_order_acquire);
+        if ((ptrdiff_t)(seq - (pos + 1)) < 0)
+          return 0; // empty
+        pos = dequeue_pos.load(memory_order_relaxed);
+        continue;
+      }
+      if (dequeue_pos.compare_exchange_weak(pos, pos + k, memory_order_relaxed))
+        return k;
+    }
+  }
+
+  bool is_full() const {
+    size_t pos = enqueue_pos.load(memory_order_relaxed);
+    return (ptrdiff_t)(slots[pos & mask].sequence.load(memory_order_acquire) - pos) < 0;
+  }
+
+  bool is_empty() const {
+    size_t pos = dequeue_pos.load(memory_order_relaxed);
+    return (ptrdiff_t)(slots[pos & mask].sequence.load(memory_order_acquire) - (pos + 1)) < 0;
+  }
+
+public:
+  MPMCRingBuffer& operator=(const MPMCRingBuffer &) = delete;
+  MPMCRingBuffer(const MPMCRingBuffer &other) = delete;
+
+  /**
+   * The capacity is rounded up to the next power of two.
+   */
+  MPMCRingBuffer(size_t capacity = 4096)
+    : slots(round_up_pow2(capacity)), mask(slots.size() - 1),
+      enqueue_pos(0), dequeue_pos(0), terminate_consumer(false),
+      waiting_consumers(0), waiting_producers(0) {
+    for (size_t i = 0; i < slots.size(); ++i) {
+      slots[i].sequence.store(i, memory_order_relaxed);
+    }
+  }
+
+
+  void terminate_consumers() {
+    terminate_consumer.store(true);
+    { unique_lock<mutex> lock(mutex_); }
+    not_empty.notify_all();
+  }
+
+  // approximate number of queued items.
+  size_t size() const {
+    size_t enq = enqueue_pos.load(memory_order_relaxed);
+    size_t deq = dequeue_pos.load(memory_order_relaxed);
+    return enq > deq ? enq - deq : 0;
+  }
+
+  size_t capacity() const {
+    return slots.size();
+  }
+
+  void push(const T& obj) {
+    T copy(obj);
+    push(std::move(copy));
+  }
+
+  void push(T&& obj) {
+    push_batch(&obj, 1);
+  }
+
+  /**
+   * Moves 'n' items, starting at 'items', to the queue, blocking while it
+   * is full. The items are pushed in order, but may interleave with
+   * items from other producers.
+   */
+  void push_batch(T *items, size_t n) {
+    while (n) {
+      size_t pos;
+      size_t k = claim_push(n, pos);
+      if (!k) {
+        wait([this]{ return !this->is_full(); }, waiting_producers, not_full);
+        continue;
+      }
+      for (size_t i = 0; i < k; ++i) {
+        Slot &slot = slots[(pos + i) & mask];
+        slot.data = std::move(items[i]);
+        slot.sequence.store(pos + i + 1, memory_order_release);
+      }
+      items += k;
+      n -= k;
+      wake(waiting_consumers, not_empty);
+    }
+  }
+
+  void push_batch(vector<T> &items) {
+    push_batch(items.data(), items.size());
+    items.clear();
+  }
+
+  // returns false if no item could be extracted and the producer has requested shutdown.
+  // returns true and writes the next item in 'out' otherwise.
+  bool pop(T &out) {
+    return pop_batch(&out, 1) == 1;
+  }
+
+  /**
+   * Moves up to 'max' items to 'out', blocking until at least one item is
+   * available. Returns 0 if the queue is empty and the producer has
+   * requested shutdown.
+   */
+  size_t pop_batch(T *out, size_t max) {
+    while (true) {
+      size_t pos;
+      size_t k = claim_pop(max, pos);
+      if (k) {
+        for (size_t i = 0; i < k; ++i) {
+          Slot &slot = slots[(pos + i) & mask];
+          out[i] = std::move(slot.data);
+          slot.sequence.store(pos + i + mask + 1, memory_order_release);
+        }
+        wake(waiting_producers, not_full);
+        return k;
+      }
+      if (terminate_consumer.load() && is_empty())
+        return 0;
+      wait([this]{ return !this->is_empty() || this->terminate_consumer.load(); },
+           waiting_consumers, not_empty);
+    }
+  }
+
+  /**
+   * Replaces the content of 'out' with up to 'max' items.
+   */
+  size_t pop_batch(vector<T> &out, size_t max) {
+    out.resize(max);
+    size_t n = pop_batch(out.data(), max);
+    out.resize(n);
+    return n;
+  }
+};
@@ -0,0 +1,166 @@
+#pragma once
+#include <string>
+#include <array>
+#include <cstring>
+#include <boost/utility/string_ref.hpp>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/**
+ * Splits the lines of the DBpedia N-Triples dumps into their terms, as
+ * string_refs into the line where possible.
+ *
+ * split() cuts at every space, like boost::split (for the page links, whose
+ * terms are all IRIs). tokenize() handles quoted literals the way
+ * escaped_list_separator_includeinvalid does for the labels: spaces inside
+ * quotes don't separate, quotes are removed, "\\n", "\\\"", "\\ " and "\\\\"
+ * are unescaped and any other escape (like "\\u00F6") is kept verbatim.
+ * Terms containing quotes or escapes are assembled in a buffer per term,
+ * which is reused for the following lines, so tokenizing doesn't allocate
+ * once the buffers are large enough.
+ *
+ * The next space, quote or backslash is found 16 bytes at a time with SSE2
+ * (always available on x86-64), the spaces of split() with memchr.
+ */
+class NTriplesTokenizer {
+public:
+  typedef boost::string_ref string_ref;
+
+  // the most terms returned, further ones are only counted by split().
+  static const size_t max_terms = 4;
+
+private:
+  array<string_ref, max_terms> terms;
+  array<string, max_terms> buffers;
+
+  // the first space, quote or backslash in [p, end), or end.
+  static const char *find_special(const char *p, const char *end) {
+#if defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i escape = _mm_set1_epi8('\\');
+    for (; p + 16 <= end; p += 16) {
+      __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+      __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, space),
+                                                _mm_cmpeq_epi8(bytes, quote)),
+                                   _mm_cmpeq_epi8(bytes, escape));
+      int mask = _mm_movemask_epi8(found);
+      if (mask)
+        return p + __builtin_ctz(mask);
+    }
+#endif
+    for (; p != end; ++p) {
+      if (*p == ' ' || *p == '"' || *p == '\\')
+        break;
+    }
+    return p;
+  }
+
+public:
+  /**
+   * Splits 'line' at spaces. Returns the number of terms (one more than
+   * there are spaces); only the first max_terms are kept.
+   */
+  size_t split(const string_ref &line) {
+    const char *p = line.data(), *end = line.data() + line.size();
+    size_t count = 0;
+    while (true) {
+      const char *space = (const char*)memchr(p, ' ', end - p);
+      const char *term_end = space ? space : end;
+      if (count < max_terms)
+        terms[count] = string_ref(p, term_end - p);
+      count++;
+      if (!space)
+        return count;
+      p = space + 1;
+    }
+  }
+
+  /**
+   * Reads up to 'n' (at most max_terms) terms of 'line', with quotes and
+   * escapes, see above. Returns the number of terms read, or -1 if the line
+   * ends with a backslash. An empty line has no terms, a line ending with
+   * a separating space has an empty last term.
+   */
+  size_t tokenize(const string_ref &line, size_t n = max_terms) {
+    const char *p = line.data(), *end = line.data() + line.size();
+    if (n > max_terms)
+      n = max_terms;
+    size_t count = 0;
+    if (p == end)
+      return 0;
+    while (count < n) {
+      const char *start = p;
+      // set once the term needs the buffer
+      string *buffer = nullptr;
+      bool in_quote = false;
+      bool separated = false;
+      while (true) {
+        const char *special = find_special(p, end);
+        if (buffer)
+          buffer->append(p, special);
+        if (special == end) {
+          p = end;
+          break;
+        }
+        char c = *special;
+        if (c == ' ' && !in_quote) {
+          p = special + 1;
+          separated = true;
+          break;
+        }
+        if (!buffer) {
+          buffer = &buffers[count];
+          buffer->assign(start, special);
+        }
+        if (c == ' ') {
+          buffer->push_back(' ');
+          p = special + 1;
+        } else if (c == '"') {
+          in_quote = !in_quote;
+          p = special + 1;
+        } else {
+          if (special + 1 == end)
+            return -1;
+          char next = special[1];
+          if (next == 'n') {
+            buffer->push_back('\n');
+          } else if (next == '"' || next == ' ' || next == '\\') {
+            buffer->push_back(next);
+          } else {
+            buffer->push_back('\\');
+            buffer->push_back(next);
+          }
+          p = special + 2;
+        }
+        if (p == end)
+          break;
+      }
+      if (buffer) {
+        terms[count] = string_ref(*buffer);
+      } else {
+        terms[count] = string_ref(start, (separated ? p - 1 : p) - start);
+      }
+      count++;
+      if (p == end) {
+        // a separator at the end is followed by an empty term.
+        if (separated && count < n)
+          terms[count++] = string_ref();
+        break;
+      }
+    }
+    return count;
+  }
+
+  /**
+   * Term 'i' of the last line, valid until the next call or until the line
+   * is modified.
+   */
+  const string_ref& term(size_t i) const {
+    return terms[i];
+  }
+};
@@ -0,0 +1,334 @@
+#pragma once
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+
+#include "data.hpp"
+#include "graph_bfs.hpp"
+
+using namespace std;
+
+/**
+ * Level-synchronous breadth-first search on several threads, switching
+ * between top-down and bottom-up steps (direction-optimizing BFS, Beamer et
+ * al. 2012).
+ *
+ * A top-down step expands the frontier along its links, the threads claim
+ * newly reached articles in a shared visited bitmap. Once the frontier's
+ * links outnumber the links of the unvisited articles by a factor of
+ * 'alpha', a bottom-up step is cheaper: every unvisited article looks for a
+ * parent in the frontier (a bitmap as well) and stops at the first one
+ * found. When the frontier shrinks below V / 'beta' articles, the search
+ * switches back. Bottom-up steps follow links backwards, so they need the
+ * incoming links (--inlinks), for undirected searches as well.
+ *
+ * The per-article arrays are allocated once and reused by all searches,
+ * an instance runs one search at a time. They aren't cleared for a path
+ * search: parents and distances are only read for visited articles, and
+ * only the words of the visited bitmap the last search set are reset. A
+ * short path query costs time proportional to the articles it visits.
+ */
+class ParallelBFS {
+public:
+  typedef WikiData::ArticleID ArticleID;
+  typedef uint32_t Distance;
+  typedef GraphBFS::Path Path;
+  typedef GraphBFS::ArticleSet ArticleSet;
+
+  const Distance UNREACHABLE = -1;
+
+  // switching thresholds, see above.
+  const size_t alpha = 14;
+  const size_t beta = 24;
+  // top-down steps only if false
+  bool direction_optimizing = true;
+
+  // statistics of the last search
+  struct Stats {
+    size_t visited = 0;
+    size_t top_down_levels = 0;
+    size_t bottom_up_levels = 0;
+  };
+
+private:
+  const WikiData &wikidata;
+  const size_t n_threads;
+  const size_t n;
+
+  // frontier and work items handed out to the threads at once
+  const size_t chunk_size = 1024;
+
+  vector<atomic<uint64_t>> visited;
+  vector<atomic<uint64_t>> frontier_bitmap;
+  vector<ArticleID> parent;
+  vector<Distance> distance;
+  vector<ArticleID> frontier;
+  // next frontier and its number of links, per thread
+  vector<vector<ArticleID>> next_frontier;
+  vector<size_t> next_links;
+  // decoded links per thread, if compressed
+  vector<vector<ArticleID>> buffers;
+  Stats stats;
+  // articles visited by the last search, whose words of 'visited' the next
+  // one clears. Once there are more of them than words, all words are
+  // cleared instead ('touched_all').
+  vector<ArticleID> touched;
+  bool touched_all = true;
+  // leading words of 'visited' holding the last search's excluded articles
+  size_t touched_exclude_words = 0;
+
+  static bool test_bit(const vector<atomic<uint64_t>> &bitmap, ArticleID article) {
+    return bitmap[article / 64].load(memory_order_relaxed) & ((uint64_t)1 << (article % 64));
+  }
+
+  // returns whether the bit was newly set.
+  static bool set_bit(vector<atomic<uint64_t>> &bitmap, ArticleID article) {
+    uint64_t bit = (uint64_t)1 << (article % 64);
+    return !(bitmap[article / 64].fetch_or(bit, memory_order_relaxed) & bit);
+  }
+
+  /**
+   * Calls f(begin, end, thread) for chunks of [0, count) on up to n_threads
+   * threads. Small ranges are processed on the calling thread only.
+   */
+  template<typename F>
+  void parallel_for(size_t count, F f) {
+    size_t threads = min(n_threads, (count + chunk_size - 1) / chunk_size);
+    if (threads <= 1) {
+      f(0, count, 0);
+      return;
+    }
+    atomic<size_t> next(0);
+    auto worker = [&](size_t thread) {
+      size_t begin;
+      while ((begin = next.fetch_add(chunk_size)) < count) {
+        f(begin, min(begin + chunk_size, count), thread);
+      }
+    };
+    vector<std::thread> workers;
+    for (size_t i = 1; i < threads; ++i) {
+      workers.push_back(std::thread(worker, i));
+    }
+    worker(0);
+    for (std::thread &t: workers) {
+      t.join();
+    }
+  }
+
+  // links a top-down step follows from 'article'
+  size_t link_count(ArticleID article, bool undirected) const {
+    return wikidata.outlink_count(article) +
+      (undirected ? wikidata.inlinks_of(article).size() : 0);
+  }
+
+  void visit(ArticleID article, ArticleID from, Distance level, size_t thread, bool undirected) {
+    parent[article] = from;
+    distance[article] = level;
+    next_frontier[thread].push_back(article);
+    next_links[thread] += link_count(article, undirected);
+  }
+
+  void clear_visited() {
+    if (touched_all) {
+      parallel_for(visited.size(), [&](size_t begin, size_t end, size_t) {
+        for (size_t w = begin; w < end; ++w) {
+          visited[w].store(0, memory_order_relaxed);
+        }
+      });
+    } else {
+      for (ArticleID article: touched) {
+        visited[article / 64].store(0, memory_order_relaxed);
+      }
+      for (size_t w = 0; w < touched_exclude_words; ++w) {
+        visited[w].store(0, memory_order_relaxed);
+      }
+    }
+    touched.clear();
+    touched_all = false;
+  }
+
+  void add_touched(const vector<ArticleID> &articles) {
+    if (touched_all)
+      return;
+    if (touched.size() + articles.size() > visited.size()) {
+      touched.clear();
+      touched_all = true;
+      return;
+    }
+    touched.insert(touched.end(), articles.begin(), articles.end());
+  }
+
+  void top_down_step(Distance level, bool undirected) {
+    parallel_for(frontier.size(), [&](size_t begin, size_t end, size_t thread) {
+      for (size_t i = begin; i < end; ++i) {
+        ArticleID current = frontier[i];
+        for (const WikiData::LinkRange& links: wikidata.links_of(current, undirected, buffers[thread])) {
+          for (ArticleID article: links) {
+            if (test_bit(visited, article) || !set_bit(visited, article))
+              continue;
+            visit(article, current, level, thread, undirected);
+          }
+        }
+      }
+    });
+  }
+
+  void bottom_up_step(Distance level, bool undirected) {
+    for (atomic<uint64_t> &word: frontier_bitmap) {
+      word.store(0, memory_order_relaxed);
+    }
+    parallel_for(frontier.size(), [&](size_t begin, size_t end, size_t) {
+      for (size_t i = begin; i < end; ++i) {
+        set_bit(frontier_bitmap, frontier[i]);
+      }
+    });
+    // chunks of whole bitmap words, so each word of 'visited' is only
+    // changed by one thread.
+    parallel_for(visited.size(), [&](size_t begin, size_t end, size_t thread) {
+      for (size_t w = begin; w < end; ++w) {
+        uint64_t unvisited = ~visited[w].load(memory_order_relaxed);
+        uint64_t found = 0;
+        while (unvisited) {
+          ArticleID article = w * 64 + __builtin_ctzll(unvisited);
+          unvisited &= unvisited - 1;
+          if (article >= n)
+            break;
+          // a parent among the articles linking to 'article'
+          WikiData::LinkRanges ranges = {{ wikidata.inlinks_of(article),
+            undirected ? wikidata.outlinks_of(article, buffers[thread]) : WikiData::LinkRange() }};
+          bool parent_found = false;
+          for (size_t r = 0; r < ranges.size() && !parent_found; ++r) {
+            for (ArticleID from: ranges[r]) {
+              if (test_bit(frontier_bitmap, from)) {
+                found |= (uint64_t)1 << (article % 64);
+                visit(article, from, level, thread, undirected);
+                parent_found = true;
+                break;
+              }
+            }
+          }
+        }
+        if (found)
+          visited[w].fetch_or(found, memory_order_relaxed);
+      }
+    });
+  }
+
+  /**
+   * Searches from 'from' until all reachable articles are visited, or
+   * until the level 'to' was reached on is complete (if not -1).
+   */
+  void search(ArticleID from, ArticleID to, const ArticleSet &exclude_set, bool undirected) {
+    wikidata.check_articleid_linkdb(from);
+    if (to != (ArticleID)-1)
+      wikidata.check_articleid_linkdb(to);
+
+    // excluded articles count as visited.
+    clear_visited();
+    touched_exclude_words = min(exclude_set.word_count(), visited.size());
+    parallel_for(touched_exclude_words, [&](size_t begin, size_t end, size_t) {
+      for (size_t w = begin; w < end; ++w) {
+        visited[w].store(exclude_set.word(w), memory_order_relaxed);
+      }
+    });
+    stats = Stats();
+
+    // without the incoming links, an undirected search is a directed one
+    // along the outgoing links, which bottom-up steps can't follow backwards.
+    const bool can_bottom_up = direction_optimizing && wikidata.has_incoming_links();
+    // links of the unvisited articles, for the switching heuristic
+    size_t unexplored_links = wikidata.link_count() +
+      (undirected ? wikidata.inlink_sources.size() : 0);
+    size_t frontier_links = link_count(from, undirected);
+    bool bottom_up = false;
+
+    set_bit(visited, from);
+    parent[from] = from;
+    distance[from] = 0;
+    frontier.assign(1, from);
+    add_touched(frontier);
+    for (Distance level = 1; frontier.size(); ++level) {
+      if (to != (ArticleID)-1 && test_bit(visited, to))
+        break;
+      stats.visited += frontier.size();
+      unexplored_links -= min(unexplored_links, frontier_links);
+      if (!bottom_up) {
+        bottom_up = can_bottom_up && frontier_links > unexplored_links / alpha;
+      } else {
+        bottom_up = frontier.size() >= n / beta;
+      }
+
+      for (size_t i = 0; i < n_threads; ++i) {
+        next_frontier[i].clear();
+        next_links[i] = 0;
+      }
+      if (bottom_up) {
+        bottom_up_step(level, undirected);
+        stats.bottom_up_levels++;
+      } else {
+        top_down_step(level, undirected);
+        stats.top_down_levels++;
+      }
+
+      frontier.clear();
+      frontier_links = 0;
+      for (size_t i = 0; i < n_threads; ++i) {
+        frontier.insert(frontier.end(), next_frontier[i].begin(), next_frontier[i].end());
+        frontier_links += next_links[i];
+      }
+      add_touched(frontier);
+    }
+  }
+
+public:
+  ParallelBFS(const WikiData &wikidata, size_t n_threads)
+    : wikidata(wikidata), n_threads(max((size_t)1, n_threads)),
+      n(wikidata.linkdb_size()), visited((n + 63) / 64), frontier_bitmap((n + 63) / 64),
+      parent(n), distance(n), next_frontier(this->n_threads), next_links(this->n_threads),
+      buffers(this->n_threads) {
+  }
+
+  ParallelBFS(const ParallelBFS &other) = delete;
+  ParallelBFS& operator=(const ParallelBFS &other) = delete;
+
+  /**
+   * The number of links on a shortest path from 'from' to every article,
+   * UNREACHABLE for articles not reachable without passing through
+   * 'exclude_set'.
+   */
+  const vector<Distance>& distances(ArticleID from, const ArticleSet &exclude_set,
+                                    bool undirected=false) {
+    parallel_for(n, [&](size_t begin, size_t end, size_t) {
+      fill(distance.begin() + begin, distance.begin() + end, UNREACHABLE);
+    });
+    search(from, -1, exclude_set, undirected);
+    return distance;
+  }
+
+  /**
+   * A shortest path from 'from' to 'to', an empty path if none exists.
+   */
+  Path path(ArticleID from, ArticleID to, const ArticleSet &exclude_set,
+            bool undirected=false) {
+    if (exclude_set.count(to)) {
+      throw std::runtime_error("Error: 'to' node is contained in the excluded nodes.");
+    }
+    search(from, to, exclude_set, undirected);
+    Path ret;
+    if (!test_bit(visited, to))
+      return ret;
+    for (ArticleID a = to; a != from; a = parent[a]) {
+      ret.push_back(a);
+    }
+    ret.push_back(from);
+    reverse(ret.begin(), ret.end());
+    return ret;
+  }
+
+  const Stats& last_stats() const {
+    return stats;
+  }
+};
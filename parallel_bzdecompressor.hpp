@@ -0,0 +1,484 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <bzlib.h>
+#include <errno.h>
+
+#include "mpmc_ring_buffer.hpp"
+
+using namespace std;
+
+/**
+ * Decompresses a .bz2 file using multiple threads.
+ *
+ * bzip2 compresses its input in independent blocks of at most 900k. Each block
+ * starts with the 48 bit magic 0x314159265359, each stream ends with the magic
+ * 0x177245385090 (followed by the stream CRC). Neither is byte aligned.
+ *
+ * A scanner thread searches the compressed file for both magics, cuts it into
+ * pieces at every magic, and hands the pieces to the worker threads. A worker
+ * wraps a block piece into a standalone single-block stream and decompresses it.
+ * next_block() returns the decompressed blocks in file order, so the output is
+ * identical to a serial decompression, including files with multiple streams.
+ *
+ * The block magic may occur by chance inside compressed data. The (wrongly)
+ * split block then fails to decompress; it is glued together with its
+ * successors and retried. Pieces, merged or not, are limited to
+ * max_piece_size, so a corrupt file without magics fails instead of being
+ * read into memory as a single piece.
+ */
+class ParallelBzDecompressor {
+  static const uint64_t BLOCK_MAGIC = 0x314159265359ULL;
+  static const uint64_t EOS_MAGIC = 0x177245385090ULL;
+  static const uint64_t MAGIC_MASK = 0xFFFFFFFFFFFFULL;
+
+  static const size_t read_size = 1 << 20;
+  // a compressed block is at most ~900k. Anything larger is corrupt.
+  static const size_t max_piece_size = 2 << 20;
+  // a block holds at most 900k before the initial run length encoding.
+  static const size_t max_initial_out_size = 1 << 20;
+
+  /**
+   * Bit string, msb first.
+   */
+  struct BitString {
+    vector<uint8_t> bytes;
+    uint64_t nbits = 0;
+
+    void put_byte(uint8_t b) {
+      if (nbits % 8 == 0) {
+        bytes.push_back(b);
+        nbits += 8;
+      } else {
+        put_bits(b, 8);
+      }
+    }
+
+    void put_bits(uint64_t value, unsigned n) {
+      for (unsigned i = n; i-- > 0;) {
+        if (nbits % 8 == 0)
+          bytes.push_back(0);
+        if ((value >> i) & 1)
+          bytes.back() |= 0x80 >> (nbits % 8);
+        nbits++;
+      }
+    }
+
+    // appends 'other', skipping the first 'skip_bytes' bytes.
+    void append(const BitString &other, size_t skip_bytes = 0) {
+      uint64_t full = other.nbits / 8;
+      for (uint64_t i = skip_bytes; i < full; ++i) {
+        put_byte(other.bytes[i]);
+      }
+      unsigned rem = other.nbits % 8;
+      if (rem) {
+        put_bits(other.bytes[full] >> (8 - rem), rem);
+      }
+    }
+
+    void truncate(uint64_t n) {
+      nbits = n;
+      bytes.resize((n + 7) / 8);
+      if (n % 8)
+        bytes.back() &= 0xFF << (8 - n % 8);
+    }
+  };
+
+  // block pieces are stored as a standalone stream right away, i.e. prefixed
+  // by a stream header. The trailer is added before decompression.
+  static const size_t header_size = 4;
+
+  /**
+   * libbz2 allocates several MB of state for every stream. Since every block
+   * is decompressed as a separate stream, each worker keeps these allocations
+   * around for the next block.
+   */
+  struct AllocCache {
+    vector<pair<size_t, void*>> free_list;
+
+    ~AllocCache() {
+      for (auto &entry: free_list) {
+        ::free((size_t*)entry.second - 1);
+      }
+    }
+
+    static void* alloc(void *opaque, int n, int m) {
+      AllocCache *cache = (AllocCache*)opaque;
+      size_t size = (size_t)n * m;
+      for (size_t i = 0; i < cache->free_list.size(); ++i) {
+        if (cache->free_list[i].first == size) {
+          void *ret = cache->free_list[i].second;
+          cache->free_list.erase(cache->free_list.begin() + i);
+          return ret;
+        }
+      }
+      void *ret = ::malloc(size + sizeof(size_t));
+      if (!ret)
+        return NULL;
+      *(size_t*)ret = size;
+      return (size_t*)ret + 1;
+    }
+
+    static void release(void *opaque, void *ptr) {
+      AllocCache *cache = (AllocCache*)opaque;
+      cache->free_list.push_back(make_pair(*((size_t*)ptr - 1), ptr));
+    }
+  };
+
+  /**
+   * Keeps released buffers around for reuse.
+   */
+  template<typename Buffer>
+  class Recycler {
+    mutex mutex_;
+    vector<Buffer> free_;
+    const size_t max_free;
+
+  public:
+    Recycler(size_t max_free) : max_free(max_free) {}
+
+    void get(Buffer &out) {
+      unique_lock<mutex> lock(mutex_);
+      if (free_.size()) {
+        out.swap(free_.back());
+        free_.pop_back();
+      }
+      out.clear();
+    }
+
+    void put(Buffer &buffer) {
+      unique_lock<mutex> lock(mutex_);
+      if (free_.size() < max_free) {
+        free_.push_back(Buffer());
+        free_.back().swap(buffer);
+      }
+    }
+  };
+
+  struct Piece {
+    // true if the piece starts with a block magic, false if it starts
+    // with an end of stream marker (and contains no data).
+    bool is_block;
+    // "BZh9" followed by the piece (block pieces only)
+    BitString bits;
+
+    promise<void> decompressed;
+    bool ok = false;
+    string out;
+  };
+  typedef shared_ptr<Piece> piece_ptr;
+
+  FILE *file;
+  MPMCRingBuffer<piece_ptr> ordered;
+  MPMCRingBuffer<piece_ptr> work;
+  thread scanner;
+  vector<thread> workers;
+
+  atomic<bool> stop;
+  exception_ptr scan_error;
+  AllocCache retry_cache;
+
+  Recycler<string> out_buffers;
+  Recycler<vector<uint8_t>> piece_buffers;
+
+  // candidate tables: bit s of block_candidates[c] is set if a block magic
+  // starting at bit s of byte p has the value c in byte p+2.
+  uint8_t block_candidates[256];
+  uint8_t eos_candidates[256];
+
+public:
+  ParallelBzDecompressor(const ParallelBzDecompressor &) = delete;
+  ParallelBzDecompressor& operator=(const ParallelBzDecompressor &) = delete;
+
+  ParallelBzDecompressor(const string &filename, size_t n_threads)
+    : ordered(2 * n_threads + 2), work(2 * n_threads + 2), stop(false),
+      out_buffers(2 * n_threads + 2), piece_buffers(2 * n_threads + 2) {
+    file = fopen(filename.c_str(), "r");
+    if (file == NULL) {
+      throw std::runtime_error("Unable to open file " + filename + ", errno=" + to_string(errno) + " (" + strerror(errno) + ")");
+    }
+    char header[3];
+    if (fread(header, 1, 3, file) != 3 || memcmp(header, "BZh", 3) != 0) {
+      fclose(file);
+      throw std::runtime_error("Unable to decompress file: " + filename + " is not a bzip2 file");
+    }
+    rewind(file);
+
+    memset(block_candidates, 0, sizeof(block_candidates));
+    memset(eos_candidates, 0, sizeof(eos_candidates));
+    for (unsigned s = 0; s < 8; ++s) {
+      block_candidates[(BLOCK_MAGIC >> (24 + s)) & 0xFF] |= 1 << s;
+      eos_candidates[(EOS_MAGIC >> (24 + s)) & 0xFF] |= 1 << s;
+    }
+
+    for (size_t i = 0; i < n_threads; ++i) {
+      workers.push_back(thread(&ParallelBzDecompressor::worker_thread, this));
+    }
+    scanner = thread(&ParallelBzDecompressor::scanner_thread, this);
+  }
+
+  ~ParallelBzDecompressor() {
+    stop = true;
+    piece_ptr p;
+    while (ordered.pop(p)) {
+    }
+    scanner.join();
+    for (thread &t: workers) {
+      t.join();
+    }
+    fclose(file);
+  }
+
+  /**
+   * Writes the next decompressed block to 'out'. Returns false at the end
+   * of the file.
+   * Throws std::runtime_error on corrupt input.
+   */
+  bool next_block(string &out) {
+    piece_ptr piece;
+    while (pop_decompressed(piece)) {
+      if (!piece->ok) {
+        piece = retry_merged(piece);
+      }
+      piece_buffers.put(piece->bits.bytes);
+      if (piece->out.size()) {
+        out.swap(piece->out);
+        out_buffers.put(piece->out);
+        return true;
+      }
+    }
+    if (scan_error) {
+      rethrow_exception(scan_error);
+    }
+    return false;
+  }
+
+private:
+  bool pop_decompressed(piece_ptr &piece) {
+    if (!ordered.pop(piece))
+      return false;
+    piece->decompressed.get_future().wait();
+    return true;
+  }
+
+  // glues 'failed' together with its successors until it decompresses.
+  piece_ptr retry_merged(piece_ptr failed) {
+    piece_ptr next;
+    while (failed->bits.bytes.size() < max_piece_size && pop_decompressed(next)) {
+      failed->bits.append(next->bits, next->is_block ? header_size : 0);
+      decompress(*failed, retry_cache);
+      if (failed->ok)
+        return failed;
+    }
+    throw std::runtime_error("Reading failed: corrupt bzip2 block");
+  }
+
+  void decompress(Piece &piece, AllocCache &cache) {
+    out_buffers.get(piece.out);
+    piece.ok = !piece.is_block;
+    if (!piece.is_block)
+      return;
+    BitString &stream = piece.bits;
+    // header (32 bits) + magic (48 bits) + block crc (32 bits)
+    if (stream.nbits < 112)
+      return;
+    const uint8_t *crc = &stream.bytes[header_size + 6];
+    uint32_t block_crc = ((uint32_t)crc[0] << 24) | ((uint32_t)crc[1] << 16) |
+                         ((uint32_t)crc[2] << 8) | crc[3];
+
+    // terminate the stream. The combined crc of a single block stream is
+    // the block crc.
+    uint64_t piece_bits = stream.nbits;
+    stream.put_bits(EOS_MAGIC, 48);
+    stream.put_bits(block_crc, 32);
+
+    bz_stream bz;
+    memset(&bz, 0, sizeof(bz));
+    bz.bzalloc = &AllocCache::alloc;
+    bz.bzfree = &AllocCache::release;
+    bz.opaque = &cache;
+    if (BZ2_bzDecompressInit(&bz, 0, 0) == BZ_OK) {
+      bz.next_in = (char*)stream.bytes.data();
+      bz.avail_in = stream.bytes.size();
+
+      piece.out.resize(min(stream.bytes.size() * 8, (size_t)max_initial_out_size));
+      size_t produced = 0;
+      while (true) {
+        bz.next_out = &piece.out[produced];
+        bz.avail_out = piece.out.size() - produced;
+        int ret = BZ2_bzDecompress(&bz);
+        produced = piece.out.size() - bz.avail_out;
+        if (ret == BZ_STREAM_END) {
+          piece.ok = true;
+          break;
+        }
+        if (ret != BZ_OK)
+          break;
+        if (bz.avail_out == 0) {
+          piece.out.resize(piece.out.size() * 2);
+        } else if (bz.avail_in == 0) {
+          // truncated
+          break;
+        }
+      }
+      BZ2_bzDecompressEnd(&bz);
+      piece.out.resize(produced);
+    }
+    // keep the piece mergeable with its predecessor/successor
+    stream.truncate(piece_bits);
+    if (!piece.ok)
+      piece.out.clear();
+  }
+
+  void worker_thread() {
+    AllocCache cache;
+    piece_ptr piece;
+    while (work.pop(piece)) {
+      decompress(*piece, cache);
+      piece->decompressed.set_value();
+    }
+  }
+
+  void scanner_thread() {
+    try {
+      scan();
+    } catch (...) {
+      scan_error = current_exception();
+    }
+    work.terminate_consumers();
+    ordered.terminate_consumers();
+  }
+
+  // state of scan()
+  vector<uint8_t> buf;
+  uint64_t buf_offset = 0; // file offset of buf[0]
+  piece_ptr current;
+  // bit offset of the current piece, minus the length of its header.
+  uint64_t current_base = 0;
+
+  // appends the bits up to (excluding) bit offset 'end' to the current piece.
+  // only full bytes are appended unless 'partial' is set.
+  void extend_current(uint64_t end, bool partial) {
+    if (!current)
+      return;
+    BitString &bits = current->bits;
+    while (current_base + bits.nbits + 8 <= end) {
+      uint64_t pos = current_base + bits.nbits;
+      size_t idx = pos / 8 - buf_offset;
+      unsigned shift = pos % 8;
+      uint8_t b = buf[idx] << shift;
+      if (shift)
+        b |= buf[idx + 1] >> (8 - shift);
+      bits.put_byte(b);
+    }
+    uint64_t pos = current_base + bits.nbits;
+    if (partial && pos < end) {
+      size_t idx = pos / 8 - buf_offset;
+      unsigned n = end - pos;
+      unsigned shift = pos % 8;
+      uint16_t two = ((uint16_t)buf[idx] << 8) | (idx + 1 < buf.size() ? buf[idx + 1] : 0);
+      bits.put_bits((two >> (16 - shift - n)) & ((1 << n) - 1), n);
+    }
+    if (bits.bytes.size() > max_piece_size) {
+      if (current->is_block)
+        throw std::runtime_error("Reading failed: bzip2 block larger than " + to_string(max_piece_size) + " bytes");
+      throw std::runtime_error("Reading failed: no bzip2 block found in " + to_string(max_piece_size) + " bytes");
+    }
+  }
+
+  void finish_current(uint64_t end) {
+    if (!current)
+      return;
+    extend_current(end, true);
+    ordered.push(current);
+    work.push(current);
+    current.reset();
+  }
+
+  void boundary(uint64_t pos, bool is_block) {
+    finish_current(pos);
+    current = make_shared<Piece>();
+    current->is_block = is_block;
+    piece_buffers.get(current->bits.bytes);
+    if (is_block) {
+      current->bits.bytes.insert(current->bits.bytes.end(), {'B', 'Z', 'h', '9'});
+      current->bits.nbits = 8 * header_size;
+    }
+    current_base = pos - current->bits.nbits;
+  }
+
+  void scan() {
+    size_t scan_from = 0;
+    bool eof = false;
+    while (!eof && !stop) {
+      size_t old_size = buf.size();
+      buf.resize(old_size + read_size);
+      size_t n = fread(buf.data() + old_size, 1, read_size, file);
+      buf.resize(old_size + n);
+      if (n < read_size) {
+        if (ferror(file))
+          throw std::runtime_error("Reading failed: errno is " + to_string(errno));
+        eof = true;
+      }
+
+      // positions p need 8 bytes buf[p..p+8). At the end of the file,
+      // pad with zeros and only accept magics within the file.
+      size_t limit = buf.size() >= 8 ? buf.size() - 7 : 0;
+      uint64_t file_bits = (buf_offset + buf.size()) * 8;
+      if (eof) {
+        limit = buf.size();
+        buf.resize(buf.size() + 8, 0);
+      }
+      for (size_t p = scan_from; p < limit; ++p) {
+        uint8_t c = buf[p + 2];
+        uint8_t candidates = block_candidates[c] | eos_candidates[c];
+        if (!candidates)
+          continue;
+        uint64_t w = 0;
+        for (size_t i = 0; i < 8; ++i) {
+          w = (w << 8) | buf[p + i];
+        }
+        for (unsigned s = 0; s < 8; ++s) {
+          if (!(candidates & (1 << s)))
+            continue;
+          uint64_t pos = (buf_offset + p) * 8 + s;
+          if (pos + 48 > file_bits)
+            continue;
+          uint64_t v = (w >> (16 - s)) & MAGIC_MASK;
+          if (v == BLOCK_MAGIC) {
+            boundary(pos, true);
+          } else if (v == EOS_MAGIC) {
+            boundary(pos, false);
+          }
+        }
+      }
+
+      if (eof) {
+        buf.resize(buf.size() - 8);
+        finish_current(file_bits);
+        break;
+      }
+
+      extend_current((buf_offset + limit) * 8, false);
+
+      // drop everything that was scanned and copied to the current piece.
+      size_t keep = limit;
+      if (current) {
+        keep = min(keep, (size_t)((current_base + current->bits.nbits) / 8 - buf_offset));
+      }
+      buf.erase(buf.begin(), buf.begin() + keep);
+      buf_offset += keep;
+      scan_from = limit - keep;
+    }
+  }
+};
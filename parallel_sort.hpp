@@ -0,0 +1,139 @@
+#pragma once
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <iterator>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * Sorts [first, last) with 'cmp' on up to 'n_threads' threads: the range
+ * is split into one part per thread, the parts are sorted in parallel and
+ * then merged pairwise, again in parallel. Not stable.
+ */
+template<typename It, typename Cmp>
+void parallel_sort(It first, It last, Cmp cmp, size_t n_threads) {
+  const size_t n = distance(first, last);
+  size_t parts = 1;
+  while (parts * 2 <= n_threads && parts * 2 <= n / 1024)
+    parts *= 2;
+  if (parts == 1) {
+    sort(first, last, cmp);
+    return;
+  }
+
+  vector<It> bounds;
+  for (size_t i = 0; i <= parts; ++i) {
+    bounds.push_back(first + n * i / parts);
+  }
+
+  vector<thread> threads;
+  for (size_t i = 0; i < parts; ++i) {
+    threads.push_back(thread([&, i]{ sort(bounds[i], bounds[i + 1], cmp); }));
+  }
+  for (thread &t: threads) {
+    t.join();
+  }
+
+  // merge neighbouring parts until one is left.
+  for (size_t width = 1; width < parts; width *= 2) {
+    threads.clear();
+    for (size_t i = 0; i + width < parts; i += 2 * width) {
+      It a = bounds[i], b = bounds[i + width], c = bounds[min(i + 2 * width, parts)];
+      threads.push_back(thread([a, b, c, &cmp]{ inplace_merge(a, b, c, cmp); }));
+    }
+    for (thread &t: threads) {
+      t.join();
+    }
+  }
+}
+
+/**
+ * Sorts [first, last) with 'cmp' on up to 'n_threads' threads by sample
+ * sort: splitters taken from a sample of the range divide it into a few
+ * buckets per thread, the elements are moved to their buckets in parallel
+ * and the buckets are sorted in parallel. Unlike parallel_sort, no part of
+ * it runs on one thread only, and the elements of a bucket are contiguous
+ * while it is sorted. Needs a buffer of the range's size (of default
+ * constructed elements) and 4 bytes per element. Not stable.
+ */
+template<typename It, typename Cmp>
+void parallel_sample_sort(It first, It last, Cmp cmp, size_t n_threads) {
+  typedef typename iterator_traits<It>::value_type T;
+  const size_t n = distance(first, last);
+  if (n_threads < 2 || n < (1 << 14)) {
+    sort(first, last, cmp);
+    return;
+  }
+
+  // more buckets than threads even out buckets of different cost.
+  const size_t n_buckets = 8 * n_threads;
+  const size_t oversampling = 16;
+  vector<T> splitters;
+  {
+    vector<T> sample;
+    const size_t n_samples = n_buckets * oversampling;
+    for (size_t i = 0; i < n_samples; ++i) {
+      sample.push_back(first[n * i / n_samples + n / n_samples / 2]);
+    }
+    sort(sample.begin(), sample.end(), cmp);
+    for (size_t b = 1; b < n_buckets; ++b) {
+      splitters.push_back(sample[b * oversampling]);
+    }
+  }
+
+  auto run_threads = [&](function<void(size_t)> f) {
+    vector<thread> threads;
+    for (size_t t = 0; t < n_threads; ++t) {
+      threads.push_back(thread(f, t));
+    }
+    for (thread &t: threads) {
+      t.join();
+    }
+  };
+  auto part_begin = [&](size_t t) { return n * t / n_threads; };
+
+  // bucket of every element, and the bucket sizes per thread's part.
+  vector<uint32_t> bucket(n);
+  vector<vector<size_t>> positions(n_threads, vector<size_t>(n_buckets));
+  run_threads([&](size_t t) {
+    for (size_t i = part_begin(t); i < part_begin(t + 1); ++i) {
+      bucket[i] = upper_bound(splitters.begin(), splitters.end(), first[i], cmp) - splitters.begin();
+      positions[t][bucket[i]]++;
+    }
+  });
+  // where each thread's elements of a bucket go.
+  vector<size_t> bucket_bounds(n_buckets + 1);
+  size_t offset = 0;
+  for (size_t b = 0; b < n_buckets; ++b) {
+    bucket_bounds[b] = offset;
+    for (size_t t = 0; t < n_threads; ++t) {
+      size_t count = positions[t][b];
+      positions[t][b] = offset;
+      offset += count;
+    }
+  }
+  bucket_bounds[n_buckets] = n;
+
+  vector<T> buffer(n);
+  run_threads([&](size_t t) {
+    vector<size_t> &position = positions[t];
+    for (size_t i = part_begin(t); i < part_begin(t + 1); ++i) {
+      buffer[position[bucket[i]]++] = std::move(first[i]);
+    }
+  });
+  vector<uint32_t>().swap(bucket);
+
+  atomic<size_t> next_bucket(0);
+  run_threads([&](size_t) {
+    size_t b;
+    while ((b = next_bucket.fetch_add(1)) < n_buckets) {
+      auto begin = buffer.begin() + bucket_bounds[b], end = buffer.begin() + bucket_bounds[b + 1];
+      sort(begin, end, cmp);
+      std::move(begin, end, first + bucket_bounds[b]);
+    }
+  });
+}
@@ -1,6 +1,12 @@
 #include "parseutil.hpp"
 
 #include <string>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 // Generic string parsing /*{{{*/
 
@@ -55,29 +61,98 @@ bool split_one(string &first, string &rem, const string &in, char delim) {
 
 /*}}}*/
 // DBPedia-related parse utilities /*{{{*/
-// removes < and > from start and end of a token.
-// returns true if <> was removed, false otherwise.
-bool strip_tag(string &token) {
- if (token.size() > 2 && token[0] == '<' && token[token.size()-1] == '>') {
-    token = token.substr(1, token.size()-2);
-    return true;
- }
- return false;
+// the first '%' or '+' in [p, end), or end.
+static const char *find_urlescape(const char *p, const char *end) {
+#if defined(__SSE2__)
+  const __m128i percent = _mm_set1_epi8('%');
+  const __m128i plus = _mm_set1_epi8('+');
+  for (; p + 16 <= end; p += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, percent),
+                                              _mm_cmpeq_epi8(bytes, plus)));
+    if (mask)
+      return p + __builtin_ctz(mask);
+  }
+#endif
+  for (; p != end; ++p) {
+    if (*p == '%' || *p == '+')
+      break;
+  }
+  return p;
+}
+
+// true if urldecode would succeed on [p, end): every '%' starts "%%" or a
+// hex escape.
+static bool urldecodable(const char *p, const char *end) {
+  short high, low;
+  while ((p = find_urlescape(p, end)) != end) {
+    if (*p == '+') {
+      p += 1;
+    } else if (p + 1 < end && p[1] == '%') {
+      p += 2;
+    } else if (p + 3 <= end && parse_hex(high, p[1]) && parse_hex(low, p[2])) {
+      p += 3;
+    } else {
+      return false;
+    }
+  }
+  return true;
 }
 
 
 const string DBPEDIA_RESOURCE_PREFIX("dbpedia.org/resource/");
-// removes DBPREDIA_RESOURCE_PREFIX from beginning of resource and returns true, returns false
-// if string didn't start with DBPEDIA_RESOURCE_PREFIX.
-bool stripDbpediaPrefix(string& resource) {
-  if (resource.find("http://") != 0)
-    return false;
-  size_t pos = resource.find(DBPEDIA_RESOURCE_PREFIX);
-  if (pos >= 15) // accounts for http://simple.$DBPEDIA_RESOURCE_PREFIX
-    return false;
 
-  resource = resource.substr(pos+DBPEDIA_RESOURCE_PREFIX.size());
-  return true;
+/**
+ * performs basic dbpedia resource normalization, see the string version.
+ * Works in place: the < > tags and the prefix are skipped, the rest is
+ * decoded to the start of 'data'.
+ */
+size_t abbr_ressource(char *data, size_t size) {
+  const char *begin = data, *end = data + size;
+  // removes < and > from start and end.
+  if (size > 2 && begin[0] == '<' && end[-1] == '>') {
+    ++begin;
+    --end;
+  }
+  // removes DBPEDIA_RESOURCE_PREFIX if it starts within the first 15
+  // characters (accounts for http://simple.$DBPEDIA_RESOURCE_PREFIX).
+  const size_t http = 7;
+  if ((size_t)(end - begin) >= http && memcmp(begin, "http://", http) == 0) {
+    const char *search_end = begin + min((size_t)(end - begin), 14 + DBPEDIA_RESOURCE_PREFIX.size());
+    const char *pos = search(begin, search_end, DBPEDIA_RESOURCE_PREFIX.begin(), DBPEDIA_RESOURCE_PREFIX.end());
+    if (pos != search_end)
+      begin = pos + DBPEDIA_RESOURCE_PREFIX.size();
+  }
+
+  char *out = data;
+  if (!urldecodable(begin, end)) {
+    cerr << "Warning: could not urldecode " << boost::string_ref(begin, end - begin) << endl;
+    memmove(out, begin, end - begin);
+    return end - begin;
+  }
+  // 'out' never passes the input, as escapes only get shorter.
+  const char *p = begin;
+  while (true) {
+    const char *escape = find_urlescape(p, end);
+    memmove(out, p, escape - p);
+    out += escape - p;
+    if (escape == end)
+      break;
+    if (*escape == '+') {
+      *out++ = ' ';
+      p = escape + 1;
+    } else if (escape[1] == '%') {
+      *out++ = '%';
+      p = escape + 2;
+    } else {
+      short high = 0, low = 0;
+      parse_hex(high, escape[1]);
+      parse_hex(low, escape[2]);
+      *out++ = high * 16 + low;
+      p = escape + 3;
+    }
+  }
+  return out - data;
 }
 
 
@@ -86,15 +161,7 @@ bool stripDbpediaPrefix(string& resource) {
  * removes the < > tags, removes the dbpedia resource prefix, urldecodes (if possible).
  */
 void abbr_ressource(string& source) {
-  strip_tag(source);
-  stripDbpediaPrefix(source);
-  string urldecoded_source;
-  
-  if (!urldecode(urldecoded_source, source)) {
-    cerr << "Warning: could not urldecode " << source << endl;
-  } else {
-    source = urldecoded_source;
-  }
+  source.resize(abbr_ressource(&source[0], source.size()));
 }
 
 
@@ -103,10 +170,17 @@ void abbr_ressource(string& source) {
  * removes quotes.
  */
 void parse_nt_string(string &in) {
-  if (in.size() > 2 && in.rfind("@") == in.size()-3) {
-    in = in.substr(0, in.size()-3);
+  boost::string_ref parsed = parse_nt_string(boost::string_ref(in));
+  in = in.substr(parsed.data() - in.data(), parsed.size());
+}
+
+
+boost::string_ref parse_nt_string(boost::string_ref in) {
+  if (in.size() > 2 && in.rfind('@') == in.size()-3) {
+    in.remove_suffix(3);
   }
   if (in.size() > 2 && in[0] == '"' && in[in.size()-1] == '"') {
     in = in.substr(1, in.size()-2);
   }
+  return in;
 }
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <iostream> // required by urldecode. Probably not required (return true/false instead of cerr).
+#include <boost/utility/string_ref.hpp>
 using namespace std;
 
 
@@ -20,12 +21,23 @@ bool split_one(string &first, string &rem, const string &in, char delim = ' ');
  */
 void abbr_ressource(string& source); 
 
+/**
+ * abbr_ressource in place on the 'size' characters at 'data', without
+ * allocating. Returns the size of the result, which starts at 'data'.
+ */
+size_t abbr_ressource(char *data, size_t size);
+
 /**
  * parses a string: removes the @<langauge code> suffix,
  * removes quotes.
  */
 void parse_nt_string(string &in);
 
+/**
+ * parse_nt_string without copying: the part of 'in' it would keep.
+ */
+boost::string_ref parse_nt_string(boost::string_ref in);
+
 inline bool parse_hex(short &tgt, char c) {
   if (c >= '0' && c <= '9') {
     tgt = c - '0';
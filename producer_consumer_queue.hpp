@@ -46,6 +46,13 @@ class ProducerConsumerQueue {
       cond_.notify_all();
     }
 
+    void push(T&& obj) {
+      unique_lock<mutex> lock(mutex_);
+      cond_.wait(lock, [this]{return this->queue_.size() < max_queue_size;});
+      queue_.push(std::move(obj));
+      cond_.notify_all();
+    }
+
     // returns false if no item could be extracted and the producer has requested shutdown.
     // returns true and writes the next item in 'out' otherwise.
     bool pop(T &out) {
@@ -54,7 +61,7 @@ class ProducerConsumerQueue {
       if (queue_.empty()) {
         return false;
       }
-      out = queue_.front();
+      out = std::move(queue_.front());
       queue_.pop();
       cond_.notify_all();
       return true;
@@ -1,75 +1,95 @@
 #include "read.hpp"
 
 #include <thread>
+#include <atomic>
+#include <iterator>
 #include <vector>
-#include <tuple>
+#include <utility>
 #include <algorithm>
-#include <boost/tokenizer.hpp>
-#include <boost/algorithm/string/split.hpp>
-#include <boost/algorithm/string/classification.hpp>
-
-#include "producer_consumer_queue.hpp"
+#include <chrono>
+#include <malloc.h>
+
+#include "mpmc_ring_buffer.hpp"
+#include "parallel_sort.hpp"
+#include "link_builder.hpp"
+#include "component_builder.hpp"
+#include "link_order_builder.hpp"
 #include "bzreader.hpp"
-#include "escaped_list_ignore.hpp"
+#include "ntriples_tokenizer.hpp"
 #include "parseutil.hpp"
 
 
 using namespace std;
-using namespace boost::algorithm;
-using namespace boost;
+using boost::string_ref;
 
 // stats: number of occurances where we didn't need to store the label seperately.
 size_t nolabel = 0;
 
+size_t label_threads = max(1u, thread::hardware_concurrency());
+size_t decompress_threads = max(1u, thread::hardware_concurrency());
+
+bool use_resource_index = true;
+bool use_components = true;
+LinkOrderBuilder::Method link_order = LinkOrderBuilder::KEEP;
+
 // Label parsing /*{{{*/
-// add a line from the labels resource file to the database.
-void add_label(WikiData& wikidata, const string& line, const size_t linenr) {
+// labels read by one label thread, unsorted, and its statistics. The
+// threads share nothing but the queue and the progress counter; the shards
+// are merged once all have finished.
+struct LabelShard {
+  vector<string> labels;
+  size_t nolabel = 0;
+};
+
+// lines read by all label threads, added up per chunk.
+atomic<size_t> label_linecount(0);
+
+// add a line from the labels resource file to the shard. 'resource' is
+// the thread's buffer for the normalized resource.
+void add_label(LabelShard &shard, NTriplesTokenizer &tokens, string &resource,
+               const string_ref& line, const size_t linenr) {
   if (!line.size() || line[0] == '#')
     return;
-  escaped_list_separator_includeinvalid<char> ls('\\', ' ', '\"');
-  tokenizer<escaped_list_separator_includeinvalid<char> > tok(line, ls);
-
-  auto it = tok.begin();
-  size_t i = 0;
-  string resource, label;
-  for (i = 0; i < 3 && it != tok.end(); ++i, ++it) {
-    if (i == 0) {
-      resource = *it;      
-      abbr_ressource(resource);
-    }
-    if (i == 2) {
-      label = *it;
-      parse_nt_string(label);      
-    }
-  }
-  if (i != 3) {
+  if (tokens.tokenize(line, 3) != 3) {
     cerr << "line [" << linenr << "] malformed: " << line << endl;
     return;
   }
-
-  string denormalized = resource;
-  wikipedia_denormalization(denormalized);
-  if (denormalized != label) {
+  resource.assign(tokens.term(0).data(), tokens.term(0).size());
+  resource.resize(abbr_ressource(&resource[0], resource.size()));
+  string_ref label = parse_nt_string(tokens.term(2));
+
+  // compares against the label the resource denormalizes to, without copying it.
+  bool denormalized = resource.size() == label.size() &&
+    equal(resource.begin(), resource.end(), label.begin(), [](char r, char l) {
+      return (r == '_' ? ' ' : r) == l;
+    });
+  if (!denormalized) {
     resource.push_back('\0');
-    resource.append(label);
+    resource.append(label.data(), label.size());
   } else {
-    nolabel++;
-  }
-
-  {
-    unique_lock<mutex> lock(wikidata.labels_write);
-    wikidata.labels.push_back(resource);
+    shard.nolabel++;
   }
+  shard.labels.push_back(resource);
 }
 
-size_t label_linecount = 1;
-void add_label_thread(WikiData &wikidata, ProducerConsumerQueue<string> &q) {
-  string line;
-  while (q.pop(line)) {
-    add_label(wikidata, line, label_linecount);
-    label_linecount += 1;
-    if (label_linecount % 1000000 == 0) {
-      cout << "Read " << label_linecount << " labels. Queue is at " << q.size() << endl;
+void add_label_thread(LabelShard &shard, MPMCRingBuffer<string> &q) {
+  NTriplesTokenizer tokens;
+  string resource;
+  string chunk;
+  while (q.pop(chunk)) {
+    // line numbers are approximate, the chunks are parsed in parallel.
+    size_t linenr = label_linecount.load(memory_order_relaxed);
+    size_t lines_in_chunk = 0;
+    LineSplitter lines(chunk);
+    string_ref line;
+    while (lines.next(line)) {
+      lines_in_chunk++;
+      add_label(shard, tokens, resource, line, linenr + lines_in_chunk);
+    }
+    size_t before = label_linecount.fetch_add(lines_in_chunk, memory_order_relaxed);
+    if (before / 1000000 != (before + lines_in_chunk) / 1000000) {
+      cout << "Read " << (before + lines_in_chunk) / 1000000 * 1000000 << " labels. Queue is at "
+           << q.size() << endl;
     }
   }
 }
@@ -77,15 +97,20 @@ void add_label_thread(WikiData &wikidata, ProducerConsumerQueue<string> &q) {
 void read_labels(WikiData &wikidata, string labelfile = "labels_en.nt.bz2") {
   cout << "Reading labels from " << labelfile << endl;
 
-  ProducerConsumerQueue<string> q(4096);
+  // queue of chunks of lines
+  const size_t n_threads = max((size_t)1, label_threads);
+  MPMCRingBuffer<string> q(2 * n_threads);
+  vector<LabelShard> shards(n_threads);
+  label_linecount = 0;
   vector<thread> threads;
-  for (size_t i = 0; i < NUM_LABEL_THREADS; ++i) {
-    threads.push_back(thread(add_label_thread, std::ref(wikidata), std::ref(q)));
+  for (size_t i = 0; i < n_threads; ++i) {
+    threads.push_back(thread(add_label_thread, std::ref(shards[i]), std::ref(q)));
   }
-  BzReader r(labelfile);
+  BzReader r(labelfile, decompress_threads);
   try {
-    while (!r.done()) {
-      q.push(r.readline());
+    string chunk;
+    while (r.read_chunk(chunk)) {
+      q.push(std::move(chunk));
     }
   } catch (const std::runtime_error &e) {
     cerr << e.what() << endl;
@@ -95,131 +120,212 @@ void read_labels(WikiData &wikidata, string labelfile = "labels_en.nt.bz2") {
     t.join();
   }
 
-  cout << "Reading finished, read " << label_linecount << " labels. Sorting." << endl;
+  vector<string> labels;
+  size_t total = 0;
+  for (const LabelShard &shard: shards) {
+    total += shard.labels.size();
+  }
+  labels.reserve(total);
+  nolabel = 0;
+  for (LabelShard &shard: shards) {
+    move(shard.labels.begin(), shard.labels.end(), back_inserter(labels));
+    vector<string>().swap(shard.labels);
+    nolabel += shard.nolabel;
+  }
+
+  cout << "Reading finished, read " << label_linecount << " lines with " << labels.size()
+       << " labels. Sorting." << endl;
+
+  auto sort_start = chrono::steady_clock::now();
+  parallel_sample_sort(labels.begin(), labels.end(), less<string>(),
+                       max(1u, thread::hardware_concurrency()));
+  cout << "Sorting the labels took " <<
+    chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - sort_start).count()
+    << " ms." << endl;
+  wikidata.set_labels(labels);
+
+  if (use_resource_index) {
+    auto start = chrono::steady_clock::now();
+    wikidata.build_resource_index();
+    cout << "Building the resource index took " <<
+      chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
+      << " ms, using " << wikidata.resource_index.memory_usage() / (1024.0 * 1024) << " MB." << endl;
+  }
 
-  sort(wikidata.labels.begin(), wikidata.labels.end());
+  auto start = chrono::steady_clock::now();
+  wikidata.build_label_index(max(1u, thread::hardware_concurrency()));
+  cout << "Building the label index took " <<
+    chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
+    << " ms, using " << wikidata.label_index.memory_usage() / (1024.0 * 1024) << " MB." << endl;
 }
 
 /*}}}*/
 // Link parsing /*{{{*/
+// copies 'term' to 'buffer' (reusing its memory) and normalizes it there.
+string_ref normalized_resource(string &buffer, const string_ref &term) {
+  buffer.assign(term.data(), term.size());
+  return string_ref(buffer.data(), abbr_ressource(&buffer[0], buffer.size()));
+}
+
+// statistics of the page link parsers.
+struct PageLinkStats {
+  atomic<size_t> links{0};
+  // lines whose subject was looked up, and those that reused the subject
+  // of the previous line.
+  atomic<size_t> subject_lookups{0};
+  atomic<size_t> subject_reused{0};
+};
+
 /**
- * Handles a configurable amount of add_link_locked calls in parallel.
+ * Parses page link lines for one thread and collects the links in a buffer
+ * of its own. The dumps list the links of a page in a run of lines with
+ * the same subject, so the subject of the previous line is remembered and
+ * only a new one is normalized and looked up. The runs come sorted by
+ * subject, as are the labels: without the resource index, a new subject is
+ * searched from the previous one on (WikiData::find_by_resource with a
+ * hint), which falls back to a full search for unsorted input. Targets are
+ * collected and looked up in batches (WikiData::find_by_resource_batch),
+ * whose cache misses overlap.
  */
-class LinkWriteDispatcher {
-  typedef ProducerConsumerQueue<tuple<WikiData::ArticleID, WikiData::ArticleID, bool>> pcqueue_t;
-  vector<thread> threads;
-  vector<pcqueue_t*> prodcons;
-  WikiData& wikidata;
-  size_t n_threads;
-
-  void add_link_thread(pcqueue_t *q) {
-    tuple<WikiData::ArticleID, WikiData::ArticleID, bool> data;
-    while (q->pop(data)) {
-      wikidata.add_link_unsafe(get<0>(data),
-          get<1>(data), get<2>(data));
-    }
-  }
+class PageLinkParser {
+  typedef WikiData::ArticleID ArticleID;
+
+  const WikiData &wikidata;
+  LinkBuilder::Buffer out;
+  NTriplesTokenizer tokens;
+  // targets looked up at once
+  static const size_t target_batch_size = 256;
+
+  // buffer for the normalized subject
+  string source;
+  // the normalized targets waiting for their lookup, one after the other,
+  // with their end offsets and subjects.
+  string targets;
+  vector<size_t> target_ends;
+  vector<ArticleID> target_subjects;
+  vector<string_ref> target_keys;
+  vector<ArticleID> found_targets;
+  // the subject of the previous line, as in the line, and its article.
+  string subject_term;
+  ArticleID subject = -1;
+  // the last subject found, where the search for the next one starts.
+  ArticleID hint = 0;
+  size_t subject_lookups = 0, subject_reused = 0;
 
 public:
-  const LinkWriteDispatcher& operator=(const LinkWriteDispatcher&other) = delete;
-  LinkWriteDispatcher(const LinkWriteDispatcher&other) = delete;
-
-  LinkWriteDispatcher(WikiData& wikidata, size_t n_threads) : 
-      wikidata(wikidata), n_threads(n_threads) {
-    for (size_t i = 0; i < n_threads; ++i) {
-      prodcons.push_back(new pcqueue_t);
-      threads.push_back(thread(&LinkWriteDispatcher::add_link_thread, this, prodcons[i]));
+  PageLinkParser(const WikiData &wikidata, LinkBuilder &builder)
+    : wikidata(wikidata), out(builder) { }
+
+  void parse(const string_ref& line) {
+    if (!line.size() || line[0] == '#')
+      return;
+    if (tokens.split(line) != 4) {
+      cerr << "Reading line " << line << ": Don't know what to do." << endl;
+      return;
     }
-  }
 
-  ~LinkWriteDispatcher() {
-    for (pcqueue_t* q: prodcons) {
-      q->terminate_consumers(); 
+    const string_ref &term = tokens.term(0);
+    if (term == subject_term) {
+      subject_reused++;
+    } else {
+      subject_term.assign(term.data(), term.size());
+      subject = wikidata.find_by_resource(normalized_resource(source, term), hint);
+      if (subject != (ArticleID)-1)
+        hint = subject;
+      subject_lookups++;
     }
-    for (thread& t: threads) {
-      t.join();
+    if (subject == (ArticleID)-1) {
+      // missing links are actually pretty common. Just ignore 'em.
+      return;
     }
-    for (pcqueue_t* q: prodcons) {
-      delete q;
-    }
-  }
 
-  void add_link(WikiData::ArticleID from, WikiData::ArticleID target,
-        bool outgoing) {
-    size_t thread_id = from % n_threads;
-    prodcons[thread_id]->push(make_tuple(from, target, outgoing));
-  }
-};
-
-void parse_add_pagelink(WikiData& wikidata, const string& line,
-    LinkWriteDispatcher &l, bool add_incoming) { 
-  if (!line.size() || line[0] == '#')
-    return;
-  vector<string> tokens;
-  split(tokens, line, is_any_of(" ")); 
-  if (tokens.size() != 4) {
-    cerr << "Reading line " << line << ": Don't know what to do." << endl;
-    return;
-  }
-
-  string source = tokens[0];
-  abbr_ressource(source);
-
-  string target = tokens[2];
-  abbr_ressource(target);
-
-  WikiData::ArticleID from_idx = wikidata.find_by_resource(source);
-  if (from_idx == (WikiData::ArticleID)-1) {
-    // missing links are actually pretty common. Just ignore 'em.
-    return;
+    const string_ref &target = tokens.term(2);
+    size_t start = targets.size();
+    targets.append(target.data(), target.size());
+    targets.resize(start + abbr_ressource(&targets[start], target.size()));
+    target_ends.push_back(targets.size());
+    target_subjects.push_back(subject);
+    if (target_ends.size() == target_batch_size)
+      flush();
   }
 
-  WikiData::ArticleID target_idx = wikidata.find_by_resource(target);
-  if (target_idx == (WikiData::ArticleID)-1) {
-    return;
+  /**
+   * Looks up the collected targets and adds their links.
+   */
+  void flush() {
+    target_keys.clear();
+    size_t start = 0;
+    for (size_t end: target_ends) {
+      target_keys.push_back(string_ref(targets.data() + start, end - start));
+      start = end;
+    }
+    found_targets.resize(target_keys.size());
+    wikidata.find_by_resource_batch(target_keys.data(), target_keys.size(), found_targets.data());
+    for (size_t i = 0; i < found_targets.size(); ++i) {
+      if (found_targets[i] != (ArticleID)-1)
+        out.add_link(target_subjects[i], found_targets[i]);
+    }
+    targets.clear();
+    target_ends.clear();
+    target_subjects.clear();
   }
 
-  l.add_link(from_idx, target_idx, true);
-  if (add_incoming) {
-    l.add_link(target_idx, from_idx, false);
+  void add_stats(PageLinkStats &stats) const {
+    stats.links += out.size();
+    stats.subject_lookups += subject_lookups;
+    stats.subject_reused += subject_reused;
   }
-}
+};
 
-void parse_add_pagelink_thread(WikiData& wikidata, ProducerConsumerQueue<string>& in,
-                               LinkWriteDispatcher& out, bool add_incoming) {
-  string line;
-  while (in.pop(line)) {
-    parse_add_pagelink(wikidata, line, out, add_incoming);
+void parse_add_pagelink_thread(const WikiData& wikidata, MPMCRingBuffer<string>& in,
+                               LinkBuilder& builder, PageLinkStats& stats) {
+  PageLinkParser parser(wikidata, builder);
+  string chunk;
+  while (in.pop(chunk)) {
+    LineSplitter lines(chunk);
+    string_ref line;
+    while (lines.next(line)) {
+      parser.parse(line);
+    }
   }
+  parser.flush();
+  parser.add_stats(stats);
 }
 
 
 size_t read_page_links(WikiData &wikidata, const string& linkfile, const bool incoming = false) {
-  BzReader r(linkfile);
+  BzReader r(linkfile, decompress_threads);
 
-  // TODO protect linecount with mutex
+  // only counted by this thread, while it splits the input into chunks
   size_t linecount = 0;
 
-  ProducerConsumerQueue<string> q;
+  // queue of chunks of lines
+  MPMCRingBuffer<string> q(2 * PARSE_LINK_THREADS);
+
+  LinkBuilder builder(wikidata.label_count(), LINK_BUILD_SHARDS);
+  PageLinkStats stats;
+  auto start = chrono::steady_clock::now();
 
-  LinkWriteDispatcher addlink_dispatch(wikidata, ADD_LINK_THREADS);
-  
   vector<thread> threads;
   for (size_t i = 0; i < PARSE_LINK_THREADS; ++i) {
     threads.push_back(thread(parse_add_pagelink_thread,
-                             std::ref(wikidata), std::ref(q),
-                             std::ref(addlink_dispatch), incoming)); 
+                             std::cref(wikidata), std::ref(q),
+                             std::ref(builder), std::ref(stats)));
   }
 
-  while (!r.done()) {
-    linecount += 1;
+  string chunk;
+  while (true) {
     try {
-      q.push(r.readline());
+      if (!r.read_chunk(chunk))
+        break;
     } catch (const std::runtime_error &c) {
       cerr << c.what() << endl;
       break;
     }
-    if (linecount % 1000000 == 0) {
+    size_t old_linecount = linecount;
+    linecount += count(chunk.begin(), chunk.end(), '\n');
+    q.push(std::move(chunk));
+    if (linecount / 1000000 != old_linecount / 1000000) {
       cout << "Read: " << linecount << endl;
     }
   }
@@ -229,6 +335,36 @@ size_t read_page_links(WikiData &wikidata, const string& linkfile, const bool in
     t.join(); 
   }
 
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  const size_t links = stats.links, lookups = stats.subject_lookups, reused = stats.subject_reused;
+  cout << "Reading finished, read " << linecount << " lines with " << links << " links in "
+       << seconds << " s (" << (size_t)(links / seconds) << " links/s). Packing links." << endl;
+  cout << "Reused the subject of the previous line " << reused << " times, saved " << reused
+       << " of " << 2 * (lookups + reused) << " label lookups." << endl;
+  builder.build(wikidata, max(1u, thread::hardware_concurrency()), incoming);
+  // the collected links were spread over the arenas of the parser threads,
+  // hand the memory back.
+  malloc_trim(0);
+
+  if (link_order != LinkOrderBuilder::KEEP) {
+    auto start = chrono::steady_clock::now();
+    LinkOrderBuilder(wikidata, max(1u, thread::hardware_concurrency())).build(link_order);
+    cout << "Reordering the link database took " <<
+      chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
+      << " ms." << endl;
+  }
+
+  if (use_components) {
+    auto start = chrono::steady_clock::now();
+    ComponentBuilder(wikidata, max(1u, thread::hardware_concurrency())).build();
+    const Components &components = wikidata.components;
+    cout << "Computing the connected components took " <<
+      chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
+      << " ms: " << components.weak_sizes.size() << " weakly, " << components.strong_sizes.size()
+      << " strongly connected components, using " << components.memory_usage() / (1024.0 * 1024)
+      << " MB." << endl;
+  }
+
   return linecount;
 }
 
@@ -1,26 +1,51 @@
 #include <string>
 
 #include "data.hpp"
+#include "link_order_builder.hpp"
 
-// number of threads for label parsing and insertion
-const size_t NUM_LABEL_THREADS = 2; // change to 4 for best performance with -O0
-// number of threads for page link database insertion
-const size_t ADD_LINK_THREADS = 2;
-// number of threads for page link parsing
+// number of threads for page link parsing. Each collects the links it
+// reads in a LinkBuilder::Buffer of its own.
 const size_t PARSE_LINK_THREADS = 4;
+// number of shards the page links are collected in. Shards are sorted
+// and packed in parallel after reading.
+const size_t LINK_BUILD_SHARDS = 64;
 
+// number of labels stored without a separate label, as they equal their
+// resource with spaces (see read_labels).
 extern size_t nolabel;
 
+// number of threads for label parsing. Each collects its labels separately,
+// they are merged after reading. Defaults to the number of cores.
+extern size_t label_threads;
+
+// number of threads for bz2 decompression. 1 uses the serial libbz2 reader.
+// Defaults to the number of cores.
+extern size_t decompress_threads;
+
+// build WikiData's resource hash index after reading the labels. Speeds
+// up the link import, costs 8 bytes per article. Defaults to true.
+extern bool use_resource_index;
+
+// compute the connected components of the link graph after reading the
+// page links, costs 8 bytes per article. Defaults to true.
+extern bool use_components;
+
+// order of the link database, applied after reading the page links (see
+// LinkOrderBuilder). Defaults to KEEP, the order of the articles.
+extern LinkOrderBuilder::Method link_order;
+
 /**
- * Read all labels from 'labelfile' (in .bz2 format) to the 'labels'
- * vector in wikidata and sort the data afterwards.
+ * Read all labels from 'labelfile' (in .bz2 format) to the labels
+ * of 'wikidata', sorted by resource. Builds the label index, and the
+ * resource index if use_resource_index is set.
  */
 void read_labels(WikiData &wikidata, string labelfile);
 
 /**
- * Read all page links from 'linkfile' (in .bz2 format) to the 'links'
- * database. If incoming is set to 'true', backlinks will be inserted
- * as well.
+ * Read all page links from 'linkfile' (in .bz2 format) to the link
+ * database of 'wikidata', replacing it. If incoming is set to 'true',
+ * backlinks will be inserted as well. Reorders the links by link_order and
+ * computes the connected components if use_components is set.
  */
 size_t read_page_links(WikiData &wikidata, const std::string& linkfile,
                        const bool incoming);
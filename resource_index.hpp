@@ -0,0 +1,199 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <boost/utility/string_ref.hpp>
+
+#include "flat_array.hpp"
+#include "label_store.hpp"
+
+using namespace std;
+
+/**
+ * Open addressing hash index from resources to article ids, speeding up
+ * find_by_resource (binary search in the LabelStore) on the link import
+ * hot path.
+ *
+ * Only article ids are stored (4 bytes per slot, twice as many slots as
+ * articles). A lookup probes linearly from the resource's hash and checks
+ * candidates against the LabelStore, so the index never returns a wrong
+ * article and does not have to store any strings.
+ *
+ * The bits of a slot not needed for the article id hold a few bits of the
+ * resource's hash (a tag), which avoids most of the comparisons with
+ * non-matching resources.
+ */
+class ResourceIndex {
+public:
+  typedef LabelStore::ArticleID ArticleID;
+  static const ArticleID empty_slot = (ArticleID)-1;
+
+  // slots per article
+  static const size_t load_divisor = 2;
+
+  FlatArray<ArticleID> slots;
+
+  ResourceIndex() { }
+  ResourceIndex(const ResourceIndex &other) = delete;
+  ResourceIndex& operator=(const ResourceIndex &other) = delete;
+
+  bool empty() const {
+    return slots.empty();
+  }
+
+  /**
+   * Replaces the index with one for all resources of 'labels'.
+   */
+  void build(const LabelStore &labels) {
+    vector<ArticleID> &table = slots.vec();
+    table.clear();
+    if (!labels.size())
+      return;
+    table.assign(labels.size() * load_divisor, (ArticleID)empty_slot);
+    const unsigned bits = id_bits(labels.size());
+    labels.for_each_resource([&](ArticleID article, boost::string_ref resource) {
+      uint64_t h = hash(resource);
+      size_t i = slot_of(h, table.size());
+      while (table[i] != empty_slot) {
+        i = next(i, table.size());
+      }
+      table[i] = tag_of(h, bits) | article;
+    });
+  }
+
+  void clear() {
+    vector<ArticleID>().swap(slots.vec());
+  }
+
+  /**
+   * True if all used slots hold an article of 'labels' and a slot is
+   * empty, which ends every probe. For indexes not built here (snapshots).
+   */
+  bool valid(const LabelStore &labels) const {
+    const ArticleID id_mask = ((uint64_t)1 << id_bits(labels.size())) - 1;
+    bool has_empty = false;
+    for (ArticleID slot: slots) {
+      if (slot == empty_slot)
+        has_empty = true;
+      else if ((slot & id_mask) >= labels.size())
+        return false;
+    }
+    return has_empty || slots.empty();
+  }
+
+  /**
+   * The article with resource 'key', or -1. Does not allocate.
+   */
+  ArticleID find(const LabelStore &labels, boost::string_ref key) const {
+    const size_t n = slots.size();
+    if (!n)
+      return -1;
+    const unsigned bits = id_bits(labels.size());
+    const ArticleID id_mask = ((uint64_t)1 << bits) - 1;
+    uint64_t h = hash(key);
+    return find_from_slot(labels, key, tag_of(h, bits), id_mask, slot_of(h, n));
+  }
+
+  /**
+   * find() for 'n_keys' keys at once, the results go to 'out'. Works on
+   * groups of keys in stages, prefetching what the next stage reads for
+   * all keys of the group: hashes all keys and prefetches their slots,
+   * then prefetches the block offsets of the articles whose tag matches,
+   * then their blocks, and then compares. The cache misses of a group
+   * overlap instead of each one waiting for the previous.
+   */
+  void find_batch(const LabelStore &labels, const boost::string_ref *keys, size_t n_keys,
+                  ArticleID *out) const {
+    const size_t n = slots.size();
+    if (!n) {
+      fill(out, out + n_keys, (ArticleID)-1);
+      return;
+    }
+    const unsigned bits = id_bits(labels.size());
+    const ArticleID id_mask = ((uint64_t)1 << bits) - 1;
+    uint64_t hashes[batch_group_size];
+    size_t first_slots[batch_group_size];
+    for (size_t g = 0; g < n_keys; g += batch_group_size) {
+      size_t m = n_keys - g;
+      if (m > batch_group_size)
+        m = batch_group_size;
+      const boost::string_ref *group = keys + g;
+      for (size_t j = 0; j < m; ++j) {
+        hashes[j] = hash(group[j]);
+        first_slots[j] = slot_of(hashes[j], n);
+        __builtin_prefetch(&slots[first_slots[j]]);
+      }
+      // the first slot usually holds the article, if the key exists.
+      for (size_t j = 0; j < m; ++j) {
+        ArticleID slot = slots[first_slots[j]];
+        if (slot != empty_slot && (slot & ~id_mask) == tag_of(hashes[j], bits))
+          labels.prefetch_offset(slot & id_mask);
+      }
+      for (size_t j = 0; j < m; ++j) {
+        ArticleID slot = slots[first_slots[j]];
+        if (slot != empty_slot && (slot & ~id_mask) == tag_of(hashes[j], bits))
+          labels.prefetch_resource(slot & id_mask);
+      }
+      for (size_t j = 0; j < m; ++j) {
+        out[g + j] = find_from_slot(labels, group[j], tag_of(hashes[j], bits), id_mask, first_slots[j]);
+      }
+    }
+  }
+
+  size_t memory_usage() const {
+    return slots.size() * sizeof(ArticleID);
+  }
+
+  // FNV-1a with a final mix, slot_of uses the upper bits. Part of the
+  // snapshot format, don't change without increasing SNAPSHOT_VERSION.
+  static uint64_t hash(boost::string_ref s) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (char c: s) {
+      h = (h ^ (unsigned char)c) * 0x100000001b3ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+  }
+
+private:
+  // keys find_batch looks up at once
+  static const size_t batch_group_size = 16;
+
+  // probes the slots from 'i' on for 'key', whose tag is 'tag'.
+  ArticleID find_from_slot(const LabelStore &labels, boost::string_ref key, ArticleID tag,
+                           ArticleID id_mask, size_t i) const {
+    const size_t n = slots.size();
+    ArticleID slot;
+    while ((slot = slots[i]) != empty_slot) {
+      if ((slot & ~id_mask) == tag && labels.resource_equals(slot & id_mask, key))
+        return slot & id_mask;
+      i = next(i, n);
+    }
+    return -1;
+  }
+
+  // bits used for article ids. Ids are always less than 2^bits - 1, so a
+  // used slot never equals empty_slot.
+  static unsigned id_bits(size_t n_articles) {
+    unsigned bits = 1;
+    while (bits < 32 && ((uint64_t)1 << bits) <= n_articles)
+      bits++;
+    return bits;
+  }
+
+  // the lower hash bits, in the slot bits not used by the id
+  static ArticleID tag_of(uint64_t h, unsigned bits) {
+    return bits >= 32 ? 0 : (ArticleID)(h << bits);
+  }
+
+  // maps the hash to [0, n) without a division.
+  static size_t slot_of(uint64_t h, size_t n) {
+    return (size_t)(((unsigned __int128)h * n) >> 64);
+  }
+
+  static size_t next(size_t i, size_t n) {
+    return i + 1 == n ? 0 : i + 1;
+  }
+};
@@ -0,0 +1,407 @@
+#include "snapshot.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const char snapshot_magic[8] = { 'W', 'D', 'B', 'S', 'N', 'A', 'P', '\0' };
+const uint32_t byte_order_mark = 0x01020304;
+
+// order of the sections in the section table.
+enum Section {
+  LABEL_INFO,
+  RESOURCE_BLOCK_OFFSETS,
+  RESOURCE_DATA,
+  CUSTOM_LABEL_IDS,
+  CUSTOM_LABEL_OFFSETS,
+  CUSTOM_LABEL_DATA,
+  RESOURCE_INDEX,
+  LABEL_INDEX,
+  LABEL_INDEX_SAMPLES,
+  LINK_OFFSETS,
+  LINK_TARGETS,
+  INLINK_OFFSETS,
+  INLINK_SOURCES,
+  COMPRESSED_LINK_OFFSETS,
+  COMPRESSED_LINK_DATA,
+  VERTEX_ARTICLES,
+  ARTICLE_VERTICES,
+  WEAK_COMPONENTS,
+  STRONG_COMPONENTS,
+  WEAK_COMPONENT_SIZES,
+  STRONG_COMPONENT_SIZES,
+  DISTANCE_OUT_OFFSETS,
+  DISTANCE_OUT_HUBS,
+  DISTANCE_OUT_DISTANCES,
+  DISTANCE_IN_OFFSETS,
+  DISTANCE_IN_HUBS,
+  DISTANCE_IN_DISTANCES,
+  LANDMARK_ARTICLES,
+  LANDMARK_DISTANCES,
+  N_SECTIONS
+};
+
+// room for sections of future versions without changing the header size.
+const size_t max_sections = 32;
+
+struct SectionEntry {
+  uint64_t offset;     // from the start of the file
+  uint64_t count;      // number of elements
+  uint32_t element_size;
+  uint32_t reserved;
+  uint64_t checksum;   // of the count * element_size bytes at offset
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t file_size;
+  uint32_t n_sections;
+  uint32_t reserved;
+  SectionEntry sections[max_sections];
+  uint64_t header_checksum; // of all fields above
+};
+
+
+// calls visitor(section, array) for all arrays of 'wikidata' (WikiData or
+// const WikiData) stored in a snapshot.
+template<typename Data, typename Visitor>
+void visit_sections(Data &wikidata, Visitor &visitor) {
+  visitor(LABEL_INFO, wikidata.labels.info);
+  visitor(RESOURCE_BLOCK_OFFSETS, wikidata.labels.resource_block_offsets);
+  visitor(RESOURCE_DATA, wikidata.labels.resource_data);
+  visitor(CUSTOM_LABEL_IDS, wikidata.labels.custom_label_ids);
+  visitor(CUSTOM_LABEL_OFFSETS, wikidata.labels.custom_label_offsets);
+  visitor(CUSTOM_LABEL_DATA, wikidata.labels.custom_label_data);
+  visitor(RESOURCE_INDEX, wikidata.resource_index.slots);
+  visitor(LABEL_INDEX, wikidata.label_index.ids);
+  visitor(LABEL_INDEX_SAMPLES, wikidata.label_index.samples);
+  visitor(LINK_OFFSETS, wikidata.link_offsets);
+  visitor(LINK_TARGETS, wikidata.link_targets);
+  visitor(INLINK_OFFSETS, wikidata.inlink_offsets);
+  visitor(INLINK_SOURCES, wikidata.inlink_sources);
+  visitor(COMPRESSED_LINK_OFFSETS, wikidata.compressed_links.offsets);
+  visitor(COMPRESSED_LINK_DATA, wikidata.compressed_links.data);
+  visitor(VERTEX_ARTICLES, wikidata.vertex_articles);
+  visitor(ARTICLE_VERTICES, wikidata.article_vertices);
+  visitor(WEAK_COMPONENTS, wikidata.components.weak);
+  visitor(STRONG_COMPONENTS, wikidata.components.strong);
+  visitor(WEAK_COMPONENT_SIZES, wikidata.components.weak_sizes);
+  visitor(STRONG_COMPONENT_SIZES, wikidata.components.strong_sizes);
+  visitor(DISTANCE_OUT_OFFSETS, wikidata.distance_index.out.offsets);
+  visitor(DISTANCE_OUT_HUBS, wikidata.distance_index.out.hubs);
+  visitor(DISTANCE_OUT_DISTANCES, wikidata.distance_index.out.distances);
+  visitor(DISTANCE_IN_OFFSETS, wikidata.distance_index.in.offsets);
+  visitor(DISTANCE_IN_HUBS, wikidata.distance_index.in.hubs);
+  visitor(DISTANCE_IN_DISTANCES, wikidata.distance_index.in.distances);
+  visitor(LANDMARK_ARTICLES, wikidata.landmarks.articles);
+  visitor(LANDMARK_DISTANCES, wikidata.landmarks.distances);
+}
+
+
+// 64 bit multiply/xorshift hash over four independent lanes, fast enough to
+// run at memory bandwidth.
+uint64_t checksum(const void *data, size_t size) {
+  const uint64_t prime = 0x9E3779B97F4A7C15ull;
+  const unsigned char *p = static_cast<const unsigned char*>(data);
+  uint64_t lanes[4] = { 1, 2, 3, 4 };
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    for (size_t l = 0; l < 4; ++l) {
+      uint64_t w;
+      memcpy(&w, p + i + 8 * l, 8);
+      lanes[l] = (lanes[l] ^ w) * prime;
+      lanes[l] ^= lanes[l] >> 29;
+    }
+  }
+  uint64_t h = size;
+  for (size_t l = 0; l < 4; ++l) {
+    h = (h ^ lanes[l]) * prime;
+  }
+  for (; i < size; ++i) {
+    h = (h ^ p[i]) * prime;
+  }
+  return h ^ (h >> 32);
+}
+
+
+size_t align(size_t pos) {
+  return (pos + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+
+struct SectionLayout {
+  Header &header;
+  size_t pos;
+
+  template<typename T>
+  void operator()(Section s, const FlatArray<T> &array) {
+    SectionEntry &entry = header.sections[s];
+    pos = align(pos);
+    entry.offset = pos;
+    entry.count = array.size();
+    entry.element_size = sizeof(T);
+    entry.checksum = checksum(array.data(), array.size() * sizeof(T));
+    pos += array.size() * sizeof(T);
+  }
+};
+
+
+struct SectionMapper {
+  const Header &header;
+  const char *base;
+  const string &invalid;
+
+  template<typename T>
+  void operator()(Section s, FlatArray<T> &array) {
+    const SectionEntry &entry = header.sections[s];
+    if (entry.element_size != sizeof(T))
+      throw std::runtime_error(invalid + "unexpected element size in section " + to_string(s));
+    array.map(reinterpret_cast<const T*>(base + entry.offset), entry.count);
+  }
+};
+
+
+class File {
+  FILE *f;
+public:
+  File(const string &filename, const char *mode) : f(fopen(filename.c_str(), mode)) {
+    if (!f)
+      throw std::runtime_error("Cannot open " + filename + ": " + strerror(errno));
+  }
+  ~File() {
+    if (f)
+      fclose(f);
+  }
+
+  void write(const void *data, size_t size) {
+    if (size && fwrite(data, 1, size, f) != size)
+      throw std::runtime_error(string("Writing snapshot failed: ") + strerror(errno));
+  }
+
+  void pad_to(size_t pos) {
+    static const char zeros[SNAPSHOT_ALIGNMENT] = { 0 };
+    long current = ftell(f);
+    if (current < 0 || (size_t)current > pos)
+      throw std::runtime_error("Writing snapshot failed: bad file position");
+    write(zeros, pos - current);
+  }
+
+  void close() {
+    FILE *tmp = f;
+    f = nullptr;
+    if (fclose(tmp) != 0)
+      throw std::runtime_error(string("Writing snapshot failed: ") + strerror(errno));
+  }
+};
+
+
+struct SectionWriter {
+  File &out;
+  const Header &header;
+
+  template<typename T>
+  void operator()(Section s, const FlatArray<T> &array) {
+    out.pad_to(header.sections[s].offset);
+    out.write(array.data(), array.size() * sizeof(T));
+  }
+};
+
+
+// throws unless 'array' (with one entry per element plus one) describes
+// consecutive ranges within 'data_size'.
+template<typename T>
+void check_offsets(const FlatArray<T> &array, uint64_t data_size, const string &what) {
+  if (array.empty())
+    return;
+  if (array[0] != 0 || array.back() != data_size)
+    throw std::runtime_error("Invalid snapshot: inconsistent " + what);
+  for (size_t i = 1; i < array.size(); ++i) {
+    if (array[i] < array[i - 1])
+      throw std::runtime_error("Invalid snapshot: inconsistent " + what);
+  }
+}
+
+// throws unless all ids in 'array' are less than 'bound'.
+template<typename T>
+void check_ids(const FlatArray<T> &array, uint64_t bound, const string &what) {
+  for (T id: array) {
+    if (id >= bound)
+      throw std::runtime_error("Invalid snapshot: inconsistent " + what);
+  }
+}
+
+} // namespace
+
+
+void save_snapshot(const WikiData &wikidata, const string &filename) {
+  Header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+  header.version = SNAPSHOT_VERSION;
+  header.byte_order = byte_order_mark;
+  header.n_sections = N_SECTIONS;
+
+  SectionLayout layout = { header, sizeof(header) };
+  visit_sections(wikidata, layout);
+  header.file_size = layout.pos;
+  header.header_checksum = checksum(&header, offsetof(Header, header_checksum));
+
+  string tmpname = filename + ".tmp";
+  try {
+    File out(tmpname, "wb");
+    out.write(&header, sizeof(header));
+    SectionWriter writer = { out, header };
+    visit_sections(wikidata, writer);
+    out.close();
+  } catch (const std::runtime_error &) {
+    remove(tmpname.c_str());
+    throw;
+  }
+  if (rename(tmpname.c_str(), filename.c_str()) != 0) {
+    remove(tmpname.c_str());
+    throw std::runtime_error("Cannot rename snapshot to " + filename + ": " + strerror(errno));
+  }
+}
+
+
+void load_snapshot(WikiData &wikidata, const string &filename, bool verify_checksums) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("Cannot open " + filename + ": " + strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw std::runtime_error("Cannot stat " + filename + ": " + strerror(errno));
+  }
+  size_t size = st.st_size;
+  if (size < sizeof(Header)) {
+    close(fd);
+    throw std::runtime_error("Invalid snapshot " + filename + ": file too small");
+  }
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED)
+    throw std::runtime_error("Cannot map " + filename + ": " + strerror(errno));
+  shared_ptr<const void> mapping(addr, [size](const void *p) {
+    munmap(const_cast<void*>(p), size);
+  });
+  const char *base = static_cast<const char*>(addr);
+
+  Header header;
+  memcpy(&header, base, sizeof(header));
+  string invalid = "Invalid snapshot " + filename + ": ";
+  if (memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic)) != 0)
+    throw std::runtime_error(invalid + "not a snapshot file");
+  if (header.byte_order != byte_order_mark)
+    throw std::runtime_error(invalid + "written on a machine with different byte order");
+  if (header.version != SNAPSHOT_VERSION)
+    throw std::runtime_error(invalid + "version " + to_string(header.version) +
+        ", expected " + to_string(SNAPSHOT_VERSION) + ". Please recreate it.");
+  if (header.header_checksum != checksum(&header, offsetof(Header, header_checksum)))
+    throw std::runtime_error(invalid + "header checksum mismatch");
+  if (header.file_size != size)
+    throw std::runtime_error(invalid + "expected " + to_string(header.file_size) +
+        " bytes, found " + to_string(size) + " (truncated?)");
+  if (header.n_sections != N_SECTIONS)
+    throw std::runtime_error(invalid + "unexpected number of sections");
+
+  for (size_t s = 0; s < N_SECTIONS; ++s) {
+    const SectionEntry &entry = header.sections[s];
+    if (entry.offset % SNAPSHOT_ALIGNMENT || entry.offset > size ||
+        entry.count > (size - entry.offset) / max((uint32_t)1, entry.element_size))
+      throw std::runtime_error(invalid + "section " + to_string(s) + " out of bounds");
+    if (verify_checksums &&
+        entry.checksum != checksum(base + entry.offset, entry.count * entry.element_size))
+      throw std::runtime_error(invalid + "checksum mismatch in section " + to_string(s));
+  }
+
+  WikiData loaded;
+  SectionMapper mapper = { header, base, invalid };
+  visit_sections(loaded, mapper);
+  const LabelStore &labels = loaded.labels;
+  if (labels.info.size() != 0 && labels.info.size() != 2)
+    throw std::runtime_error(invalid + "inconsistent labels");
+  size_t bs = labels.block_size();
+  if (!bs || labels.resource_block_offsets.size() !=
+      (labels.info.empty() ? 0 : (labels.size() + bs - 1) / bs + 1))
+    throw std::runtime_error(invalid + "inconsistent labels");
+  check_offsets(labels.resource_block_offsets, labels.resource_data.size(), "labels");
+  check_offsets(labels.custom_label_offsets, labels.custom_label_data.size(), "labels");
+  if (labels.custom_label_offsets.size() != labels.custom_label_ids.size() + (labels.info.empty() ? 0 : 1))
+    throw std::runtime_error(invalid + "inconsistent labels");
+  // the arrays below are indexed by what they store, so their content is
+  // checked as well (checksums are only compared with 'verify_checksums').
+  if (!labels.blocks_valid())
+    throw std::runtime_error(invalid + "inconsistent labels");
+  if (loaded.resource_index.slots.size() &&
+      (loaded.resource_index.slots.size() != labels.size() * ResourceIndex::load_divisor ||
+       !loaded.resource_index.valid(labels)))
+    throw std::runtime_error(invalid + "inconsistent resource index");
+  const LabelIndex &label_index = loaded.label_index;
+  if (label_index.ids.size() && (label_index.ids.size() != labels.size() ||
+      label_index.samples.size() != (labels.size() + LabelIndex::sample_step - 1) /
+        LabelIndex::sample_step * LabelIndex::sample_length))
+    throw std::runtime_error(invalid + "inconsistent label index");
+  check_ids(label_index.ids, labels.size(), "label index");
+  const CompressedLinks &compressed = loaded.compressed_links;
+  if (compressed.empty()) {
+    check_offsets(loaded.link_offsets, loaded.link_targets.size(), "links");
+  } else {
+    check_offsets(loaded.link_offsets, loaded.link_count(), "links");
+    if (loaded.link_targets.size() || compressed.offsets.size() != loaded.link_offsets.size() ||
+        compressed.data.size() < CompressedLinks::padding)
+      throw std::runtime_error(invalid + "inconsistent compressed links");
+    check_offsets(compressed.offsets, compressed.data.size() - CompressedLinks::padding, "links");
+    if (!compressed.valid(loaded.link_offsets, loaded.linkdb_size()))
+      throw std::runtime_error(invalid + "inconsistent compressed links");
+  }
+  check_offsets(loaded.inlink_offsets, loaded.inlink_sources.size(), "links");
+  if (loaded.has_incoming_links() && loaded.inlink_offsets.size() != loaded.link_offsets.size())
+    throw std::runtime_error(invalid + "incoming links do not match the outgoing ones");
+  check_ids(loaded.link_targets, loaded.linkdb_size(), "links");
+  check_ids(loaded.inlink_sources, loaded.linkdb_size(), "links");
+  if (loaded.linkdb_size() && loaded.linkdb_size() != loaded.label_count())
+    throw std::runtime_error(invalid + "link database does not match the labels");
+  if (loaded.vertex_articles.size() != loaded.article_vertices.size() ||
+      (loaded.is_reordered() && loaded.vertex_articles.size() != loaded.linkdb_size()))
+    throw std::runtime_error(invalid + "inconsistent link order");
+  for (size_t v = 0; v < loaded.vertex_articles.size(); ++v) {
+    WikiData::ArticleID a = loaded.vertex_articles[v];
+    if (a >= loaded.article_vertices.size() || loaded.article_vertices[a] != v)
+      throw std::runtime_error(invalid + "inconsistent link order");
+  }
+  const Components &components = loaded.components;
+  if (components.weak.size() != components.strong.size() ||
+      (components.weak.size() && components.weak.size() != loaded.linkdb_size()))
+    throw std::runtime_error(invalid + "inconsistent connected components");
+  for (const DistanceIndex::Labels *labels: { &loaded.distance_index.out, &loaded.distance_index.in }) {
+    if (labels->hubs.size() != labels->distances.size() ||
+        labels->offsets.size() != loaded.distance_index.out.offsets.size() ||
+        (labels->offsets.size() && labels->offsets.size() != loaded.linkdb_size() + 1))
+      throw std::runtime_error(invalid + "inconsistent distance index");
+    check_offsets(labels->offsets, labels->hubs.size(), "distance index");
+  }
+  const Landmarks &landmarks = loaded.landmarks;
+  if (landmarks.distances.size() != landmarks.size() * 2 * loaded.linkdb_size())
+    throw std::runtime_error(invalid + "inconsistent landmarks");
+  for (Landmarks::ArticleID a: landmarks.articles) {
+    if (a >= loaded.linkdb_size())
+      throw std::runtime_error(invalid + "inconsistent landmarks");
+  }
+
+  visit_sections(wikidata, mapper);
+  wikidata.mapping = mapping;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+
+#include "data.hpp"
+
+/**
+ * Binary snapshots of a loaded database.
+ *
+ * A snapshot starts with a header (magic, format version, byte order,
+ * file size and a table of sections), followed by the arrays of WikiData,
+ * each aligned to SNAPSHOT_ALIGNMENT bytes. Every section has its own
+ * checksum, the header has one over itself including the section table.
+ *
+ * Increase SNAPSHOT_VERSION whenever the layout or the meaning of a
+ * section changes; older snapshots are rejected then.
+ */
+const uint32_t SNAPSHOT_VERSION = 11;
+const size_t SNAPSHOT_ALIGNMENT = 64;
+
+/**
+ * Writes the labels and links of 'wikidata' to 'filename'. The file is
+ * written under a temporary name first and renamed when complete.
+ * Throws std::runtime_error on I/O errors.
+ */
+void save_snapshot(const WikiData &wikidata, const std::string &filename);
+
+/**
+ * Maps the snapshot 'filename' read-only and points the arrays of
+ * 'wikidata' to it, so startup does not depend on the database size and
+ * the pages are shared with other processes using the same snapshot.
+ *
+ * The header, the file size and the section boundaries are always checked,
+ * and so are the arrays used as indexes into others (offsets ascending,
+ * link targets and article ids in range, label blocks decodable), so a
+ * corrupted snapshot can't make queries read out of bounds. That is one
+ * pass over most of the file. 'verify_checksums' additionally checks the
+ * checksum of every section.
+ * Throws std::runtime_error if the snapshot is invalid, truncated or of
+ * a different version.
+ */
+void load_snapshot(WikiData &wikidata, const std::string &filename,
+                   bool verify_checksums = false);
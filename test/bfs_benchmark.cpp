@@ -0,0 +1,236 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <set>
+#include <functional>
+#include "../data.hpp"
+#include "../link_builder.hpp"
+#include "../graph_bfs.hpp"
+#include "../parallel_bfs.hpp"
+#include "../component_builder.hpp"
+#include "../landmark_builder.hpp"
+
+using namespace std;
+
+/**
+ * Time of a complete traversal (a path query without result) with GraphBFS
+ * and ParallelBFS on a synthetic graph with incoming links, and of short
+ * path queries with and without reusing the search workspaces, and with
+ * ParallelBFS as the CLI runs them. Also
+ * measures the cost of the exclusion test per link and the time to compute
+ * the connected components, and the articles visited by path queries
+ * between random articles with BFS, bidirectional BFS and A* on landmarks.
+ * Finally compares the raw and the compressed outgoing links: size, decode
+ * speed (scalar and SSSE3) and full traversals.
+ * Usage: bfs_benchmark [number of articles] [links per article]
+ */
+
+const size_t n_queries = 5;
+
+// links with a skewed target distribution: half of them go to the first
+// 1% of the articles, like links to popular pages. The last article has no
+// links, so paths to it don't exist.
+void make_graph(WikiData &data, size_t n, size_t degree, mt19937 &rng) {
+  LinkBuilder links(n, 64);
+  const size_t hubs = max((size_t)1, n / 100);
+  for (size_t i = 0; i < (n - 1) * degree; ++i) {
+    WikiData::ArticleID from = rng() % (n - 1);
+    WikiData::ArticleID to = rng() % 2 ? rng() % hubs : rng() % (n - 1);
+    links.add_link_unsafe(from, to);
+  }
+  links.build(data, thread::hardware_concurrency(), true);
+}
+
+template<typename F>
+double run(const string &name, F query, double baseline = 0, size_t queries = n_queries) {
+  auto start = chrono::steady_clock::now();
+  for (size_t i = 0; i < queries; ++i) {
+    query(i);
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count() / queries;
+  cout << setw(40) << left << name
+       << setw(8) << right << fixed << setprecision(3) << seconds * 1000 << " ms/query";
+  if (baseline)
+    cout << setw(8) << setprecision(2) << baseline / seconds << "x";
+  cout << endl;
+  return seconds;
+}
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? stoul(argv[1]) : 2000000;
+  size_t degree = argc > 2 ? stoul(argv[2]) : 10;
+  mt19937 rng(42);
+  WikiData data;
+  make_graph(data, n, degree, rng);
+  cout << n << " articles, " << data.link_count() << " links, "
+       << thread::hardware_concurrency() << " cores" << endl;
+
+  const WikiData::ArticleID unreachable = n - 1;
+  GraphBFS::ArticleSet exclude;
+  double baseline = run("GraphBFS::next()", [&](size_t i) {
+    GraphBFS bfs(data, exclude, i, unreachable);
+    bfs.next();
+  });
+
+  vector<size_t> thread_counts = { 1, 2, 4 };
+  if (thread::hardware_concurrency() > 4)
+    thread_counts.push_back(thread::hardware_concurrency());
+  for (bool direction_optimizing: {false, true}) {
+    for (size_t threads: thread_counts) {
+      ParallelBFS bfs(data, threads);
+      bfs.direction_optimizing = direction_optimizing;
+      string name = string(direction_optimizing ? "ParallelBFS" : "ParallelBFS top-down") +
+        ", " + to_string(threads) + " threads";
+      run(name, [&](size_t i) { bfs.path(i, unreachable, exclude); }, baseline);
+      if (threads == 1) {
+        cout << "  (" << bfs.last_stats().visited << " visited, "
+             << bfs.last_stats().top_down_levels << " top-down, "
+             << bfs.last_stats().bottom_up_levels << " bottom-up levels)" << endl;
+      }
+    }
+  }
+
+  // targets two links away from the source.
+  const size_t n_short = 1000;
+  vector<pair<WikiData::ArticleID, WikiData::ArticleID>> short_queries;
+  while (short_queries.size() < n_short) {
+    WikiData::ArticleID from = rng() % (n - 1);
+    vector<WikiData::Pagelink> outs = data.get_links(from);
+    if (outs.empty())
+      continue;
+    vector<WikiData::Pagelink> next = data.get_links(WikiData::to_ArticleID(outs[rng() % outs.size()]));
+    if (next.empty())
+      continue;
+    short_queries.push_back(make_pair(from, WikiData::to_ArticleID(next[rng() % next.size()])));
+  }
+  double fresh = run("GraphBFS, short, new workspace", [&](size_t i) {
+    BFSWorkspacePool pool;
+    GraphBFS bfs(data, exclude, short_queries[i].first, short_queries[i].second, false, pool);
+    bfs.next();
+  }, 0, n_short);
+  run("GraphBFS, short, pooled workspace", [&](size_t i) {
+    GraphBFS bfs(data, exclude, short_queries[i].first, short_queries[i].second);
+    bfs.next();
+  }, fresh, n_short);
+  // what the CLI runs for 'path' without incoming links and for 'distance'
+  // without the distance index.
+  ParallelBFS short_bfs(data, max(1u, thread::hardware_concurrency()));
+  run("ParallelBFS::path(), short (CLI path)", [&](size_t i) {
+    short_bfs.path(short_queries[i].first, short_queries[i].second, exclude);
+  }, fresh, n_short);
+
+  // random pairs of articles, with the number of articles each search visits.
+  const size_t n_random = 100;
+  vector<pair<WikiData::ArticleID, WikiData::ArticleID>> random_queries;
+  while (random_queries.size() < n_random) {
+    WikiData::ArticleID from = rng() % (n - 1), to = rng() % (n - 1);
+    if (from != to)
+      random_queries.push_back(make_pair(from, to));
+  }
+  size_t visited = 0;
+  auto report_visited = [&]() {
+    cout << "  (" << visited / n_random << " articles visited per query)" << endl;
+    visited = 0;
+  };
+  double bfs_random = run("GraphBFS, random pairs", [&](size_t i) {
+    GraphBFS bfs(data, exclude, random_queries[i].first, random_queries[i].second);
+    bfs.next();
+    visited += bfs.visited_count();
+  }, 0, n_random);
+  report_visited();
+  run("BidirectionalBFS, random pairs", [&](size_t i) {
+    BidirectionalBFS bfs(data, exclude, random_queries[i].first, random_queries[i].second);
+    bfs.next();
+    visited += bfs.visited_count();
+  }, bfs_random, n_random);
+  report_visited();
+  for (size_t k: {4, 16}) {
+    auto start = chrono::steady_clock::now();
+    LandmarkBuilder(data, k, thread::hardware_concurrency()).build(data.landmarks);
+    cout << setw(40) << left << to_string(k) + " landmarks" << setw(8) << right << setprecision(1)
+         << chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1000 << " ms" << endl;
+    run("LandmarkSearch (A*), " + to_string(k) + " landmarks", [&](size_t i) {
+      LandmarkSearch search(data, exclude, random_queries[i].first, random_queries[i].second);
+      search.next();
+      visited += search.visited_count();
+    }, bfs_random, n_random);
+    report_visited();
+  }
+
+  auto start = chrono::steady_clock::now();
+  ComponentBuilder(data, thread::hardware_concurrency()).build();
+  cout << setw(40) << left << "connected components" << setw(8) << right << setprecision(1)
+       << chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1000 << " ms  ("
+       << data.components.weak_sizes.size() << " weak, " << data.components.strong_sizes.size()
+       << " strong)" << endl;
+
+  // the exclusion test per link, with 1% of the articles excluded.
+  set<WikiData::ArticleID> tree;
+  ArticleBitset bitset;
+  for (size_t i = 0; i < n / 100; ++i) {
+    WikiData::ArticleID a = rng() % n;
+    tree.insert(a);
+    bitset.insert(a);
+  }
+  auto per_link = [&](const string &name, function<size_t(WikiData::ArticleID)> excluded) {
+    auto start = chrono::steady_clock::now();
+    size_t found = 0;
+    for (WikiData::ArticleID a: data.link_targets) {
+      found += excluded(a);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << setw(40) << left << name << setw(8) << right << setprecision(2)
+         << seconds * 1e9 / data.link_targets.size() << " ns/link  (" << found << " excluded)" << endl;
+  };
+  per_link("exclusion test, std::set", [&](WikiData::ArticleID a) { return tree.count(a); });
+  per_link("exclusion test, ArticleBitset", [&](WikiData::ArticleID a) { return bitset.count(a); });
+
+  size_t raw_bytes = data.link_targets.size() * sizeof(WikiData::ArticleID);
+  start = chrono::steady_clock::now();
+  data.compress_links();
+  cout << setw(40) << left << "compressing the links" << setw(8) << right << setprecision(1)
+       << chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1000 << " ms  ("
+       << raw_bytes / 1000000 << " MB -> " << data.compressed_links.memory_usage() / 1000000
+       << " MB, " << setprecision(2) << data.compressed_links.data.size() * 8.0 / data.link_count()
+       << " bits/link)" << endl;
+  auto decode_all = [&](const string &name,
+      function<void(size_t, size_t, vector<WikiData::ArticleID>&)> decode) {
+    vector<WikiData::ArticleID> buffer;
+    uint64_t sum = 0;
+    auto start = chrono::steady_clock::now();
+    for (WikiData::ArticleID a = 0; a < n; ++a) {
+      decode(a, data.outlink_count(a), buffer);
+      for (WikiData::ArticleID target: buffer) {
+        sum += target;
+      }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << setw(40) << left << name << setw(8) << right << setprecision(0)
+         << data.link_count() / seconds / 1e6 << " M links/s  (checksum " << sum << ")" << endl;
+  };
+  decode_all("decode, scalar", [&](size_t list, size_t count, vector<WikiData::ArticleID> &out) {
+    data.compressed_links.decode_scalar(list, count, out);
+  });
+#ifdef COMPRESSED_LINKS_SSSE3
+  if (__builtin_cpu_supports("ssse3")) {
+    decode_all("decode, SSSE3", [&](size_t list, size_t count, vector<WikiData::ArticleID> &out) {
+      data.compressed_links.decode_ssse3(list, count, out);
+    });
+  }
+#endif
+  run("GraphBFS::next(), compressed links", [&](size_t i) {
+    GraphBFS bfs(data, exclude, i, unreachable);
+    bfs.next();
+  }, baseline);
+  for (size_t threads: thread_counts) {
+    ParallelBFS bfs(data, threads);
+    run("ParallelBFS, " + to_string(threads) + " threads, compressed", [&](size_t i) {
+      bfs.path(i, unreachable, exclude);
+    }, baseline);
+  }
+  return 0;
+}
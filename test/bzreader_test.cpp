@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <cstdio>
+#include <random>
+#include "../bzreader.hpp"
+
+
+namespace {
+
+// some n-triples like lines, plus a few long runs of a single character.
+string make_input(size_t lines, unsigned seed) {
+  mt19937 rng(seed);
+  string ret;
+  for (size_t i = 0; i < lines; ++i) {
+    ret += "<http://dbpedia.org/resource/Article_" + to_string(rng()) +
+      "> <http://www.w3.org/2000/01/rdf-schema#label> \"Article " +
+      to_string(rng() % 100000) + "\"@en .\n";
+    if (i % 5000 == 0) {
+      ret += string(rng() % 300, 'x') + "\n";
+    }
+  }
+  return ret;
+}
+
+
+string compress(const string &in, int block_size_100k) {
+  vector<char> out(in.size() * 1.01 + 600);
+  unsigned int out_size = out.size();
+  int ret = BZ2_bzBuffToBuffCompress(out.data(), &out_size, const_cast<char*>(in.data()),
+                                     in.size(), block_size_100k, 0, 0);
+  if (ret != BZ_OK)
+    throw std::runtime_error("compression failed");
+  return string(out.data(), out_size);
+}
+
+
+class BzReaderTest : public ::testing::Test {
+protected:
+  void TearDown() {
+    remove(filename.c_str());
+  }
+
+  void write_file(const string &content) {
+    FILE *f = fopen(filename.c_str(), "w");
+    ASSERT_TRUE(f != NULL);
+    ASSERT_EQ(content.size(), fwrite(content.data(), 1, content.size(), f));
+    fclose(f);
+  }
+
+  vector<string> read_all(size_t threads) {
+    vector<string> lines;
+    BzReader r(filename, threads);
+    while (!r.done()) {
+      string line = r.readline();
+      // readline() reserves 4k per line, don't keep that around.
+      lines.push_back(string(line.begin(), line.end()));
+    }
+    return lines;
+  }
+
+  vector<string> read_all_chunked(size_t threads, size_t chunk_size) {
+    vector<string> lines;
+    BzReader r(filename, threads);
+    string chunk;
+    while (r.read_chunk(chunk, chunk_size)) {
+      EXPECT_TRUE(chunk.size() >= chunk_size || r.done());
+      EXPECT_TRUE(chunk[chunk.size() - 1] == '\n' || r.done());
+      LineSplitter splitter(chunk);
+      boost::string_ref line;
+      while (splitter.next(line)) {
+        lines.push_back(string(line.begin(), line.end()));
+      }
+    }
+    EXPECT_TRUE(r.done());
+    return lines;
+  }
+
+  static vector<string> split_lines(const string &in) {
+    vector<string> ret;
+    size_t start = 0;
+    for (size_t i = 0; i < in.size(); ++i) {
+      if (in[i] == '\n') {
+        ret.push_back(in.substr(start, i - start));
+        start = i + 1;
+      }
+    }
+    return ret;
+  }
+
+  // the readers may return a trailing empty line at the end of the file.
+  static void strip_trailing_empty(vector<string> &lines) {
+    while (lines.size() && lines.back().empty())
+      lines.pop_back();
+  }
+
+  void expect_identical(const string &plain) {
+    vector<string> expected = split_lines(plain);
+    vector<string> serial = read_all(1);
+    vector<string> parallel = read_all(4);
+    strip_trailing_empty(serial);
+    strip_trailing_empty(parallel);
+    EXPECT_EQ(expected.size(), serial.size());
+    EXPECT_TRUE(expected == serial);
+    EXPECT_EQ(expected.size(), parallel.size());
+    EXPECT_TRUE(expected == parallel);
+  }
+
+  string decompress_parallel(size_t threads) {
+    ParallelBzDecompressor decompressor(filename, threads);
+    string ret, block;
+    while (decompressor.next_block(block)) {
+      ret += block;
+    }
+    return ret;
+  }
+
+  // true if the block magic starts at bit 'pos' of 'data'.
+  static bool block_magic_at(const string &data, size_t pos) {
+    uint64_t v = 0;
+    for (size_t bit = pos; bit < pos + 48; ++bit) {
+      v = (v << 1) | (((uint8_t)data[bit / 8] >> (7 - bit % 8)) & 1);
+    }
+    return v == 0x314159265359ULL;
+  }
+
+  string filename = "bzreader_test.tmp.bz2";
+};
+
+
+TEST_F(BzReaderTest, SingleStreamManyBlocks) {
+  string plain = make_input(50000, 1);
+  write_file(compress(plain, 1));
+  expect_identical(plain);
+}
+
+
+TEST_F(BzReaderTest, MultipleStreams) {
+  string a = make_input(20000, 2);
+  string b = make_input(100, 3);
+  string c = make_input(30000, 4);
+  write_file(compress(a, 1) + compress(b, 9) + compress(c, 2));
+  expect_identical(a + b + c);
+}
+
+
+TEST_F(BzReaderTest, Chunks) {
+  string plain = make_input(20000, 5);
+  write_file(compress(plain, 1));
+  vector<string> expected = split_lines(plain);
+  EXPECT_TRUE(expected == read_all_chunked(1, 1 << 16));
+  EXPECT_TRUE(expected == read_all_chunked(4, 1 << 16));
+  EXPECT_TRUE(expected == read_all_chunked(4, 1 << 22));
+  // lines longer than the chunk size
+  EXPECT_TRUE(expected == read_all_chunked(1, 10));
+}
+
+
+TEST_F(BzReaderTest, SmallFile) {
+  string plain = "a single line\n";
+  write_file(compress(plain, 9));
+  expect_identical(plain);
+}
+
+
+TEST_F(BzReaderTest, FalseBlockMagic) {
+  // the symbol map of a block (which byte values it contains) starts 105
+  // bits after its block magic. With exactly these byte values it reads as
+  // another block magic, so every block is cut in two and has to be merged
+  // again. No runs, they would add run lengths to the symbols.
+  const string alphabet = "!#$'*-.13679;<?\x70\x90\xF0";
+  mt19937 rng(6);
+  string plain;
+  for (size_t i = 0; i < 300000; ++i) {
+    char c;
+    do {
+      c = alphabet[rng() % alphabet.size()];
+    } while (plain.size() && c == plain.back());
+    plain += c;
+  }
+  string compressed = compress(plain, 1);
+  ASSERT_TRUE(block_magic_at(compressed, 32));
+  ASSERT_TRUE(block_magic_at(compressed, 32 + 105));
+  write_file(compressed);
+  EXPECT_TRUE(plain == decompress_parallel(1));
+  EXPECT_TRUE(plain == decompress_parallel(4));
+}
+
+
+TEST_F(BzReaderTest, RejectsOversizedBlock) {
+  // stream header and block magic, followed by 3 MB without any magic.
+  string compressed = compress("a single line\n", 9).substr(0, 10);
+  mt19937 rng(7);
+  for (size_t i = 0; i < (3 << 20); ++i) {
+    compressed += (char)rng();
+  }
+  write_file(compressed);
+  try {
+    decompress_parallel(4);
+    FAIL() << "no exception";
+  } catch (std::runtime_error &e) {
+    EXPECT_THAT(e.what(), ::testing::HasSubstr("larger than"));
+  }
+}
+
+
+TEST_F(BzReaderTest, RejectsNonBzipFile) {
+  write_file("this is not compressed\n");
+  EXPECT_THROW(BzReader(filename, 4), std::runtime_error);
+}
+
+}; // namespace
+
+int main(int argc, char ** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+};
@@ -0,0 +1,78 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include "../data.hpp"
+#include "../link_builder.hpp"
+#include "../graph_bfs.hpp"
+#include "../distance_index_builder.hpp"
+
+using namespace std;
+
+/**
+ * Build time and size of the distance index on a synthetic graph, and the
+ * time of distance queries compared to a bidirectional BFS.
+ * Usage: distance_benchmark [number of articles] [links per article] [threads]
+ *
+ * The link targets are random apart from a skew towards the first 1% of
+ * the articles, which gives much less hub structure than real link graphs
+ * have; labels get larger than on those.
+ */
+
+const size_t n_queries = 10000;
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? stoul(argv[1]) : 20000;
+  size_t degree = argc > 2 ? stoul(argv[2]) : 5;
+  size_t threads = argc > 3 ? stoul(argv[3]) : thread::hardware_concurrency();
+  mt19937 rng(42);
+  WikiData data;
+  LinkBuilder links(n, 64);
+  const size_t hubs = max((size_t)1, n / 100);
+  for (size_t i = 0; i < n * degree; ++i) {
+    WikiData::ArticleID from = rng() % n;
+    WikiData::ArticleID to = rng() % 2 ? rng() % hubs : rng() % n;
+    links.add_link_unsafe(from, to);
+  }
+  links.build(data, threads, true);
+  cout << n << " articles, " << n * degree << " links" << endl;
+
+  auto start = chrono::steady_clock::now();
+  DistanceIndexBuilder(data, threads).build(data.distance_index);
+  const DistanceIndex &index = data.distance_index;
+  cout << "distance index: built in " << fixed << setprecision(2)
+       << chrono::duration<double>(chrono::steady_clock::now() - start).count() << "s on "
+       << threads << " threads, " << (double)index.entry_count() / n << " label entries and "
+       << (double)index.memory_usage() / n << " bytes per article" << endl;
+
+  vector<pair<WikiData::ArticleID, WikiData::ArticleID>> queries;
+  for (size_t i = 0; i < n_queries; ++i) {
+    queries.push_back(make_pair(rng() % n, rng() % n));
+  }
+  start = chrono::steady_clock::now();
+  size_t sum = 0;
+  for (const auto &q: queries) {
+    sum += index.distance(q.first, q.second);
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << setw(24) << left << "distance index" << setw(10) << right << setprecision(3)
+       << seconds / n_queries * 1e6 << " us/query  (checksum " << sum << ")" << endl;
+
+  start = chrono::steady_clock::now();
+  sum = 0;
+  GraphBFS::ArticleSet exclude;
+  for (size_t i = 0; i < n_queries / 10; ++i) {
+    const auto &q = queries[i];
+    if (q.first == q.second)
+      continue;
+    BidirectionalBFS bfs(data, exclude, q.first, q.second);
+    sum += bfs.next().size();
+  }
+  seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << setw(24) << left << "bidirectional BFS" << setw(10) << right
+       << seconds / (n_queries / 10) * 1e6 << " us/query" << endl;
+  return 0;
+}
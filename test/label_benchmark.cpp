@@ -0,0 +1,152 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include "../data.hpp"
+
+using namespace std;
+
+/**
+ * Lookup throughput of the label database on synthetic resources, single
+ * and batched (find_by_resource_batch) lookups.
+ * Usage: label_benchmark [number of articles]
+ */
+
+const size_t n_queries = 1000000;
+
+// resources roughly shaped like dbpedia's: a few words, some common
+// prefixes and suffixes.
+vector<string> make_resources(size_t n, mt19937 &rng) {
+  static const char *syllables[] = { "an", "ber", "co", "de", "el", "fa", "gra", "his",
+    "in", "jo", "ka", "li", "mon", "no", "or", "pa", "qui", "ro", "st", "tu" };
+  static const char *prefixes[] = { "", "", "", "", "List_of_", "History_of_", "1998_in_" };
+  vector<string> ret;
+  ret.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    string r = prefixes[rng() % 7];
+    size_t words = 1 + rng() % 3;
+    for (size_t w = 0; w < words; ++w) {
+      if (w)
+        r += '_';
+      size_t len = 1 + rng() % 4;
+      for (size_t s = 0; s < len; ++s) {
+        r += syllables[rng() % 20];
+      }
+      r[r.size() - 1 - (len > 1)] &= ~0x20;
+    }
+    if (rng() % 10 == 0)
+      r += "_(disambiguation)";
+    r += "_" + to_string(i);
+    ret.push_back(r);
+  }
+  return ret;
+}
+
+template<typename F>
+void run(const string &name, const vector<string> &queries, F lookup) {
+  auto start = chrono::steady_clock::now();
+  size_t found = 0;
+  for (const string &q: queries) {
+    found += lookup(q) != (WikiData::ArticleID)-1;
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << setw(36) << left << name
+       << setw(8) << right << fixed << setprecision(3) << seconds << "s  "
+       << setw(8) << setprecision(2) << queries.size() / seconds / 1e6 << " M lookups/s"
+       << "  (" << found << " found)" << endl;
+}
+
+// looks up 'queries' in batches of 'batch' with 'lookup'(keys, n, out).
+template<typename F>
+void run_batched(const string &name, const vector<string> &queries, size_t batch, F lookup) {
+  vector<boost::string_ref> keys(queries.begin(), queries.end());
+  vector<WikiData::ArticleID> out(keys.size());
+  auto start = chrono::steady_clock::now();
+  for (size_t i = 0; i < keys.size(); i += batch) {
+    lookup(keys.data() + i, min(batch, keys.size() - i), out.data() + i);
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  size_t found = count_if(out.begin(), out.end(), [](WikiData::ArticleID a) {
+    return a != (WikiData::ArticleID)-1;
+  });
+  cout << setw(36) << left << name + ", batch " + to_string(batch)
+       << setw(8) << right << fixed << setprecision(3) << seconds << "s  "
+       << setw(8) << setprecision(2) << queries.size() / seconds / 1e6 << " M lookups/s"
+       << "  (" << found << " found)" << endl;
+}
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? stoul(argv[1]) : 2000000;
+  mt19937 rng(42);
+  vector<string> resources = make_resources(n, rng);
+  sort(resources.begin(), resources.end());
+
+  vector<string> hits, misses;
+  for (size_t i = 0; i < n_queries; ++i) {
+    const string &r = resources[rng() % n];
+    hits.push_back(r);
+    string miss = r;
+    miss[rng() % miss.size()] ^= 0x01;
+    misses.push_back(miss);
+  }
+
+  WikiData data;
+  vector<string> compressed = resources;
+  data.set_labels(compressed);
+  cout << n << " articles, labels use " << data.labels.memory_usage() / (1024.0 * 1024) << " MB" << endl;
+
+  auto start = chrono::steady_clock::now();
+  data.build_resource_index();
+  cout << "resource index: built in "
+       << chrono::duration<double>(chrono::steady_clock::now() - start).count() << "s, "
+       << data.resource_index.memory_usage() / (1024.0 * 1024) << " MB" << endl;
+
+  const LabelStore &labels = data.labels;
+  const ResourceIndex &index = data.resource_index;
+  run("binary search (hits)", hits, [&](const string &q) { return labels.find(q); });
+  run("hash index (hits)", hits, [&](const string &q) { return index.find(labels, q); });
+  run("binary search (misses)", misses, [&](const string &q) { return labels.find(q); });
+  run("hash index (misses)", misses, [&](const string &q) { return index.find(labels, q); });
+
+  // a loop of single lookups against find_by_resource_batch.
+  for (bool index: {true, false}) {
+    WikiData::ArticleID (WikiData::*single)(const boost::string_ref&) const = &WikiData::find_by_resource;
+    cout << (index ? "hash index" : "binary search") << ", hits and misses:" << endl;
+    vector<string> mixed;
+    for (size_t i = 0; i < hits.size(); ++i) {
+      mixed.push_back(i % 2 ? misses[i] : hits[i]);
+    }
+    for (size_t batch: {1, 16, 256}) {
+      run_batched("  loop", mixed, batch, [&](const boost::string_ref *keys, size_t n, WikiData::ArticleID *out) {
+        for (size_t i = 0; i < n; ++i) {
+          out[i] = (data.*single)(keys[i]);
+        }
+      });
+      run_batched("  find_by_resource_batch", mixed, batch,
+                  [&](const boost::string_ref *keys, size_t n, WikiData::ArticleID *out) {
+        data.find_by_resource_batch(keys, n, out);
+      });
+    }
+    if (index)
+      data.resource_index.clear();
+  }
+
+  vector<string> label_hits;
+  for (const string &q: hits) {
+    label_hits.push_back(q);
+    wikipedia_denormalization(label_hits.back());
+  }
+  run("label via resource order (hits)", label_hits, [&](const string &q) { return data.find_by_label(q); });
+  start = chrono::steady_clock::now();
+  data.build_label_index(thread::hardware_concurrency());
+  cout << "label index: built in "
+       << chrono::duration<double>(chrono::steady_clock::now() - start).count() << "s on "
+       << thread::hardware_concurrency() << " threads, "
+       << data.label_index.memory_usage() / (1024.0 * 1024) << " MB" << endl;
+  run("label index (hits)", label_hits, [&](const string &q) { return data.find_by_label(q); });
+  return 0;
+}
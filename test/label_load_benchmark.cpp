@@ -0,0 +1,123 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <cstdio>
+#include <stdexcept>
+#include <bzlib.h>
+#include "../read.hpp"
+
+using namespace std;
+
+/**
+ * Loads a synthetic labels file with read_labels and an increasing number
+ * of label threads. Reports the time until all lines are parsed and
+ * merged (read_labels' "Reading finished" message) and the whole load,
+ * which also sorts the labels and builds the label index.
+ * Usage: label_load_benchmark [number of labels]
+ */
+
+const string filename = "label_load_benchmark.tmp.bz2";
+
+string make_labels(size_t n) {
+  static const char *words[] = { "Coffee", "Graph_theory", "K%C3%B6nigsberg", "List_of_",
+    "Paul_Erd%C5%91s", "History_of_", "(disambiguation)", "1998_in_", "Tea", "Music" };
+  mt19937 rng(42);
+  string ret;
+  for (size_t i = 0; i < n; ++i) {
+    string resource;
+    size_t n_words = 1 + rng() % 3;
+    for (size_t w = 0; w < n_words; ++w) {
+      resource += words[rng() % 10];
+    }
+    resource += "_" + to_string(i);
+    string label = resource;
+    for (char &c: label) {
+      if (c == '_')
+        c = ' ';
+    }
+    // some labels differ from their resource
+    if (rng() % 10 == 0)
+      label += " \\\"alt\\\"";
+    ret += "<http://dbpedia.org/resource/" + resource +
+      "> <http://www.w3.org/2000/01/rdf-schema#label> \"" + label + "\"@en .\n";
+  }
+  return ret;
+}
+
+// compresses 'in' as a series of bz2 streams, like the dumps' multistream files.
+void write_bz2(const string &in) {
+  FILE *f = fopen(filename.c_str(), "w");
+  if (!f)
+    throw std::runtime_error("can't write " + filename);
+  const size_t block = 800 * 1000;
+  for (size_t pos = 0; pos < in.size(); pos += block) {
+    size_t size = min(block, in.size() - pos);
+    vector<char> out(size * 1.01 + 600);
+    unsigned int out_size = out.size();
+    if (BZ2_bzBuffToBuffCompress(out.data(), &out_size, const_cast<char*>(in.data() + pos),
+                                 size, 9, 0, 0) != BZ_OK)
+      throw std::runtime_error("compression failed");
+    fwrite(out.data(), 1, out_size, f);
+  }
+  fclose(f);
+}
+
+// swallows what's written to it, remembering when a line containing
+// 'marker' was.
+class MarkerTime : public streambuf {
+  const string marker;
+  string line;
+
+protected:
+  int overflow(int c) {
+    if (c == '\n') {
+      if (line.find(marker) != string::npos)
+        time = chrono::steady_clock::now();
+      line.clear();
+    } else if (c != EOF) {
+      line.push_back(c);
+    }
+    return c;
+  }
+
+public:
+  chrono::steady_clock::time_point time;
+
+  MarkerTime(const string &marker) : marker(marker) { }
+};
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? stoul(argv[1]) : 1000000;
+  write_bz2(make_labels(n));
+  use_resource_index = false;
+
+  const size_t cores = thread::hardware_concurrency();
+  cout << n << " labels, " << cores << " cores, " << decompress_threads
+       << " decompression threads" << endl;
+  double baseline = 0;
+  for (size_t t = 1; t <= max((size_t)8, 2 * cores); t *= 2) {
+    label_threads = t;
+    WikiData data;
+    MarkerTime marker("Reading finished");
+    streambuf *original = cout.rdbuf(&marker);
+    auto start = chrono::steady_clock::now();
+    read_labels(data, filename);
+    auto end = chrono::steady_clock::now();
+    cout.rdbuf(original);
+
+    double parsed = chrono::duration<double>(marker.time - start).count();
+    double total = chrono::duration<double>(end - start).count();
+    if (t == 1)
+      baseline = parsed;
+    cout << setw(3) << t << " label threads: parsed in " << fixed << setprecision(3) << parsed
+         << "s (" << setprecision(2) << n / parsed / 1e6 << " M labels/s, "
+         << baseline / parsed << "x), loaded in " << setprecision(3) << total << "s, "
+         << data.label_count() << " labels, " << nolabel << " without label" << endl;
+  }
+  remove(filename.c_str());
+  return 0;
+}
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <sstream>
+#include "../read.hpp"
+
+using namespace std;
+
+/**
+ * Import throughput of read_page_links on the given dumps: loads the
+ * labels once, then reads the page links a few times and reports the
+ * links stored per second (parsing, resolving and collecting the links
+ * plus packing them, without the connected components). Resources are
+ * looked up with the resource index, and once without it (by binary
+ * search in the label store).
+ * Usage: link_load_benchmark <labels file> <links file> [runs]
+ */
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    cerr << "Usage: " << argv[0] << " <labels file> <links file> [runs]" << endl;
+    return 1;
+  }
+  const size_t runs = argc > 3 ? stoul(argv[3]) : 3;
+  use_components = false;
+
+  WikiData data;
+  stringstream log;
+  streambuf *original = cout.rdbuf(log.rdbuf());
+  read_labels(data, argv[1]);
+  cout.rdbuf(original);
+  cout << data.label_count() << " labels" << endl;
+
+  for (size_t run = 0; run < runs; ++run) {
+    for (size_t mode = 0; mode < 3; ++mode) {
+      const bool incoming = mode == 1, index = mode < 2;
+      if (index && data.resource_index.empty())
+        data.build_resource_index();
+      if (!index)
+        data.resource_index.clear();
+      log.str("");
+      log.clear();
+      original = cout.rdbuf(log.rdbuf());
+      auto start = chrono::steady_clock::now();
+      size_t lines = read_page_links(data, argv[2], incoming);
+      double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      cout.rdbuf(original);
+      cout << (incoming ? "with incoming links:   " : index ? "outgoing links only:   " : "without resource index: ")
+           << lines << " lines, " << data.link_count() << " links in " << fixed << setprecision(3)
+           << seconds << "s, " << setprecision(2) << data.link_count() / seconds / 1e6 << " M links/s, "
+           << lines / seconds / 1e6 << " M lines/s" << endl;
+      // read_page_links' statistics of the lookups
+      string line;
+      while (getline(log, line)) {
+        if (line.find("lookups") != string::npos)
+          cout << "  " << line << endl;
+      }
+    }
+  }
+  return 0;
+}
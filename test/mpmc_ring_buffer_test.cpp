@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <thread>
+#include <atomic>
+#include <string>
+#include "../mpmc_ring_buffer.hpp"
+
+
+namespace {
+
+TEST(MPMCRingBuffer, SingleThreadOrder) {
+  MPMCRingBuffer<int> q(5);
+  EXPECT_EQ(8u, q.capacity());
+  for (int i = 0; i < 8; ++i) {
+    q.push(i);
+  }
+  EXPECT_EQ(8u, q.size());
+  int out;
+  for (int i = 0; i < 8; ++i) {
+    ASSERT_TRUE(q.pop(out));
+    EXPECT_EQ(i, out);
+  }
+  q.terminate_consumers();
+  EXPECT_FALSE(q.pop(out));
+}
+
+
+TEST(MPMCRingBuffer, BatchesWrapAround) {
+  MPMCRingBuffer<string> q(16);
+  vector<string> in, out;
+  size_t next_in = 0, next_out = 0;
+  for (size_t round = 0; round < 20; ++round) {
+    for (size_t i = 0; i < 11; ++i) {
+      in.push_back(to_string(next_in++));
+    }
+    q.push_batch(in);
+    EXPECT_TRUE(in.empty());
+    while (q.size()) {
+      q.pop_batch(out, 4);
+      for (const string &s: out) {
+        EXPECT_EQ(to_string(next_out++), s);
+      }
+    }
+  }
+  EXPECT_EQ(next_in, next_out);
+}
+
+
+// every item is consumed exactly once, consumers end after termination.
+TEST(MPMCRingBuffer, ProducersConsumers) {
+  const size_t producers = 4, consumers = 3, items = 100000;
+  MPMCRingBuffer<uint64_t> q(64);
+  atomic<uint64_t> sum(0), count(0);
+
+  vector<thread> consumer_threads;
+  for (size_t c = 0; c < consumers; ++c) {
+    consumer_threads.push_back(thread([&, c]{
+      vector<uint64_t> batch;
+      uint64_t item;
+      while (true) {
+        if (c % 2) {
+          if (!q.pop(item))
+            break;
+          sum += item;
+          count += 1;
+        } else {
+          if (!q.pop_batch(batch, 7))
+            break;
+          for (uint64_t i: batch) {
+            sum += i;
+          }
+          count += batch.size();
+        }
+      }
+    }));
+  }
+
+  vector<thread> producer_threads;
+  for (size_t p = 0; p < producers; ++p) {
+    producer_threads.push_back(thread([&, p]{
+      vector<uint64_t> batch;
+      for (uint64_t i = 1; i <= items; ++i) {
+        if (p % 2) {
+          q.push(i);
+        } else {
+          batch.push_back(i);
+          if (batch.size() == 13)
+            q.push_batch(batch);
+        }
+      }
+      q.push_batch(batch);
+    }));
+  }
+  for (thread &t: producer_threads) {
+    t.join();
+  }
+  q.terminate_consumers();
+  for (thread &t: consumer_threads) {
+    t.join();
+  }
+  EXPECT_EQ(producers * items, count.load());
+  EXPECT_EQ(producers * items * (items + 1) / 2, sum.load());
+}
+
+}; // namespace
+
+int main(int argc, char ** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+};
@@ -0,0 +1,152 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <boost/tokenizer.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include "../ntriples_tokenizer.hpp"
+#include "../escaped_list_ignore.hpp"
+#include "../parseutil.hpp"
+
+using namespace std;
+using boost::string_ref;
+
+/**
+ * Tokenizing throughput for lines shaped like the DBpedia labels and page
+ * links dumps: the boost tokenizers read.cpp used before against
+ * NTriplesTokenizer. Then the cost per page link line of normalizing both
+ * resources, with the former copying abbr_ressource against the in place one.
+ * Usage: parse_benchmark [number of lines]
+ */
+
+// abbr_ressource as it was: substr for the tags and the prefix, urldecode
+// into another string.
+void copying_abbr_ressource(string &source) {
+  static const string prefix("dbpedia.org/resource/");
+  if (source.size() > 2 && source[0] == '<' && source[source.size() - 1] == '>')
+    source = source.substr(1, source.size() - 2);
+  size_t pos = source.find(prefix);
+  if (source.find("http://") == 0 && pos < 15)
+    source = source.substr(pos + prefix.size());
+  string decoded;
+  if (urldecode(decoded, source))
+    source = decoded;
+}
+
+string make_resource(mt19937 &rng) {
+  static const char *words[] = { "Coffee", "Graph_theory", "K%C3%B6nigsberg", "List_of_",
+    "Paul_Erd%C5%91s", "History_of_", "(disambiguation)", "1998_in_", "Tea", "Music" };
+  string r = "<http://dbpedia.org/resource/";
+  size_t n = 1 + rng() % 3;
+  for (size_t i = 0; i < n; ++i) {
+    r += words[rng() % 10];
+  }
+  return r + ">";
+}
+
+vector<string> make_label_lines(size_t n, mt19937 &rng) {
+  static const char *words[] = { "Coffee", "Graph theory", "K\\u00F6nigsberg", "List of ",
+    "Paul Erd\\u0151s", "History of ", "\\\"quoted\\\"", "1998 in ", "Tea", "Music" };
+  vector<string> ret;
+  for (size_t i = 0; i < n; ++i) {
+    string label;
+    size_t words_per_label = 1 + rng() % 3;
+    for (size_t w = 0; w < words_per_label; ++w) {
+      label += words[rng() % 10];
+    }
+    ret.push_back(make_resource(rng) + " <http://www.w3.org/2000/01/rdf-schema#label> \"" +
+                  label + "\"@en .");
+  }
+  return ret;
+}
+
+vector<string> make_link_lines(size_t n, mt19937 &rng) {
+  vector<string> ret;
+  for (size_t i = 0; i < n; ++i) {
+    ret.push_back(make_resource(rng) + " <http://dbpedia.org/ontology/wikiPageWikiLink> " +
+                  make_resource(rng) + " .");
+  }
+  return ret;
+}
+
+template<typename F>
+void run(const string &name, const vector<string> &lines, F tokenize) {
+  size_t bytes = 0;
+  for (const string &line: lines) {
+    bytes += line.size() + 1;
+  }
+  auto start = chrono::steady_clock::now();
+  size_t checksum = 0;
+  for (const string &line: lines) {
+    checksum += tokenize(line);
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << setw(40) << left << name
+       << setw(8) << right << fixed << setprecision(3) << seconds << "s  "
+       << setw(8) << setprecision(1) << bytes / seconds / 1e6 << " MB/s"
+       << setw(8) << seconds / lines.size() * 1e9 << " ns/line"
+       << "  (checksum " << checksum << ")" << endl;
+}
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? stoul(argv[1]) : 1000000;
+  mt19937 rng(42);
+  vector<string> labels = make_label_lines(n, rng);
+  vector<string> links = make_link_lines(n, rng);
+
+  cout << "labels, " << n << " lines:" << endl;
+  run("  escaped_list_separator + strings", labels, [](const string &line) {
+    escaped_list_separator_includeinvalid<char> ls('\\', ' ', '\"');
+    boost::tokenizer<escaped_list_separator_includeinvalid<char>, string::const_iterator>
+      tok(line.begin(), line.end(), ls);
+    string resource, label;
+    size_t i = 0;
+    for (auto it = tok.begin(); i < 3 && it != tok.end(); ++i, ++it) {
+      if (i == 0)
+        resource = *it;
+      if (i == 2) {
+        label = *it;
+        parse_nt_string(label);
+      }
+    }
+    return resource.size() + label.size();
+  });
+  NTriplesTokenizer tokens;
+  run("  NTriplesTokenizer::tokenize", labels, [&](const string &line) {
+    if (tokens.tokenize(line, 3) != 3)
+      return (size_t)0;
+    return tokens.term(0).size() + parse_nt_string(tokens.term(2)).size();
+  });
+
+  cout << "page links, " << n << " lines:" << endl;
+  run("  boost::split into vector<string>", links, [](const string &line) {
+    vector<string> terms;
+    boost::split(terms, line, boost::is_any_of(" "));
+    return terms[0].size() + terms[2].size();
+  });
+  run("  NTriplesTokenizer::split", links, [&](const string &line) {
+    tokens.split(line);
+    return tokens.term(0).size() + tokens.term(2).size();
+  });
+
+  cout << "page links, tokenized and both resources normalized:" << endl;
+  run("  copying abbr_ressource", links, [&](const string &line) {
+    tokens.split(line);
+    string source = tokens.term(0).to_string();
+    copying_abbr_ressource(source);
+    string target = tokens.term(2).to_string();
+    copying_abbr_ressource(target);
+    return source.size() + target.size();
+  });
+  string source, target;
+  run("  in place abbr_ressource", links, [&](const string &line) {
+    tokens.split(line);
+    source.assign(tokens.term(0).data(), tokens.term(0).size());
+    target.assign(tokens.term(2).data(), tokens.term(2).size());
+    return abbr_ressource(&source[0], source.size()) + abbr_ressource(&target[0], target.size());
+  });
+  return 0;
+}
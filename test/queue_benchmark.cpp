@@ -0,0 +1,111 @@
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+#include "../producer_consumer_queue.hpp"
+#include "../mpmc_ring_buffer.hpp"
+
+using namespace std;
+
+/**
+ * Throughput of ProducerConsumerQueue vs. MPMCRingBuffer (single and batched
+ * push/pop) for different producer/consumer counts.
+ * Usage: queue_benchmark [items per producer]
+ */
+
+typedef tuple<uint32_t, uint32_t, bool> item_t;
+const size_t batch_size = 256;
+
+struct Single {};
+struct Batched {};
+
+template<typename Queue>
+void produce(Queue &q, size_t items, Single) {
+  for (size_t i = 0; i < items; ++i) {
+    q.push(make_tuple((uint32_t)i, (uint32_t)i, true));
+  }
+}
+
+template<typename Queue>
+void produce(Queue &q, size_t items, Batched) {
+  vector<item_t> batch;
+  for (size_t i = 0; i < items; ++i) {
+    batch.push_back(make_tuple((uint32_t)i, (uint32_t)i, true));
+    if (batch.size() == batch_size)
+      q.push_batch(batch);
+  }
+  q.push_batch(batch);
+}
+
+template<typename Queue>
+size_t consume(Queue &q, Single) {
+  size_t n = 0;
+  item_t item;
+  while (q.pop(item)) {
+    n += get<2>(item);
+  }
+  return n;
+}
+
+template<typename Queue>
+size_t consume(Queue &q, Batched) {
+  size_t n = 0;
+  vector<item_t> batch;
+  while (q.pop_batch(batch, batch_size)) {
+    for (const item_t &item: batch) {
+      n += get<2>(item);
+    }
+  }
+  return n;
+}
+
+template<typename Queue, typename Mode>
+void run(const string &name, size_t producers, size_t consumers, size_t items) {
+  Queue q(4096);
+  vector<size_t> consumed(consumers);
+  auto start = chrono::steady_clock::now();
+
+  vector<thread> consumer_threads;
+  for (size_t c = 0; c < consumers; ++c) {
+    consumer_threads.push_back(thread([&, c]{ consumed[c] = consume(q, Mode()); }));
+  }
+  vector<thread> producer_threads;
+  for (size_t p = 0; p < producers; ++p) {
+    producer_threads.push_back(thread([&]{ produce(q, items, Mode()); }));
+  }
+  for (thread &t: producer_threads) {
+    t.join();
+  }
+  q.terminate_consumers();
+  for (thread &t: consumer_threads) {
+    t.join();
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  size_t total = 0;
+  for (size_t c: consumed) {
+    total += c;
+  }
+  if (total != producers * items) {
+    cerr << "lost items: " << total << " != " << producers * items << endl;
+  }
+  cout << setw(28) << left << name << producers << "P/" << consumers << "C  "
+       << setw(8) << right << fixed << setprecision(3) << seconds << "s  "
+       << setw(8) << setprecision(2) << total / seconds / 1e6 << " M items/s" << endl;
+}
+
+int main(int argc, char **argv) {
+  size_t items = argc > 1 ? stoul(argv[1]) : 2000000;
+  cout << "hardware threads: " << thread::hardware_concurrency() << ", "
+       << items << " items per producer" << endl;
+
+  const size_t configs[][2] = {{1, 4}, {4, 2}};
+  for (auto &config: configs) {
+    run<ProducerConsumerQueue<item_t>, Single>("ProducerConsumerQueue", config[0], config[1], items);
+    run<MPMCRingBuffer<item_t>, Single>("MPMCRingBuffer", config[0], config[1], items);
+    run<MPMCRingBuffer<item_t>, Batched>("MPMCRingBuffer (batch 256)", config[0], config[1], items);
+  }
+  return 0;
+}
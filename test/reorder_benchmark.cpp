@@ -0,0 +1,201 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <thread>
+#include <functional>
+#include <cstring>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "../data.hpp"
+#include "../link_builder.hpp"
+#include "../link_order_builder.hpp"
+#include "../graph_bfs.hpp"
+#include "../parallel_bfs.hpp"
+
+using namespace std;
+
+/**
+ * BFS traversals and PageRank iterations on a synthetic graph in resource
+ * order and after LinkOrderBuilder, with the cache misses per link where
+ * the kernel lets us count them (perf_event_open).
+ *
+ * The graph has communities of 1000 articles with most links inside their
+ * community, like articles on a topic, and a few hubs. Article ids are
+ * shuffled, as sorting by resource separates the articles of a topic.
+ * Nothing links to the last article, so searches for it visit everything.
+ * Usage: reorder_benchmark [number of articles] [links per article]
+ */
+
+const size_t community_size = 1000;
+
+void make_graph(WikiData &data, size_t n, size_t degree) {
+  mt19937 rng(42);
+  vector<WikiData::ArticleID> id(n);
+  for (size_t i = 0; i < n; ++i) {
+    id[i] = i;
+  }
+  shuffle(id.begin(), id.end(), rng);
+  LinkBuilder links(n, 64);
+  const size_t hubs = max((size_t)1, n / 1000);
+  for (size_t i = 0; i < n * degree; ++i) {
+    size_t from = rng() % n;
+    size_t to;
+    size_t kind = rng() % 10;
+    if (kind < 8) {
+      size_t community = from / community_size * community_size;
+      to = min(n - 1, community + rng() % community_size);
+    } else if (kind == 8) {
+      to = rng() % hubs;
+    } else {
+      to = rng() % n;
+    }
+    if (id[to] != n - 1)
+      links.add_link_unsafe(id[from], id[to]);
+  }
+  links.build(data, thread::hardware_concurrency(), true);
+}
+
+// counts hardware cache misses of this thread and its children, if allowed.
+class CacheMisses {
+  int fd = -1;
+
+public:
+  CacheMisses() {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+
+  ~CacheMisses() {
+    if (fd >= 0)
+      close(fd);
+  }
+
+  bool available() const {
+    return fd >= 0;
+  }
+
+  void start() {
+    if (fd < 0)
+      return;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+
+  uint64_t stop() {
+    uint64_t count = 0;
+    if (fd < 0)
+      return 0;
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) != sizeof(count))
+      return 0;
+    return count;
+  }
+};
+
+double run(const string &name, size_t links, function<void()> f, double baseline = 0) {
+  CacheMisses misses;
+  misses.start();
+  auto start = chrono::steady_clock::now();
+  f();
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  uint64_t count = misses.stop();
+  cout << setw(36) << left << name << setw(9) << right << fixed << setprecision(1)
+       << seconds * 1000 << " ms";
+  if (misses.available()) {
+    cout << setw(8) << setprecision(2) << (double)count / links << " misses/link";
+  } else {
+    cout << "      (cache misses n/a)";
+  }
+  if (baseline)
+    cout << setw(8) << setprecision(2) << baseline / seconds << "x";
+  cout << endl;
+  return seconds;
+}
+
+// pull-style PageRank along the incoming links, returns the largest rank.
+double pagerank(const WikiData &data, size_t iterations) {
+  const size_t n = data.linkdb_size();
+  const double damping = 0.85;
+  vector<double> rank(n, 1.0 / n), contribution(n);
+  for (size_t i = 0; i < iterations; ++i) {
+    double dangling = 0;
+    for (WikiData::ArticleID v = 0; v < n; ++v) {
+      size_t out = data.outlink_count(v);
+      contribution[v] = out ? rank[v] / out : 0;
+      if (!out)
+        dangling += rank[v];
+    }
+    for (WikiData::ArticleID v = 0; v < n; ++v) {
+      double sum = 0;
+      for (WikiData::ArticleID from: data.inlinks_of(v)) {
+        sum += contribution[from];
+      }
+      rank[v] = (1 - damping) / n + damping * (sum + dangling / n);
+    }
+  }
+  return *max_element(rank.begin(), rank.end());
+}
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? stoul(argv[1]) : 2000000;
+  size_t degree = argc > 2 ? stoul(argv[2]) : 10;
+  const size_t threads = thread::hardware_concurrency();
+  const size_t n_sources = 3;
+
+  vector<double> baselines;
+  for (LinkOrderBuilder::Method method: {LinkOrderBuilder::KEEP, LinkOrderBuilder::DEGREE,
+                                         LinkOrderBuilder::BFS}) {
+    const char *name = method == LinkOrderBuilder::KEEP ? "resource order" :
+      method == LinkOrderBuilder::DEGREE ? "degree order" : "BFS order";
+    WikiData data;
+    make_graph(data, n, degree);
+    auto start = chrono::steady_clock::now();
+    LinkOrderBuilder(data, threads).build(method);
+    cout << name << ": " << n << " articles, " << data.link_count() << " links, reordering took "
+         << setprecision(1) << chrono::duration<double>(chrono::steady_clock::now() - start).count() * 1000
+         << " ms" << endl;
+
+    // the same articles as sources in every order.
+    GraphBFS::ArticleSet exclude;
+    vector<double> times;
+    auto timed = [&](const string &label, size_t links, function<void()> f) {
+      size_t i = times.size();
+      times.push_back(run(label, links, f, baselines.size() > i ? baselines[i] : 0));
+    };
+    timed("  GraphBFS, complete traversal", n_sources * data.link_count(), [&]() {
+      for (size_t i = 0; i < n_sources; ++i) {
+        GraphBFS bfs(data, exclude, data.vertex_of(i * 7919 % n), data.vertex_of(n - 1));
+        bfs.next();
+      }
+    });
+    for (size_t t: {(size_t)1, threads}) {
+      ParallelBFS bfs(data, t);
+      timed("  ParallelBFS, " + to_string(t) + " threads", n_sources * data.link_count(), [&]() {
+        for (size_t i = 0; i < n_sources; ++i) {
+          bfs.distances(data.vertex_of(i * 7919 % n), exclude);
+        }
+      });
+      if (t == threads)
+        break;
+    }
+    double top = 0;
+    timed("  PageRank, 10 iterations", 10 * data.link_count(), [&]() { top = pagerank(data, 10); });
+    cout << "  (largest rank " << scientific << setprecision(6) << top << fixed << ")" << endl;
+    if (baselines.empty())
+      baselines = times;
+  }
+  return 0;
+}
@@ -0,0 +1,268 @@
+#include <gtest/gtest.h>
+#include <gmock/gmock.h>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include "../data.hpp"
+#include "../link_builder.hpp"
+#include "../component_builder.hpp"
+#include "../distance_index_builder.hpp"
+#include "../landmark_builder.hpp"
+#include "../link_order_builder.hpp"
+#include "../snapshot.hpp"
+
+
+namespace {
+
+class SnapshotTest : public ::testing::Test {
+protected:
+  void SetUp() {
+    vector<string> labels = {
+      "Coffee",
+      "Graph_theory",
+      string("K%C3%B6nigsberg") + '\0' + "K\\u00F6nigsberg",
+      "Paul_Erd%C5%91s",
+    };
+    data.set_labels(labels);
+    data.build_resource_index();
+    data.build_label_index(2);
+    LinkBuilder links(4, 2);
+    links.add_link_unsafe(0, 2);
+    links.add_link_unsafe(2, 1);
+    links.build(data, 2, true);
+    ComponentBuilder(data, 2).build();
+    DistanceIndexBuilder(data, 2).build(data.distance_index);
+    LandmarkBuilder(data, 2, 2).build(data.landmarks);
+  }
+
+  void TearDown() {
+    remove(filename.c_str());
+  }
+
+  string read_file() {
+    ifstream in(filename, ios::binary);
+    stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+  }
+
+  void write_file(const string &content) {
+    ofstream out(filename, ios::binary | ios::trunc);
+    out << content;
+  }
+
+  WikiData data;
+  string filename = "snapshot_test.tmp";
+};
+
+
+TEST_F(SnapshotTest, RoundTrip) {
+  save_snapshot(data, filename);
+  WikiData loaded;
+  load_snapshot(loaded, filename, true);
+
+  EXPECT_TRUE(loaded.labels.resource_data.is_mapped());
+  EXPECT_TRUE(loaded.link_targets.is_mapped());
+  EXPECT_TRUE(loaded.resource_index.slots.is_mapped());
+  ASSERT_EQ(4u, loaded.label_count());
+  EXPECT_EQ(0u, loaded.find_by_resource("Coffee"));
+  EXPECT_EQ(1u, loaded.find_by_label("Graph theory"));
+  EXPECT_EQ("K\\u00F6nigsberg", loaded.label_by_id(2));
+  EXPECT_EQ(2u, loaded.find_by_label("K\\u00F6nigsberg"));
+  EXPECT_EQ("K%C3%B6nigsberg", loaded.resource_by_id(2));
+  EXPECT_EQ((WikiData::ArticleID)-1, loaded.find_by_resource("Tea"));
+
+  ASSERT_EQ(4u, loaded.linkdb_size());
+  EXPECT_TRUE(loaded.has_incoming_links());
+  EXPECT_TRUE(loaded.components.weak.is_mapped());
+  EXPECT_EQ(3u, loaded.components.weak_size(1));
+  EXPECT_EQ(1u, loaded.components.weak_size(3));
+  EXPECT_EQ(1u, loaded.components.strong_size(0));
+  EXPECT_FALSE(loaded.components.path_possible(1, 0, false));
+  EXPECT_TRUE(loaded.distance_index.in.hubs.is_mapped());
+  EXPECT_EQ(2u, loaded.distance_index.distance(0, 1));
+  EXPECT_EQ(0u, loaded.distance_index.distance(2, 2));
+  EXPECT_EQ((DistanceIndex::Distance)-1, loaded.distance_index.distance(1, 0));
+  // only article 2 is in the strongly connected component of the first landmark.
+  ASSERT_EQ(1u, loaded.landmarks.size());
+  EXPECT_TRUE(loaded.landmarks.distances.is_mapped());
+  EXPECT_EQ(2u, loaded.landmarks.articles[0]);
+  EXPECT_EQ(1u, loaded.landmarks.distance_to(0, 0));
+  EXPECT_EQ(1u, loaded.landmarks.distance_from(1, 0));
+  EXPECT_EQ((Landmarks::Distance)-1, loaded.landmarks.lower_bound(1, 0));
+  EXPECT_TRUE(loaded.outlink_exists(0, 2));
+  EXPECT_TRUE(loaded.outlink_exists(2, 1));
+  EXPECT_FALSE(loaded.outlink_exists(1, 2));
+  EXPECT_THAT(loaded.get_links(2, true, true), ::testing::ElementsAre(
+        WikiData::to_pagelink(0, false, true),
+        WikiData::to_pagelink(1, true, false)));
+}
+
+
+TEST_F(SnapshotTest, CompressedLinks) {
+  data.compress_links();
+  save_snapshot(data, filename);
+  WikiData loaded;
+  load_snapshot(loaded, filename, true);
+
+  EXPECT_TRUE(loaded.compressed_links.data.is_mapped());
+  EXPECT_TRUE(loaded.link_targets.empty());
+  EXPECT_EQ(2u, loaded.link_count());
+  EXPECT_TRUE(loaded.outlink_exists(0, 2));
+  EXPECT_TRUE(loaded.outlink_exists(2, 1));
+  EXPECT_FALSE(loaded.outlink_exists(1, 2));
+  EXPECT_THAT(loaded.get_links(2, true, true), ::testing::ElementsAre(
+        WikiData::to_pagelink(0, false, true),
+        WikiData::to_pagelink(1, true, false)));
+
+  // corrupted list offsets are rejected.
+  loaded.compressed_links.offsets.vec().assign(5, 1000);
+  save_snapshot(loaded, filename);
+  EXPECT_THROW(load_snapshot(loaded, filename), std::runtime_error);
+}
+
+
+TEST_F(SnapshotTest, ReorderedLinks) {
+  LinkOrderBuilder(data, 2).build(LinkOrderBuilder::DEGREE);
+  ComponentBuilder(data, 2).build();
+  save_snapshot(data, filename);
+  WikiData loaded;
+  load_snapshot(loaded, filename, true);
+
+  EXPECT_TRUE(loaded.vertex_articles.is_mapped());
+  ASSERT_TRUE(loaded.is_reordered());
+  // article 2 has the most links.
+  EXPECT_EQ(0u, loaded.vertex_of(2));
+  EXPECT_EQ(2u, loaded.article_of(0));
+  EXPECT_TRUE(loaded.outlink_exists(0, 2));
+  EXPECT_TRUE(loaded.outlink_exists(2, 1));
+  EXPECT_FALSE(loaded.outlink_exists(1, 2));
+  EXPECT_THAT(loaded.get_links(2, true, true), ::testing::ElementsAre(
+        WikiData::to_pagelink(0, false, true),
+        WikiData::to_pagelink(1, true, false)));
+  EXPECT_FALSE(loaded.components.path_possible(loaded.vertex_of(1), loaded.vertex_of(0), false));
+
+  // the order has to be a permutation.
+  loaded.vertex_articles.vec().assign(4, 0);
+  save_snapshot(loaded, filename);
+  EXPECT_THROW(load_snapshot(loaded, filename), std::runtime_error);
+}
+
+
+TEST_F(SnapshotTest, LabelsOnly) {
+  WikiData labels_only;
+  vector<string> labels = { "A", "B" };
+  labels_only.set_labels(labels);
+  save_snapshot(labels_only, filename);
+
+  WikiData loaded;
+  load_snapshot(loaded, filename);
+  EXPECT_EQ(2u, loaded.label_count());
+  EXPECT_EQ(0u, loaded.linkdb_size());
+  EXPECT_FALSE(loaded.has_incoming_links());
+  EXPECT_EQ(1u, loaded.find_by_resource("B"));
+}
+
+
+TEST_F(SnapshotTest, RejectsTruncated) {
+  save_snapshot(data, filename);
+  string content = read_file();
+  write_file(content.substr(0, content.size() - 1));
+  WikiData loaded;
+  EXPECT_THROW(load_snapshot(loaded, filename), std::runtime_error);
+  write_file(content.substr(0, 16));
+  EXPECT_THROW(load_snapshot(loaded, filename), std::runtime_error);
+  EXPECT_EQ(0u, loaded.label_count());
+}
+
+
+TEST_F(SnapshotTest, RejectsOtherVersion) {
+  save_snapshot(data, filename);
+  string content = read_file();
+  // the version follows the 8 byte magic.
+  content[8] ^= 0x7f;
+  write_file(content);
+  WikiData loaded;
+  EXPECT_THROW(load_snapshot(loaded, filename), std::runtime_error);
+}
+
+
+TEST_F(SnapshotTest, RejectsCorruptedData) {
+  save_snapshot(data, filename);
+  string content = read_file();
+  content[content.size() - 2] ^= 0x10;
+  write_file(content);
+  WikiData loaded;
+  EXPECT_THROW(load_snapshot(loaded, filename, true), std::runtime_error);
+
+  write_file("not a snapshot, but long enough to hold a header................"
+             "................................................................"
+             "................................................................"
+             "................................................................"
+             "................................................................"
+             "................................................................");
+  EXPECT_THROW(load_snapshot(loaded, filename), std::runtime_error);
+}
+
+
+TEST_F(SnapshotTest, RejectsInconsistentContent) {
+  // each change keeps the sizes and the checksums valid, but would be
+  // read out of bounds.
+  auto expect_rejected = [&]() {
+    save_snapshot(data, filename);
+    WikiData loaded;
+    EXPECT_THROW(load_snapshot(loaded, filename), std::runtime_error);
+  };
+  vector<WikiData::ArticleID> targets = data.link_targets.vec();
+  data.link_targets.vec()[0] = 4;
+  expect_rejected();
+  data.link_targets.vec() = targets;
+
+  vector<WikiData::ArticleID> sources = data.inlink_sources.vec();
+  data.inlink_sources.vec()[0] = 7;
+  expect_rejected();
+  data.inlink_sources.vec() = sources;
+
+  auto offsets = data.link_offsets.vec();
+  data.link_offsets.vec()[1] = 2;
+  data.link_offsets.vec()[2] = 0;
+  expect_rejected();
+  data.link_offsets.vec() = offsets;
+
+  auto ids = data.label_index.ids.vec();
+  data.label_index.ids.vec()[0] = 9;
+  expect_rejected();
+  data.label_index.ids.vec() = ids;
+
+  auto slots = data.resource_index.slots.vec();
+  for (auto &slot: data.resource_index.slots.vec()) {
+    if (slot != ResourceIndex::empty_slot)
+      slot = 5;
+  }
+  expect_rejected();
+  // no empty slot to end a probe
+  data.resource_index.slots.vec().assign(slots.size(), 0);
+  expect_rejected();
+  data.resource_index.slots.vec() = slots;
+
+  auto resources = data.labels.resource_data.vec();
+  data.labels.resource_data.vec()[0] = 100;
+  expect_rejected();
+  data.labels.resource_data.vec() = resources;
+
+  save_snapshot(data, filename);
+  WikiData loaded;
+  EXPECT_NO_THROW(load_snapshot(loaded, filename));
+
+  // the value byte of article 0's only link
+  data.compress_links();
+  data.compressed_links.data.vec()[data.compressed_links.offsets[0] + 1] = 200;
+  expect_rejected();
+}
+
+}; // namespace
+
+int main(int argc, char ** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+};
@@ -0,0 +1,80 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <thread>
+#include "../parallel_sort.hpp"
+
+using namespace std;
+
+/**
+ * Sorting the label table of read_labels (resource, optionally followed
+ * by '\0' and the label) with std::sort, parallel_sort and
+ * parallel_sample_sort on an increasing number of threads.
+ * Usage: sort_benchmark [number of labels]
+ */
+
+vector<string> make_labels(size_t n) {
+  static const char *syllables[] = { "an", "ber", "co", "de", "el", "fa", "gra", "his",
+    "in", "jo", "ka", "li", "mon", "no", "or", "pa", "qui", "ro", "st", "tu" };
+  static const char *prefixes[] = { "", "", "", "", "List_of_", "History_of_", "1998_in_" };
+  mt19937 rng(42);
+  vector<string> ret;
+  ret.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    string r = prefixes[rng() % 7];
+    size_t words = 1 + rng() % 3;
+    for (size_t w = 0; w < words; ++w) {
+      if (w)
+        r += '_';
+      size_t len = 1 + rng() % 4;
+      for (size_t s = 0; s < len; ++s) {
+        r += syllables[rng() % 20];
+      }
+      r[0] &= ~0x20;
+    }
+    r += "_" + to_string(rng() % n);
+    if (rng() % 10 == 0)
+      r += string("\0", 1) + "Label of " + r;
+    ret.push_back(r);
+  }
+  return ret;
+}
+
+template<typename F>
+double run(const string &name, const vector<string> &labels, F sort_labels, double baseline) {
+  vector<string> values = labels;
+  auto start = chrono::steady_clock::now();
+  sort_labels(values);
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  cout << setw(36) << left << name << setw(8) << right << fixed << setprecision(3) << seconds << "s";
+  if (baseline)
+    cout << setw(8) << setprecision(2) << baseline / seconds << "x";
+  if (!is_sorted(values.begin(), values.end()))
+    cout << "  NOT SORTED";
+  cout << endl;
+  return seconds;
+}
+
+int main(int argc, char **argv) {
+  size_t n = argc > 1 ? stoul(argv[1]) : 10000000;
+  vector<string> labels = make_labels(n);
+
+  const size_t cores = thread::hardware_concurrency();
+  cout << n << " labels, " << cores << " cores" << endl;
+  double baseline = run("std::sort", labels, [](vector<string> &v) {
+    sort(v.begin(), v.end());
+  }, 0);
+  for (size_t t = 2; t <= max((size_t)8, 2 * cores); t *= 2) {
+    run("parallel_sort, " + to_string(t) + " threads", labels, [&](vector<string> &v) {
+      parallel_sort(v.begin(), v.end(), less<string>(), t);
+    }, baseline);
+    run("parallel_sample_sort, " + to_string(t) + " threads", labels, [&](vector<string> &v) {
+      parallel_sample_sort(v.begin(), v.end(), less<string>(), t);
+    }, baseline);
+  }
+  return 0;
+}
@@ -1,6 +1,21 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 #include "../data.hpp"
+#include "../link_builder.hpp"
+#include <queue>
+#include "../parallel_sort.hpp"
+#include "../graph_bfs.hpp"
+#include "../parallel_bfs.hpp"
+#include "../component_builder.hpp"
+#include "../distance_index_builder.hpp"
+#include "../landmark_builder.hpp"
+#include "../link_order_builder.hpp"
+#include "../ntriples_tokenizer.hpp"
+#include "../escaped_list_ignore.hpp"
+#include "../commandline_interface.hpp"
+#include <boost/tokenizer.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
 
 
 namespace {
@@ -8,11 +23,12 @@ namespace {
 class WikiDataUnidirectional : public ::testing::Test {
 protected:
   void SetUp() {
-    data.links.resize(4);
-    data.add_link_unsafe(0, 1, true);
-    data.add_link_unsafe(0, 2, true);
-    data.add_link_unsafe(0, 3, true);
-    data.add_link_unsafe(3, 0, true);
+    LinkBuilder links(4, 2);
+    links.add_link_unsafe(0, 1);
+    links.add_link_unsafe(0, 2);
+    links.add_link_unsafe(0, 3);
+    links.add_link_unsafe(3, 0);
+    links.build(data, 2);
   }
 
   WikiData data;
@@ -97,18 +113,15 @@ TEST_F(WikiDataUnidirectional, PagelinkExportAndHelpers) {
 class WikiDataBidirectional : public ::testing::Test {
 protected:
   void SetUp() {
-    data.links.resize(4);
-    data.add_link_unsafe(0, 1, true);
-    data.add_link_unsafe(1, 0, false);
-
-    data.add_link_unsafe(0, 2, true);
-    data.add_link_unsafe(2, 0, false);
-  
-    data.add_link_unsafe(0, 3, true);
-    data.add_link_unsafe(3, 0, false);
-
-    data.add_link_unsafe(3, 0, true);
-    data.add_link_unsafe(0, 3, false);
+    LinkBuilder links(4, 2);
+    links.add_link_unsafe(0, 1);
+    links.add_link_unsafe(0, 2);
+    links.add_link_unsafe(0, 3);
+    links.add_link_unsafe(3, 0);
+    // duplicates are merged
+    links.add_link_unsafe(0, 3);
+    // the incoming links are the transposed outgoing ones
+    links.build(data, 2, true);
   }
 
   WikiData data;
@@ -203,6 +216,1003 @@ TEST_F(WikiDataBidirectional, PagelinkExportAndHelpers) {
   EXPECT_TRUE(WikiData::is_link_to_article(links[0], 0));
 };
 
+class WikiDataLabels : public ::testing::Test {
+protected:
+  void SetUp() {
+    // enough entries for several front coding blocks, many with long
+    // shared prefixes.
+    for (size_t i = 0; i < 100; ++i) {
+      resources.push_back("Article_" + to_string(i));
+      resources.push_back("Article_" + to_string(i) + "_(disambiguation)");
+    }
+    resources.push_back("A");
+    resources.push_back("Ab");
+    resources.push_back("Zebra");
+    sort(resources.begin(), resources.end());
+
+    vector<string> compressed;
+    for (const string &r: resources) {
+      if (r == "Zebra") {
+        compressed.push_back(r + '\0' + "Custom \"zebra\"");
+      } else {
+        compressed.push_back(r);
+      }
+    }
+    data.set_labels(compressed);
+  }
+
+  vector<string> resources;
+  WikiData data;
+};
+
+
+TEST_F(WikiDataLabels, FindsEveryResource) {
+  ASSERT_EQ(resources.size(), data.label_count());
+  string buffer;
+  for (size_t i = 0; i < resources.size(); ++i) {
+    EXPECT_EQ(i, data.find_by_resource(resources[i]));
+    EXPECT_EQ(resources[i], data.resource_by_id(i, buffer));
+  }
+}
+
+
+TEST_F(WikiDataLabels, MissingResources) {
+  const WikiData::ArticleID missing = -1;
+  EXPECT_EQ(missing, data.find_by_resource(""));
+  EXPECT_EQ(missing, data.find_by_resource("0"));
+  EXPECT_EQ(missing, data.find_by_resource("Article_"));
+  EXPECT_EQ(missing, data.find_by_resource("Article_1_"));
+  EXPECT_EQ(missing, data.find_by_resource("Article_10_(disambiguation)x"));
+  EXPECT_EQ(missing, data.find_by_resource("Article_555"));
+  EXPECT_EQ(missing, data.find_by_resource("B"));
+  EXPECT_EQ(missing, data.find_by_resource("Zebras"));
+  EXPECT_EQ(missing, data.find_by_resource("zzz"));
+
+  WikiData empty;
+  EXPECT_EQ(missing, empty.find_by_resource("A"));
+  EXPECT_THROW(empty.label_by_id(0), std::runtime_error);
+}
+
+
+TEST_F(WikiDataLabels, FindFromHint) {
+  // in order, each search starting at the previous result.
+  WikiData::ArticleID hint = 0;
+  for (size_t i = 0; i < resources.size(); ++i) {
+    hint = data.find_by_resource(resources[i], hint);
+    EXPECT_EQ(i, hint);
+  }
+  // any hint, before or after the resource.
+  for (size_t i = 0; i < resources.size(); i += 7) {
+    for (size_t h = 0; h < resources.size(); h += 13) {
+      EXPECT_EQ(i, data.labels.find_from(resources[i], h));
+    }
+  }
+  const WikiData::ArticleID missing = -1;
+  EXPECT_EQ(missing, data.labels.find_from("", 0));
+  EXPECT_EQ(missing, data.labels.find_from("Article_555", 17));
+  EXPECT_EQ(missing, data.labels.find_from("Zebras", 0));
+  EXPECT_EQ(missing, data.labels.find_from("zzz", resources.size() - 1));
+  WikiData empty;
+  EXPECT_EQ(missing, empty.find_by_resource("A", 0));
+}
+
+
+TEST_F(WikiDataLabels, FindBatch) {
+  // hits and misses, more than a group of keys.
+  vector<string> keys;
+  for (size_t i = 0; i < resources.size(); i += 3) {
+    keys.push_back(resources[i]);
+    keys.push_back(resources[i] + "x");
+  }
+  keys.push_back("");
+  keys.push_back("zzz");
+  vector<boost::string_ref> refs(keys.begin(), keys.end());
+  for (bool index: {false, true}) {
+    if (index)
+      data.build_resource_index();
+    vector<WikiData::ArticleID> found = data.find_by_resource_batch(refs);
+    ASSERT_EQ(keys.size(), found.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      EXPECT_EQ(data.find_by_resource(keys[i]), found[i]) << keys[i];
+    }
+    EXPECT_EQ(0u, found[0]);
+    EXPECT_EQ((WikiData::ArticleID)-1, found[1]);
+  }
+  WikiData empty;
+  EXPECT_EQ((WikiData::ArticleID)-1, empty.find_by_resource_batch(refs)[0]);
+}
+
+
+TEST_F(WikiDataLabels, ResourceIndex) {
+  data.build_resource_index();
+  ASSERT_FALSE(data.resource_index.empty());
+  for (size_t i = 0; i < resources.size(); ++i) {
+    EXPECT_EQ(i, data.find_by_resource(resources[i]));
+  }
+  const WikiData::ArticleID missing = -1;
+  EXPECT_EQ(missing, data.find_by_resource(""));
+  EXPECT_EQ(missing, data.find_by_resource("Article_"));
+  EXPECT_EQ(missing, data.find_by_resource("Article_555"));
+  EXPECT_EQ(missing, data.find_by_resource("Zebras"));
+
+  // replacing the labels drops the index.
+  vector<string> other = { "B", "C" };
+  data.set_labels(other);
+  EXPECT_TRUE(data.resource_index.empty());
+  EXPECT_EQ(1u, data.find_by_resource("C"));
+}
+
+
+TEST_F(WikiDataLabels, LabelIndex) {
+  const WikiData::ArticleID missing = -1;
+  // without the index, custom labels can't be found.
+  EXPECT_EQ(missing, data.find_by_label("Custom \"zebra\""));
+
+  data.build_label_index(4);
+  ASSERT_FALSE(data.label_index.empty());
+  string buffer;
+  for (size_t i = 0; i < resources.size(); ++i) {
+    EXPECT_EQ(i, data.find_by_label(data.label_by_id(i, buffer).to_string()));
+  }
+  EXPECT_EQ(data.find_by_resource("Zebra"), data.find_by_label("Custom \"zebra\""));
+  EXPECT_EQ(missing, data.find_by_label("Zebra"));
+  EXPECT_EQ(missing, data.find_by_label("Article_1"));
+  EXPECT_EQ(missing, data.find_by_label("Article 1 "));
+  EXPECT_EQ(missing, data.find_by_label(""));
+
+  // the index is sorted by label
+  for (size_t i = 1; i < data.label_index.ids.size(); ++i) {
+    string a = data.label_by_id(data.label_index.ids[i - 1]);
+    string b = data.label_by_id(data.label_index.ids[i]);
+    EXPECT_LE(a, b);
+  }
+}
+
+
+TEST_F(WikiDataLabels, Labels) {
+  WikiData::ArticleID zebra = data.find_by_resource("Zebra");
+  EXPECT_EQ("Custom \"zebra\"", data.label_by_id(zebra));
+  EXPECT_EQ("Zebra", data.resource_by_id(zebra));
+
+  WikiData::ArticleID article = data.find_by_resource("Article_42_(disambiguation)");
+  string buffer;
+  EXPECT_EQ("Article 42 (disambiguation)", data.label_by_id(article, buffer));
+  EXPECT_EQ(article, data.find_by_label("Article 42 (disambiguation)"));
+  EXPECT_EQ(1u, data.labels.custom_label_count());
+
+  EXPECT_THROW(data.label_by_id(resources.size()), std::runtime_error);
+  EXPECT_THROW(data.resource_by_id(resources.size()), std::runtime_error);
+}
+
+
+class PathSearch : public ::testing::Test {
+protected:
+  void SetUp() {
+    random_graph(data, n);
+  }
+
+  // a random sparse graph with 3 links per article, with the incoming links
+  // unless 'outgoing_only'.
+  static void random_graph(WikiData &data, size_t n, bool outgoing_only = false) {
+    LinkBuilder links(n, 2);
+    uint32_t x = 4711;
+    for (size_t i = 0; i < 3 * n; ++i) {
+      x = x * 1103515245 + 12345;
+      WikiData::ArticleID from = (x >> 8) % n;
+      x = x * 1103515245 + 12345;
+      WikiData::ArticleID to = (x >> 8) % n;
+      links.add_link_unsafe(from, to);
+    }
+    links.build(data, 2, !outgoing_only);
+  }
+
+  // distances along outgoing (or all) links, using a plain queue.
+  static vector<ParallelBFS::Distance> reference_distances(const WikiData &data,
+      WikiData::ArticleID from, bool undirected) {
+    vector<ParallelBFS::Distance> ret(data.linkdb_size(), -1);
+    queue<WikiData::ArticleID> work;
+    ret[from] = 0;
+    work.push(from);
+    while (!work.empty()) {
+      WikiData::ArticleID current = work.front();
+      work.pop();
+      for (const WikiData::Pagelink& l: data.get_links(current, true, undirected)) {
+        WikiData::ArticleID article = WikiData::to_ArticleID(l);
+        if (ret[article] == (ParallelBFS::Distance)-1) {
+          ret[article] = ret[current] + 1;
+          work.push(article);
+        }
+      }
+    }
+    return ret;
+  }
+
+  // checks that 'path' leads from 'from' to 'to' along existing links.
+  void expect_path(const GraphBFS::Path &path, WikiData::ArticleID from,
+                   WikiData::ArticleID to, bool undirected) {
+    ASSERT_LE(2u, path.size());
+    EXPECT_EQ(from, path.front());
+    EXPECT_EQ(to, path.back());
+    for (size_t i = 0; i + 1 < path.size(); ++i) {
+      EXPECT_TRUE(data.outlink_exists(path[i], path[i + 1]) ||
+                  (undirected && data.outlink_exists(path[i + 1], path[i])));
+    }
+  }
+
+  const size_t n = 300;
+  WikiData data;
+  GraphBFS::ArticleSet exclude;
+};
+
+
+TEST_F(PathSearch, BidirectionalFindsShortestPaths) {
+  EXPECT_TRUE(data.has_incoming_links());
+  for (bool undirected: {false, true}) {
+    for (WikiData::ArticleID from = 0; from < 20; ++from) {
+      for (WikiData::ArticleID to = 20; to < 40; ++to) {
+        GraphBFS bfs(data, exclude, from, to, undirected);
+        BidirectionalBFS bidirectional(data, exclude, from, to, undirected);
+        GraphBFS::Path expected = bfs.next();
+        GraphBFS::Path path = bidirectional.next();
+        ASSERT_EQ(expected.size(), path.size());
+        if (path.size())
+          expect_path(path, from, to, undirected);
+      }
+    }
+  }
+}
+
+
+TEST_F(PathSearch, BidirectionalFurtherPaths) {
+  GraphBFS::Path first;
+  WikiData::ArticleID to = 0;
+  // find a pair with more than one path.
+  for (to = 1; to < n; ++to) {
+    BidirectionalBFS bidirectional(data, exclude, 0, to);
+    first = bidirectional.next();
+    GraphBFS::Path second = bidirectional.next();
+    if (second.size()) {
+      EXPECT_LE(first.size(), second.size());
+      EXPECT_NE(first, second);
+      expect_path(second, 0, to, false);
+      break;
+    }
+  }
+  ASSERT_LT(to, n);
+
+  // without the first path's inner articles, another path is found.
+  exclude.insert(first.begin() + 1, first.end() - 1);
+  BidirectionalBFS bidirectional(data, exclude, 0, to);
+  GraphBFS::Path path;
+  while ((path = bidirectional.next()).size()) {
+    expect_path(path, 0, to, false);
+    for (size_t i = 1; i + 1 < path.size(); ++i) {
+      EXPECT_EQ(0u, exclude.count(path[i]));
+    }
+  }
+  EXPECT_THROW(BidirectionalBFS(data, exclude, 0, 0), std::runtime_error);
+  exclude.insert(to);
+  EXPECT_THROW(BidirectionalBFS(data, exclude, 0, to), std::runtime_error);
+}
+
+
+TEST_F(PathSearch, IncomingLinksAreTransposed) {
+  ASSERT_EQ(data.link_targets.size(), data.inlink_sources.size());
+  for (WikiData::ArticleID a = 0; a < n; ++a) {
+    WikiData::LinkRange in = data.inlinks_of(a);
+    EXPECT_TRUE(is_sorted(in.begin(), in.end()));
+    EXPECT_TRUE(adjacent_find(in.begin(), in.end()) == in.end());
+    for (WikiData::ArticleID from: in) {
+      EXPECT_TRUE(data.outlink_exists(from, a));
+    }
+  }
+}
+
+TEST_F(PathSearch, NoIncomingLinks) {
+  WikiData outgoing;
+  random_graph(outgoing, n, true);
+  EXPECT_FALSE(outgoing.has_incoming_links());
+
+  // top-down steps only
+  ParallelBFS bfs(outgoing, 2);
+  EXPECT_TRUE(reference_distances(outgoing, 3, false) == bfs.distances(3, exclude));
+  EXPECT_EQ(0u, bfs.last_stats().bottom_up_levels);
+
+  // undirected searches as well: bottom-up steps would follow the
+  // outgoing links backwards.
+  WikiData large;
+  random_graph(large, 100000, true);
+  ParallelBFS large_bfs(large, 2);
+  for (WikiData::ArticleID from: {0, 4242}) {
+    EXPECT_TRUE(reference_distances(large, from, true) == large_bfs.distances(from, exclude, true));
+    EXPECT_EQ(0u, large_bfs.last_stats().bottom_up_levels);
+    vector<ParallelBFS::Distance> expected = reference_distances(large, from, true);
+    for (WikiData::ArticleID to: {1, 99999}) {
+      GraphBFS::Path path = large_bfs.path(from, to, exclude, true);
+      if (expected[to] == (ParallelBFS::Distance)-1) {
+        EXPECT_EQ(0u, path.size());
+      } else {
+        ASSERT_EQ(expected[to] + 1, path.size());
+        for (size_t i = 0; i + 1 < path.size(); ++i) {
+          EXPECT_TRUE(large.outlink_exists(path[i], path[i + 1]) ||
+                      large.outlink_exists(path[i + 1], path[i]));
+        }
+      }
+    }
+  }
+}
+
+
+TEST_F(PathSearch, ParallelDistances) {
+  WikiData large;
+  const size_t n_large = 100000;
+  random_graph(large, n_large);
+  for (size_t threads: {1, 3}) {
+    ParallelBFS bfs(large, threads);
+    for (bool undirected: {false, true}) {
+      for (WikiData::ArticleID from: {0, 4242}) {
+        EXPECT_TRUE(reference_distances(large, from, undirected) ==
+                    bfs.distances(from, exclude, undirected));
+        EXPECT_LT(0u, bfs.last_stats().top_down_levels);
+        EXPECT_LT(0u, bfs.last_stats().bottom_up_levels);
+      }
+    }
+  }
+}
+
+
+TEST_F(PathSearch, ParallelPaths) {
+  ParallelBFS bfs(data, 2);
+  for (bool undirected: {false, true}) {
+    for (WikiData::ArticleID from = 0; from < 20; ++from) {
+      vector<ParallelBFS::Distance> expected = reference_distances(data, from, undirected);
+      for (WikiData::ArticleID to = 20; to < 40; ++to) {
+        GraphBFS::Path path = bfs.path(from, to, exclude, undirected);
+        if (expected[to] == (ParallelBFS::Distance)-1) {
+          EXPECT_EQ(0u, path.size());
+        } else {
+          ASSERT_EQ(expected[to] + 1, path.size());
+          expect_path(path, from, to, undirected);
+        }
+      }
+    }
+  }
+
+  // excluded articles are not passed through.
+  GraphBFS::Path first = bfs.path(0, 30, exclude);
+  ASSERT_LT(2u, first.size());
+  exclude.insert(first[1]);
+  const vector<ParallelBFS::Distance> &distances = bfs.distances(0, exclude);
+  EXPECT_EQ(bfs.UNREACHABLE, distances[first[1]]);
+  GraphBFS::Path path = bfs.path(0, 30, exclude);
+  for (WikiData::ArticleID a: path) {
+    EXPECT_NE(first[1], a);
+  }
+  EXPECT_THROW(bfs.path(0, first[1], exclude), std::runtime_error);
+}
+
+
+TEST_F(PathSearch, ParallelSearchesReuseState) {
+  // short and complete searches, with and without excluded articles, on
+  // the same instance: what one search marked must not leak into the next.
+  WikiData large;
+  const size_t n_large = 20000;
+  random_graph(large, n_large);
+  ParallelBFS bfs(large, 2);
+  GraphBFS::ArticleSet excluded;
+  for (WikiData::ArticleID a = 100; a < 20000; a += 97) {
+    excluded.insert(a);
+  }
+  GraphBFS::ArticleSet none;
+  for (size_t round = 0; round < 3; ++round) {
+    for (GraphBFS::ArticleSet *ex: {&none, &excluded}) {
+      for (WikiData::ArticleID from: {1, 5000, 12345}) {
+        for (WikiData::ArticleID to: {2, 7000, 19999}) {
+          GraphBFS::Path expected = GraphBFS(large, *ex, from, to).next();
+          EXPECT_EQ(expected.size(), bfs.path(from, to, *ex).size());
+        }
+      }
+      if (round == 1) {
+        EXPECT_TRUE(reference_distances(large, 1, false) == bfs.distances(1, none));
+        EXPECT_EQ(bfs.UNREACHABLE, bfs.distances(1, excluded)[100]);
+      }
+    }
+  }
+
+  // searches to a direct neighbour only visit a few articles, so only
+  // their words are reset: an article excluded or visited before has to be
+  // found again.
+  for (WikiData::ArticleID from = 0; from < 100; ++from) {
+    vector<WikiData::Pagelink> links = large.get_links(from);
+    if (links.size() < 2)
+      continue;
+    WikiData::ArticleID a = WikiData::to_ArticleID(links[0]), b = WikiData::to_ArticleID(links[1]);
+    if (a == b || a == from || b == from)
+      continue;
+    GraphBFS::ArticleSet only_a;
+    only_a.insert(a);
+    EXPECT_EQ(2u, bfs.path(from, b, only_a).size());
+    EXPECT_EQ(2u, bfs.path(from, a, none).size());
+    EXPECT_EQ(2u, bfs.path(from, b, none).size());
+  }
+  EXPECT_TRUE(reference_distances(large, 1, false) == bfs.distances(1, none));
+}
+
+
+TEST_F(PathSearch, ComponentsMatchReachability) {
+  ComponentBuilder(data, 3).build();
+  const Components &components = data.components;
+  ASSERT_EQ(n, components.weak.size());
+  ASSERT_EQ(n, components.strong.size());
+  vector<vector<ParallelBFS::Distance>> distances;
+  for (WikiData::ArticleID a = 0; a < n; ++a) {
+    distances.push_back(reference_distances(data, a, false));
+  }
+  const ParallelBFS::Distance unreachable = -1;
+  size_t total = 0;
+  for (size_t c = 0; c < components.strong_sizes.size(); ++c) {
+    total += components.strong_sizes[c];
+  }
+  EXPECT_EQ(n, total);
+  for (WikiData::ArticleID a = 0; a < n; ++a) {
+    vector<ParallelBFS::Distance> undirected = reference_distances(data, a, true);
+    size_t weak_size = 0;
+    size_t strong_size = 0;
+    for (WikiData::ArticleID b = 0; b < n; ++b) {
+      bool forward = distances[a][b] != unreachable;
+      bool backward = distances[b][a] != unreachable;
+      EXPECT_EQ(undirected[b] != unreachable, components.weak[a] == components.weak[b]);
+      EXPECT_EQ(forward && backward, components.strong[a] == components.strong[b]);
+      if (forward) {
+        EXPECT_TRUE(components.path_possible(a, b, false));
+      }
+      EXPECT_EQ(undirected[b] != unreachable, components.path_possible(a, b, true));
+      weak_size += undirected[b] != unreachable;
+      strong_size += forward && backward;
+    }
+    EXPECT_EQ(weak_size, components.weak_size(a));
+    EXPECT_EQ(strong_size, components.strong_size(a));
+  }
+}
+
+
+TEST_F(PathSearch, DistanceIndexMatchesBFS) {
+  for (size_t threads: {1, 3}) {
+    DistanceIndexBuilder(data, threads).build(data.distance_index);
+    const DistanceIndex &index = data.distance_index;
+    ASSERT_EQ(n + 1, index.out.offsets.size());
+    for (WikiData::ArticleID from = 0; from < n; ++from) {
+      vector<ParallelBFS::Distance> expected = reference_distances(data, from, false);
+      for (WikiData::ArticleID to = 0; to < n; ++to) {
+        ASSERT_EQ(expected[to], index.distance(from, to));
+      }
+    }
+  }
+  for (WikiData::ArticleID from = 0; from < 20; ++from) {
+    vector<ParallelBFS::Distance> expected = reference_distances(data, from, false);
+    for (WikiData::ArticleID to = 20; to < 40; ++to) {
+      GraphBFS::Path path = distance_index_path(data, from, to);
+      if (expected[to] == (ParallelBFS::Distance)-1) {
+        EXPECT_EQ(0u, path.size());
+      } else {
+        ASSERT_EQ(expected[to] + 1, path.size());
+        expect_path(path, from, to, false);
+      }
+    }
+  }
+}
+
+
+TEST_F(PathSearch, LandmarkSearchFindsShortestPaths) {
+  LandmarkBuilder(data, 4, 2).build(data.landmarks);
+  const Landmarks &landmarks = data.landmarks;
+  ASSERT_EQ(4u, landmarks.size());
+  size_t bfs_visited = 0, astar_visited = 0;
+  for (WikiData::ArticleID from = 0; from < n; from += 7) {
+    vector<ParallelBFS::Distance> expected = reference_distances(data, from, false);
+    for (WikiData::ArticleID to = 0; to < n; ++to) {
+      if (expected[to] != (ParallelBFS::Distance)-1) {
+        ASSERT_LE(landmarks.lower_bound(from, to), expected[to]);
+      }
+      if (from == to)
+        continue;
+      LandmarkSearch search(data, exclude, from, to);
+      GraphBFS::Path path = search.next();
+      if (expected[to] == (ParallelBFS::Distance)-1) {
+        EXPECT_EQ(0u, path.size());
+        continue;
+      }
+      ASSERT_EQ(expected[to] + 1, path.size());
+      expect_path(path, from, to, false);
+      EXPECT_EQ(0u, search.next().size());
+      astar_visited += search.visited_count();
+      GraphBFS bfs(data, exclude, from, to);
+      bfs.next();
+      bfs_visited += bfs.visited_count();
+    }
+  }
+  EXPECT_LT(astar_visited, bfs_visited);
+
+  // paths around excluded articles
+  for (WikiData::ArticleID a = 0; a < n; a += 3) {
+    exclude.insert(a);
+  }
+  for (WikiData::ArticleID to = 1; to < n; to += 3) {
+    GraphBFS bfs(data, exclude, 2, to);
+    LandmarkSearch search(data, exclude, 2, to);
+    EXPECT_EQ(bfs.next().size(), search.next().size());
+  }
+}
+
+
+TEST_F(PathSearch, CompressedLinks) {
+  WikiData compressed;
+  random_graph(compressed, n);
+  compressed.compress_links();
+  EXPECT_FALSE(compressed.compressed_links.empty());
+  EXPECT_TRUE(compressed.link_targets.empty());
+  EXPECT_EQ(data.link_count(), compressed.link_count());
+  EXPECT_THROW(ComponentBuilder(compressed, 2).build(), std::runtime_error);
+
+  vector<WikiData::ArticleID> buffer;
+  for (WikiData::ArticleID a = 0; a < n; ++a) {
+    WikiData::LinkRange links = compressed.outlinks_of(a, buffer);
+    vector<WikiData::ArticleID> expected(data.link_targets.begin() + data.link_offsets[a],
+                                         data.link_targets.begin() + data.link_offsets[a + 1]);
+    EXPECT_EQ(expected, vector<WikiData::ArticleID>(links.begin(), links.end()));
+    EXPECT_EQ(data.get_links(a, true, true), compressed.get_links(a, true, true));
+  }
+
+  ParallelBFS parallel(compressed, 2);
+  for (bool undirected: {false, true}) {
+    for (WikiData::ArticleID from = 0; from < 10; ++from) {
+      vector<ParallelBFS::Distance> expected = reference_distances(data, from, undirected);
+      EXPECT_TRUE(expected == parallel.distances(from, exclude, undirected));
+      for (WikiData::ArticleID to = 20; to < 30; ++to) {
+        size_t length = expected[to] == (ParallelBFS::Distance)-1 ? 0 : expected[to] + 1;
+        EXPECT_EQ(length, GraphBFS(compressed, exclude, from, to, undirected).next().size());
+        EXPECT_EQ(length, BidirectionalBFS(compressed, exclude, from, to, undirected).next().size());
+      }
+    }
+  }
+}
+
+
+TEST(LinkBuilder, BuffersFromThreads) {
+  // the same random links, added directly and through one Buffer per thread.
+  const size_t n = 5000, n_links = 100000, n_threads = 4;
+  vector<pair<WikiData::ArticleID, WikiData::ArticleID>> links;
+  uint32_t x = 3;
+  for (size_t i = 0; i < n_links; ++i) {
+    x = x * 1103515245 + 12345;
+    WikiData::ArticleID from = (x >> 8) % (n + 10);
+    x = x * 1103515245 + 12345;
+    links.push_back(make_pair(from, (x >> 8) % n));
+  }
+  WikiData expected, buffered;
+  LinkBuilder direct(n, 8);
+  for (auto &link: links) {
+    direct.add_link_unsafe(link.first, link.second);
+  }
+  direct.build(expected, 2, true);
+
+  LinkBuilder builder(n, 8);
+  vector<size_t> added(n_threads);
+  vector<thread> threads;
+  for (size_t t = 0; t < n_threads; ++t) {
+    threads.push_back(thread([&, t]() {
+      LinkBuilder::Buffer buffer(builder);
+      for (size_t i = t; i < links.size(); i += n_threads) {
+        buffer.add_link(links[i].first, links[i].second);
+      }
+      added[t] = buffer.size();
+    }));
+  }
+  for (thread &t: threads) {
+    t.join();
+  }
+  builder.build(buffered, 2, true);
+  EXPECT_GT(added[0] + added[1] + added[2] + added[3], 0u);
+  EXPECT_LT(added[0] + added[1] + added[2] + added[3], n_links);
+  EXPECT_TRUE(expected.link_offsets.vec() == buffered.link_offsets.vec());
+  EXPECT_TRUE(expected.link_targets.vec() == buffered.link_targets.vec());
+  EXPECT_TRUE(expected.inlink_sources.vec() == buffered.inlink_sources.vec());
+}
+
+
+TEST(Components, SmallGraph) {
+  WikiData data;
+  LinkBuilder links(7, 2);
+  links.add_link_unsafe(0, 1);
+  links.add_link_unsafe(1, 2);
+  links.add_link_unsafe(2, 0);
+  links.add_link_unsafe(2, 3);
+  links.add_link_unsafe(5, 6);
+  links.add_link_unsafe(6, 5);
+  links.build(data, 2);
+  EXPECT_TRUE(data.components.path_possible(3, 0, false));
+  ComponentBuilder(data, 2).build();
+
+  const Components &components = data.components;
+  EXPECT_EQ(3u, components.weak_sizes.size());
+  EXPECT_EQ(4u, components.strong_sizes.size());
+  EXPECT_EQ(4u, components.weak_size(3));
+  EXPECT_EQ(1u, components.weak_size(4));
+  EXPECT_EQ(3u, components.strong_size(1));
+  EXPECT_EQ(1u, components.strong_size(3));
+  EXPECT_EQ(2u, components.strong_size(6));
+  EXPECT_TRUE(components.path_possible(0, 3, false));
+  EXPECT_FALSE(components.path_possible(3, 0, false));
+  EXPECT_TRUE(components.path_possible(3, 0, true));
+  EXPECT_FALSE(components.path_possible(0, 4, true));
+  EXPECT_FALSE(components.path_possible(0, 5, true));
+
+  // new links invalidate them.
+  links.build(data, 2);
+  EXPECT_TRUE(components.empty());
+}
+
+
+TEST(CLI, NoPathBetweenComponents) {
+  WikiData data;
+  LinkBuilder links(5, 2);
+  links.add_link_unsafe(0, 1);
+  links.add_link_unsafe(1, 2);
+  links.add_link_unsafe(3, 4);
+  links.build(data, 2);
+  ComponentBuilder(data, 2).build();
+  CLI cli(data);
+
+  auto query = [&](string input) {
+    stringstream out;
+    streambuf *original = cout.rdbuf(out.rdbuf());
+    cli.run_query(input);
+    cout.rdbuf(original);
+    return out.str();
+  };
+  // no path against the links, none between the weak components.
+  EXPECT_EQ("no path\n", query("path 2 0"));
+  EXPECT_EQ("no path\n", query("path-undirected 0 3"));
+  EXPECT_EQ(0u, query("distance 0 4").find("no path (components, "));
+  // the method that answered the query.
+  EXPECT_EQ(0u, query("distance 1 1").find("distance 0 (trivial, "));
+  EXPECT_EQ(0u, query("distance 0 2").find("distance 2 (BFS, "));
+}
+
+
+TEST(CLI, LandmarksOnlyWithoutInlinks) {
+  vector<string> outputs;
+  for (bool incoming: { false, true }) {
+    WikiData data;
+    vector<string> resources = { "A", "B", "C", "D" };
+    data.set_labels(resources);
+    LinkBuilder links(4, 2);
+    links.add_link_unsafe(0, 1);
+    links.add_link_unsafe(1, 2);
+    links.add_link_unsafe(2, 3);
+    links.build(data, 2, incoming);
+    LandmarkBuilder(data, 2, 2).build(data.landmarks);
+    CLI cli(data);
+
+    string input = "path 0 3";
+    stringstream out;
+    streambuf *original = cout.rdbuf(out.rdbuf());
+    cli.run_query(input);
+    cout.rdbuf(original);
+    outputs.push_back(out.str());
+  }
+  size_t note = outputs[0].find("(A* search");
+  ASSERT_NE(string::npos, note);
+  // the bidirectional search is faster than A*, the path is the same.
+  EXPECT_EQ(outputs[0].substr(0, note), outputs[1]);
+}
+
+
+TEST(ArticleBitset, Membership) {
+  ArticleBitset set;
+  EXPECT_TRUE(set.empty());
+  EXPECT_EQ(0u, set.count(5));
+  EXPECT_TRUE(set.insert(5));
+  EXPECT_TRUE(set.insert(64));
+  EXPECT_TRUE(set.insert(1000));
+  EXPECT_FALSE(set.insert(64));
+  EXPECT_EQ(3u, set.size());
+  EXPECT_EQ(1u, set.count(5));
+  EXPECT_EQ(1u, set.count(64));
+  EXPECT_EQ(1u, set.count(1000));
+  EXPECT_EQ(0u, set.count(63));
+  EXPECT_EQ(0u, set.count(1001));
+  EXPECT_EQ(0u, set.count(-1));
+  EXPECT_EQ((uint64_t)1, set.word(1));
+
+  set.clear();
+  EXPECT_TRUE(set.empty());
+  EXPECT_EQ(0u, set.count(64));
+  vector<WikiData::ArticleID> ids = { 1, 2, 2, 3 };
+  set.insert(ids.begin(), ids.end());
+  EXPECT_EQ(3u, set.size());
+}
+
+
+TEST(BFSWorkspace, ReusedAcrossSearches) {
+  BFSWorkspacePool pool;
+  BFSWorkspace *first;
+  {
+    BFSWorkspacePool::Handle workspace = pool.acquire(100);
+    first = &*workspace;
+    workspace->set(7, 3);
+    EXPECT_TRUE(workspace->is_set(7));
+    EXPECT_EQ(3u, workspace->parent(7));
+    EXPECT_FALSE(workspace->is_set(8));
+    for (WikiData::ArticleID a = 0; a < 100; ++a) {
+      workspace->push(a);
+    }
+    EXPECT_EQ(0u, workspace->pop());
+    workspace->push(100);
+  }
+  BFSWorkspacePool::Handle workspace = pool.acquire(100);
+  EXPECT_EQ(first, &*workspace);
+  EXPECT_FALSE(workspace->is_set(7));
+  EXPECT_TRUE(workspace->queue_empty());
+  // a second search at the same time gets its own workspace.
+  BFSWorkspacePool::Handle other = pool.acquire(100);
+  EXPECT_NE(first, &*other);
+}
+
+
+TEST_F(PathSearch, ReorderedLinks) {
+  for (LinkOrderBuilder::Method method: {LinkOrderBuilder::DEGREE, LinkOrderBuilder::BFS}) {
+    for (bool outgoing_only: {false, true}) {
+      WikiData reordered;
+      random_graph(reordered, n, outgoing_only);
+      LinkOrderBuilder(reordered, 2).build(method);
+      // twice, the second order applies to the first one.
+      LinkOrderBuilder(reordered, 2).build(LinkOrderBuilder::DEGREE);
+      ASSERT_TRUE(reordered.is_reordered());
+      ASSERT_EQ(n, reordered.vertex_articles.size());
+      EXPECT_EQ(data.link_count(), reordered.link_count());
+      for (WikiData::ArticleID a = 0; a < n; ++a) {
+        EXPECT_EQ(a, reordered.article_of(reordered.vertex_of(a)));
+        EXPECT_EQ(data.get_links(a, true, !outgoing_only), reordered.get_links(a, true, !outgoing_only));
+        WikiData::LinkRange in = reordered.inlinks_of(a);
+        EXPECT_TRUE(is_sorted(in.begin(), in.end()));
+      }
+      EXPECT_TRUE(reordered.outlink_exists(0, WikiData::to_ArticleID(data.get_links(0)[0])));
+      EXPECT_FALSE(reordered.outlink_exists(0, n));
+
+      // the searches work on vertex ids.
+      ParallelBFS bfs(reordered, 2);
+      for (WikiData::ArticleID from = 0; from < 10; ++from) {
+        vector<ParallelBFS::Distance> expected = reference_distances(data, from, false);
+        const vector<ParallelBFS::Distance> &distances =
+          bfs.distances(reordered.vertex_of(from), exclude);
+        for (WikiData::ArticleID a = 0; a < n; ++a) {
+          EXPECT_EQ(expected[a], distances[reordered.vertex_of(a)]);
+        }
+        GraphBFS::Path path = GraphBFS(reordered, exclude, reordered.vertex_of(from),
+                                       reordered.vertex_of(30)).next();
+        EXPECT_EQ(expected[30] == (ParallelBFS::Distance)-1 ? 0 : expected[30] + 1, path.size());
+        for (WikiData::ArticleID &v: path) {
+          v = reordered.article_of(v);
+        }
+        if (path.size())
+          expect_path(path, from, 30, false);
+      }
+    }
+  }
+
+  // the BFS order follows incoming links, whether they were read or not:
+  // from 0 back to 1 and 3, then to 2.
+  for (bool incoming: {false, true}) {
+    WikiData small;
+    LinkBuilder links(4, 2);
+    links.add_link_unsafe(1, 0);
+    links.add_link_unsafe(2, 1);
+    links.add_link_unsafe(3, 0);
+    links.build(small, 2, incoming);
+    LinkOrderBuilder(small, 2).build(LinkOrderBuilder::BFS);
+    EXPECT_EQ(vector<WikiData::ArticleID>({0, 1, 3, 2}), small.vertex_articles.vec());
+  }
+
+  // a new link database starts in article order.
+  WikiData reordered;
+  random_graph(reordered, n);
+  LinkOrderBuilder(reordered, 2).build(LinkOrderBuilder::BFS);
+  random_graph(reordered, n);
+  EXPECT_FALSE(reordered.is_reordered());
+  EXPECT_EQ(LinkOrderBuilder::BFS, LinkOrderBuilder::parse_method("bfs"));
+  EXPECT_THROW(LinkOrderBuilder::parse_method("random"), std::runtime_error);
+}
+
+
+TEST(CompressedLinks, RoundTrip) {
+  // lists of 0 to 9 ids, with differences of every byte length.
+  vector<uint32_t> offsets = { 0 };
+  vector<uint32_t> values;
+  uint32_t x = 42;
+  for (size_t list = 0; list < 200; ++list) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < list % 10; ++i) {
+      x = x * 1103515245 + 12345;
+      value += (x >> (8 * (x % 4))) / 64 + 1;
+      values.push_back(value);
+    }
+    offsets.push_back(values.size());
+  }
+  FlatArray<uint32_t> list_offsets, list_values;
+  list_offsets.vec() = offsets;
+  list_values.vec() = values;
+
+  CompressedLinks compressed;
+  compressed.build(list_offsets, list_values);
+  EXPECT_EQ(offsets.size(), compressed.offsets.size());
+  vector<uint32_t> decoded;
+  for (size_t list = 0; list + 1 < offsets.size(); ++list) {
+    vector<uint32_t> expected(values.begin() + offsets[list], values.begin() + offsets[list + 1]);
+    compressed.decode(list, expected.size(), decoded);
+    EXPECT_EQ(expected, decoded);
+    compressed.decode_scalar(list, expected.size(), decoded);
+    EXPECT_EQ(expected, decoded);
+#ifdef COMPRESSED_LINKS_SSSE3
+    if (__builtin_cpu_supports("ssse3")) {
+      compressed.decode_ssse3(list, expected.size(), decoded);
+      EXPECT_EQ(expected, decoded);
+    }
+#endif
+  }
+}
+
+
+TEST(NTriplesTokenizer, Labels) {
+  NTriplesTokenizer tokens;
+  string line = "<http://dbpedia.org/resource/K%C3%B6nigsberg> <http://www.w3.org/2000/01/rdf-schema#label> "
+    "\"K\\u00F6nigsberg \\\"bridges\\\"\"@en .";
+  ASSERT_EQ(3u, tokens.tokenize(line, 3));
+  EXPECT_EQ("<http://dbpedia.org/resource/K%C3%B6nigsberg>", tokens.term(0));
+  // unquoted without copying
+  EXPECT_EQ(line.data(), tokens.term(0).data());
+  EXPECT_EQ("K\\u00F6nigsberg \"bridges\"@en", tokens.term(2));
+  EXPECT_EQ("K\\u00F6nigsberg \"bridges\"", parse_nt_string(tokens.term(2)));
+  EXPECT_EQ(4u, tokens.tokenize(line));
+  EXPECT_EQ(".", tokens.term(3));
+
+  EXPECT_EQ(2u, tokens.tokenize("a b", 3));
+  EXPECT_EQ(3u, tokens.tokenize("a b ", 3));
+  EXPECT_EQ("", tokens.term(2));
+  EXPECT_EQ((size_t)-1, tokens.tokenize("a b \\"));
+  EXPECT_EQ(0u, tokens.tokenize(""));
+}
+
+
+TEST(NTriplesTokenizer, MatchesBoostTokenizers) {
+  // random lines of the characters that matter, long enough for the
+  // 16 byte steps.
+  const string alphabet = "  \"\\nu<>a@_.";
+  uint32_t x = 7;
+  NTriplesTokenizer tokens;
+  for (size_t l = 0; l < 20000; ++l) {
+    string line;
+    size_t length = l % 60;
+    for (size_t i = 0; i < length; ++i) {
+      x = x * 1103515245 + 12345;
+      line.push_back(alphabet[(x >> 16) % alphabet.size()]);
+    }
+
+    vector<string> expected;
+    split(expected, line, is_any_of(" "));
+    size_t count = tokens.split(line);
+    ASSERT_EQ(expected.size(), count);
+    for (size_t i = 0; i < min(count, (size_t)NTriplesTokenizer::max_terms); ++i) {
+      EXPECT_EQ(expected[i], tokens.term(i));
+    }
+
+    expected.clear();
+    bool escape_at_end = false;
+    try {
+      escaped_list_separator_includeinvalid<char> ls('\\', ' ', '\"');
+      tokenizer<escaped_list_separator_includeinvalid<char>> tok(line, ls);
+      // incrementing parses the next token already.
+      for (auto it = tok.begin(); it != tok.end(); ++it) {
+        expected.push_back(*it);
+        if (expected.size() == NTriplesTokenizer::max_terms)
+          break;
+      }
+    } catch (const escaped_list_error &) {
+      escape_at_end = true;
+    }
+    count = tokens.tokenize(line);
+    if (escape_at_end) {
+      EXPECT_EQ((size_t)-1, count) << line;
+      continue;
+    }
+    ASSERT_EQ(expected.size(), count) << line;
+    for (size_t i = 0; i < count; ++i) {
+      EXPECT_EQ(expected[i], tokens.term(i)) << line;
+    }
+  }
+}
+
+
+TEST(ParseUtil, AbbrRessource) {
+  auto abbr = [](string resource) {
+    abbr_ressource(resource);
+    return resource;
+  };
+  EXPECT_EQ("K\xC3\xB6nigsberg", abbr("<http://dbpedia.org/resource/K%C3%B6nigsberg>"));
+  EXPECT_EQ("Graph theory", abbr("<http://simple.dbpedia.org/resource/Graph+theory>"));
+  EXPECT_EQ("100%", abbr("<http://dbpedia.org/resource/100%%>"));
+  // the prefix has to start within the first 15 characters.
+  EXPECT_EQ("http://www.simple.dbpedia.org/resource/A", abbr("<http://www.simple.dbpedia.org/resource/A>"));
+  EXPECT_EQ("http://example.org/A", abbr("<http://example.org/A>"));
+  EXPECT_EQ("<>", abbr("<>"));
+  // invalid escapes leave the resource undecoded.
+  EXPECT_EQ("100%_Pure+Juice", abbr("<http://dbpedia.org/resource/100%_Pure+Juice>"));
+  EXPECT_EQ("A_rather_long_resource_name_(with)_the_escape_at_the_end_\xC3\xB6",
+            abbr("A_rather_long_resource_name_%28with%29_the_escape_at_the_end_%C3%B6"));
+
+  // random escapes without tags agree with urldecode.
+  const string alphabet = "%%++aF0_";
+  uint32_t x = 11;
+  for (size_t l = 0; l < 10000; ++l) {
+    string resource;
+    for (size_t i = 0; i < l % 40; ++i) {
+      x = x * 1103515245 + 12345;
+      resource.push_back(alphabet[(x >> 16) % alphabet.size()]);
+    }
+    string expected;
+    if (!urldecode(expected, resource))
+      expected = resource;
+    EXPECT_EQ(expected, abbr(resource)) << resource;
+  }
+}
+
+
+TEST(ParallelSort, SortsLikeSort) {
+  vector<uint32_t> values;
+  uint32_t x = 12345;
+  for (size_t i = 0; i < 100000; ++i) {
+    x = x * 1103515245 + 12345;
+    values.push_back(x % 5000);
+  }
+  vector<uint32_t> expected = values;
+  sort(expected.begin(), expected.end());
+  for (size_t threads: {1, 2, 3, 8}) {
+    vector<uint32_t> sorted = values;
+    parallel_sort(sorted.begin(), sorted.end(), less<uint32_t>(), threads);
+    EXPECT_TRUE(expected == sorted);
+  }
+}
+
+
+
+TEST(ParallelSort, SampleSortSortsStrings) {
+  // few distinct first characters and many duplicates, so buckets differ in size.
+  vector<string> values;
+  uint32_t x = 12345;
+  for (size_t i = 0; i < 50000; ++i) {
+    x = x * 1103515245 + 12345;
+    string s(1, 'A' + (x >> 16) % 3);
+    s += to_string((x >> 8) % 2000);
+    if (i % 7 == 0)
+      s += string("\0", 1) + "label";
+    values.push_back(s);
+  }
+  vector<string> expected = values;
+  sort(expected.begin(), expected.end());
+  for (size_t threads: {1, 2, 3, 8}) {
+    vector<string> sorted = values;
+    parallel_sample_sort(sorted.begin(), sorted.end(), less<string>(), threads);
+    EXPECT_TRUE(expected == sorted);
+  }
+  // sorted input, and all elements equal.
+  vector<string> sorted = expected;
+  parallel_sample_sort(sorted.begin(), sorted.end(), less<string>(), 4);
+  EXPECT_TRUE(expected == sorted);
+  vector<string> same(20000, "x");
+  parallel_sample_sort(same.begin(), same.end(), less<string>(), 4);
+  EXPECT_EQ(vector<string>(20000, "x"), same);
+}
+
 }; // namespace
 
 int main(int argc, char ** argv) {
@@ -1,9 +1,13 @@
 #include <iostream>
 #include <string>
+#include <thread>
 #include <boost/program_options.hpp>
 #include "data.hpp"
 #include "commandline_interface.hpp"
 #include "read.hpp"
+#include "snapshot.hpp"
+#include "distance_index_builder.hpp"
+#include "landmark_builder.hpp"
 
 using namespace std;
 namespace po = boost::program_options;
@@ -13,53 +17,152 @@ int main(int argc, char ** argv) {
   po::options_description desc("Options");
   desc.add_options()
     ("help", "this help message")
-    ("labels", po::value<string>(), "labels file (required)")
+    ("labels", po::value<string>(), "labels file (required unless --load-snapshot is given)")
     ("links", po::value<string>(), "page link file")
-    ("inlinks", "add incoming links");
+    ("inlinks", "add incoming links")
+    ("decompress-threads", po::value<size_t>(), "number of bz2 decompression threads (default: number of cores)")
+    ("label-threads", po::value<size_t>(), "number of label parsing threads (default: number of cores)")
+    ("no-resource-index", "don't build the resource hash index (saves 8 bytes per article, slows down the link import)")
+    ("no-components", "don't compute the connected components (saves 8 bytes per article, path queries without result take longer)")
+    ("distance-index", "build the distance index for exact distance queries (if not loaded from the snapshot)")
+    ("landmarks", po::value<size_t>(), "compute distances to/from this many landmarks for A* path searches (if not loaded from the snapshot)")
+    ("reorder-links", po::value<string>(), "store the link database in 'degree' or 'bfs' order for faster searches (when reading --links)")
+    ("compress-links", "keep the outgoing links compressed (StreamVByte) to save memory")
+    ("save-snapshot", po::value<string>(), "write the loaded database to a snapshot file")
+    ("load-snapshot", po::value<string>(), "load the database from a snapshot file instead of --labels/--links")
+    ("verify-snapshot", "verify the checksums of the whole snapshot when loading it")
+    ("bfs-threads", po::value<size_t>(), "number of threads of the parallel BFS (default: number of cores)");
 
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
   po::notify(vm);
 
-  if (vm.count("help") || !vm.count("labels")) {
+  if (vm.count("help") || (!vm.count("labels") && !vm.count("load-snapshot"))) {
     cout << desc << endl;
     return 1;
   }
 
-  string labelsfile = vm["labels"].as<string>();
+  string labelsfile = "";
+  if (vm.count("labels")) {
+    labelsfile = vm["labels"].as<string>();
+  }
   string linkfile = "";
   if (vm.count("links")) {
     linkfile = vm["links"].as<string>();
   }
 
+  if (vm.count("decompress-threads"))
+    decompress_threads = vm["decompress-threads"].as<size_t>();
+
+  if (vm.count("label-threads"))
+    label_threads = vm["label-threads"].as<size_t>();
+
+  size_t bfs_threads = max(1u, thread::hardware_concurrency());
+  if (vm.count("bfs-threads")) {
+    bfs_threads = vm["bfs-threads"].as<size_t>();
+    if (!bfs_threads) {
+      cerr << "--bfs-threads needs at least one thread" << endl;
+      return 1;
+    }
+  }
+
+  if (vm.count("no-resource-index"))
+    use_resource_index = false;
+
+  if (vm.count("no-components"))
+    use_components = false;
+
+  if (vm.count("reorder-links")) {
+    try {
+      link_order = LinkOrderBuilder::parse_method(vm["reorder-links"].as<string>());
+    } catch (const std::runtime_error &e) {
+      cerr << e.what() << endl;
+      return 1;
+    }
+  }
+
   bool incoming = false;
   if (vm.count("inlinks"))
     incoming = true;
 
   WikiData data;
   auto clock_start = chrono::system_clock::now();
-  read_labels(data, labelsfile);
-  auto clock_labels_done = chrono::system_clock::now();
-  cout << "Loading " << data.labels.size() << " labels took " << 
-    chrono::duration_cast<chrono::seconds>(clock_labels_done-clock_start).count()
-    << " seconds. " << endl;
-  if (linkfile.size()) {
-    data.links.resize(data.labels.size());
-    size_t n_pagelinks = read_page_links(data, linkfile, incoming);
-    auto clock_pagelinks_done = chrono::system_clock::now();
-    cout << "Loading " << n_pagelinks << " page links took " <<
-      chrono::duration_cast<chrono::seconds>(clock_pagelinks_done - clock_labels_done).count()
+  if (vm.count("load-snapshot")) {
+    string snapshotfile = vm["load-snapshot"].as<string>();
+    try {
+      load_snapshot(data, snapshotfile, vm.count("verify-snapshot"));
+    } catch (const std::runtime_error &e) {
+      cerr << e.what() << endl;
+      return 1;
+    }
+    cout << "Loading " << data.label_count() << " labels and " <<
+      data.link_count() << " page links from snapshot took " <<
+      chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now() - clock_start).count()
+      << " ms. " << endl;
+  } else {
+    read_labels(data, labelsfile);
+    auto clock_labels_done = chrono::system_clock::now();
+    cout << "Loading " << data.label_count() << " labels took " << 
+      chrono::duration_cast<chrono::seconds>(clock_labels_done-clock_start).count()
       << " seconds. " << endl;
+    if (linkfile.size()) {
+      size_t n_pagelinks = read_page_links(data, linkfile, incoming);
+      auto clock_pagelinks_done = chrono::system_clock::now();
+      cout << "Loading " << n_pagelinks << " page links took " <<
+        chrono::duration_cast<chrono::seconds>(clock_pagelinks_done - clock_labels_done).count()
+        << " seconds. " << endl;
+    }
+
+    // duplicate output to make it easier to find.
+    cout << "Loading " << data.label_count() << " labels took " << 
+      chrono::duration_cast<chrono::seconds>(clock_labels_done-clock_start).count()
+      << " seconds. " << endl;
+    cout << "Label compression removed " << nolabel << " labels." << endl;
   }
 
-  // duplicate output to make it easier to find.
-  cout << "Loading " << data.labels.size() << " labels took " << 
-    chrono::duration_cast<chrono::seconds>(clock_labels_done-clock_start).count()
-    << " seconds. " << endl;
-  cout << "Label compression removed " << nolabel << " labels." << endl;
-  
+  if (vm.count("distance-index") && data.distance_index.empty() && data.linkdb_size()) {
+    auto start = chrono::steady_clock::now();
+    try {
+      DistanceIndexBuilder(data, max(1u, thread::hardware_concurrency())).build(data.distance_index);
+      cout << "Building the distance index took " <<
+        chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
+        << " ms: " << data.distance_index.entry_count() << " label entries, " <<
+        (double)data.distance_index.memory_usage() / data.linkdb_size() << " bytes per article." << endl;
+    } catch (const std::runtime_error &e) {
+      data.distance_index.clear();
+      cerr << e.what() << endl;
+    }
+  }
+
+  if (vm.count("landmarks") && data.landmarks.empty() && data.linkdb_size()) {
+    auto start = chrono::steady_clock::now();
+    LandmarkBuilder(data, vm["landmarks"].as<size_t>(), max(1u, thread::hardware_concurrency())).build(data.landmarks);
+    cout << "Computing the distances of " << data.landmarks.size() << " landmarks took " <<
+      chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
+      << " ms, using " << data.landmarks.memory_usage() / 1024.0 / 1024.0 << " MB." << endl;
+  }
+
+  if (vm.count("compress-links") && data.compressed_links.empty() && data.linkdb_size()) {
+    auto start = chrono::steady_clock::now();
+    size_t uncompressed = data.link_targets.size() * sizeof(WikiData::ArticleID);
+    data.compress_links();
+    cout << "Compressing the links took " <<
+      chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count()
+      << " ms: " << uncompressed / (1024.0 * 1024) << " MB -> "
+      << data.compressed_links.memory_usage() / (1024.0 * 1024) << " MB." << endl;
+  }
+
+  if (vm.count("save-snapshot")) {
+    string snapshotfile = vm["save-snapshot"].as<string>();
+    try {
+      save_snapshot(data, snapshotfile);
+      cout << "Wrote snapshot " << snapshotfile << endl;
+    } catch (const std::runtime_error &e) {
+      cerr << e.what() << endl;
+    }
+  }
 
-  CLI cli(data);
+  CLI cli(data, bfs_threads);
   cli.run();
   return 0;
 }